@@ -0,0 +1,48 @@
+/* Host-side CRC-8 kernel benchmark, built once per CRC8_IMPL:
+ *   make -C bench run
+ * Checks the selected kernel against the bitwise reference and reports
+ * throughput. Use the 'crcbench' console command for cycles on target.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "utils/crc.h"
+
+namespace {
+
+uint8_t reference(const uint8_t *data, uint16_t len) {
+    uint8_t crc = 0;
+    while (len--) {
+        crc ^= *data++;
+        for (uint8_t i = 0; i < 8; i++) crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
+
+double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+}
+
+int main() {
+    static uint8_t buf[256];
+    for (uint16_t i = 0; i < sizeof(buf); i++) buf[i] = rand();
+    for (uint16_t len = 0; len <= sizeof(buf); len++) {
+        if (utils::crc8(buf, len) != reference(buf, len)) {
+            printf("CRC8 impl %d: mismatch at len %u\n", CRC8_IMPL, len);
+            return 1;
+        }
+    }
+    const uint32_t rounds = 200000;
+    volatile uint8_t sink = 0;
+    double t0 = now_ns();
+    for (uint32_t r = 0; r < rounds; r++) sink = sink + utils::crc8(buf, sizeof(buf), r);
+    double ns = (now_ns() - t0) / ((double)rounds * sizeof(buf));
+    printf("CRC8 impl %d: %.3f ns/byte, %.1f MB/s\n", CRC8_IMPL, ns, 1000.0 / ns);
+    return 0;
+}
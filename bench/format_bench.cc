@@ -0,0 +1,182 @@
+/* Host-side number formatter benchmark:
+ *   make -C bench run
+ * Checks stream::OutputStream against snprintf for every width of
+ * integer, the radixes, padding, fixed point and PRINT_P(), then times a mix of
+ * console fields through it and through the ltoa-into-a-buffer path it
+ * replaced. Cycles per field are host TSC cycles (x86 only).
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "stream/outputstream.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TSC() __rdtsc()
+#else
+#define TSC() 0ULL
+#endif
+
+using stream::Flags::HEX;
+using stream::Flags::BIN;
+using stream::Flags::PAD_ZERO;
+using stream::Flags::PAD_SPACE;
+
+namespace {
+
+class Sink : public stream::OutputStream {
+public:
+    char buf[256];
+    size_t len = 0;
+    void clear() { len = 0; }
+    const char *str() { buf[len] = 0; return buf; }
+protected:
+    void write(const char ch) override { if (len < sizeof(buf) - 1) buf[len++] = ch; }
+    void write(const char *b, const uint8_t n) override {     // takes runs, as UartStream
+        if (len + n < sizeof(buf)) {
+            memcpy(buf + len, b, n);
+            len += n;
+        }
+    }
+};
+
+// ltoa() as a library call, one division per digit
+__attribute__((noinline)) char *ltoa10(const long val, char *s) {
+    char *p = s;
+    unsigned long u = val < 0 ? 0UL - (unsigned long)val : (unsigned long)val;
+    do { *p++ = '0' + u % 10; } while (u /= 10);
+    if (val < 0) *p++ = '-';
+    *p = 0;
+    for (char *a = s, *b = p - 1; a < b; a++, b--) { const char c = *a; *a = *b; *b = c; }
+    return s;
+}
+
+// what the stream did before: a cleared buffer, ltoa() into it, then the
+// string walked through write() by operator<<(const char *)
+class Legacy : public Sink {
+public:
+    void put(const int32_t v) {
+        char b[34];
+        memset(b, 0, sizeof(b));
+        ltoa10(v, b);
+        *this << (const char *)b;
+    }
+};
+
+unsigned failed = 0;
+
+void check(Sink &s, const char *want) {
+    if (strcmp(s.str(), want)) {
+        if (failed++ < 20) printf("  got \"%s\", want \"%s\"\n", s.str(), want);
+    }
+    s.clear();
+}
+
+void binary(char *out, uint32_t v, int width) {
+    char b[33];
+    int n = 0;
+    do { b[n++] = '0' + (v & 1); } while (v >>= 1);
+    for (int i = n; i < width; i++) *out++ = '0';
+    while (n) *out++ = b[--n];
+    *out = 0;
+}
+
+uint32_t random32() { return (uint32_t)rand() << 16 ^ (uint32_t)rand(); }
+
+double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+}
+
+int main() {
+    Sink s;
+    char want[64];
+    const uint32_t edges[] = { 0, 1, 9, 10, 99, 100, 255, 999, 1000, 9999, 10000, 65535, 65536,
+                               99999, 100000, 999999999, 1000000000, 2147483647, 2147483648UL, 4294967295UL };
+    for (uint32_t i = 0; i < 200000; i++) {
+        const uint32_t u = i < sizeof(edges) / sizeof(edges[0]) ? edges[i] : random32() >> (rand() % 32);
+        const int32_t v = (int32_t)u;
+        s << u;                                 check(s, (snprintf(want, sizeof(want), "%lu", (unsigned long)u), want));
+        s << v;                                 check(s, (snprintf(want, sizeof(want), "%ld", (long)v), want));
+        s << (uint16_t)u;                       check(s, (snprintf(want, sizeof(want), "%u", (uint16_t)u), want));
+        s << (int16_t)u;                        check(s, (snprintf(want, sizeof(want), "%d", (int16_t)u), want));
+        s << (uint8_t)u;                        check(s, (snprintf(want, sizeof(want), "%u", (uint8_t)u), want));
+        s << (int8_t)u;                         check(s, (snprintf(want, sizeof(want), "%d", (int8_t)u), want));
+        s << HEX << u;                          check(s, (snprintf(want, sizeof(want), "%lX", (unsigned long)u), want));
+        s << HEX << PAD_ZERO << stream::Width(4) << (uint16_t)u;
+                                                check(s, (snprintf(want, sizeof(want), "%04X", (uint16_t)u), want));
+        s << BIN << PAD_ZERO << stream::Width(8) << (uint8_t)u;
+                                                check(s, (binary(want, (uint8_t)u, 8), want));
+        s << BIN << u;                          check(s, (binary(want, u, 0), want));
+        s << stream::Width(12) << v;            check(s, (snprintf(want, sizeof(want), "%12ld", (long)v), want));
+        s << PAD_SPACE << stream::Width(7) << (int16_t)u;
+                                                check(s, (snprintf(want, sizeof(want), "%7d", (int16_t)u), want));
+        s << PAD_ZERO << stream::Width(7) << (int16_t)u;
+                                                check(s, (snprintf(want, sizeof(want), "%07d", (int16_t)u), want));
+        const uint8_t d = 1 + i % FIXED_MAX;
+        uint32_t unit = 1;
+        for (uint8_t k = 0; k < d; k++) unit *= 10;
+        s << stream::Fixed(d) << u;             check(s, (snprintf(want, sizeof(want), "%lu.%0*lu", (unsigned long)(u / unit), d, (unsigned long)(u % unit)), want));
+        const int16_t t = (int16_t)u;           // 0.1 degC
+        s << stream::Fixed(1) << t;
+        snprintf(want, sizeof(want), "%s%d.%d", t < 0 ? "-" : "", abs(t) / 10, abs(t) % 10);
+        check(s, want);
+        const float f = (float)(int32_t)(random32() % 2000000 - 1000000) / 100.0f;
+        s << f;                                 check(s, (snprintf(want, sizeof(want), "%.2f", f), want));
+    }
+    s << (float)1e12;                           check(s, "ovf");
+    s << (float)NAN << ' ' << 7;                check(s, "nan 7");
+    PRINT_P(s, "{} mV ({} raw)\t", (uint16_t)3650, (uint16_t)7321);
+                                                check(s, "3650 mV (7321 raw)\t");
+    PRINT_P(s, "{} = {.1} |{04x}|{08b}|{5}|{}", (uint8_t)2, (int16_t)-5, (uint16_t)0xBEEF, (uint8_t)5, (int8_t)-42, "ok");
+                                                check(s, "2 = -0.5 |BEEF|00000101|  -42|ok");
+    PRINT_P(s, "SOC: {} %", 99.996f);           check(s, "SOC: 100.00 %");
+    if (failed) {
+        printf("formatter: %u mismatches\n", failed);
+        return 1;
+    }
+
+    // a console line's worth of fields: cell mV, current, timestamp, count, SOC
+    static int32_t values[4096];
+    for (auto &v : values) v = (int32_t)(random32() >> (rand() % 20)) * (rand() & 1 ? 1 : -1);
+    const uint32_t rounds = 200;
+    const uint32_t fields = rounds * (sizeof(values) / sizeof(values[0]));
+    Legacy old;
+    size_t bytes = 0;
+    double t0 = now_ns();
+    uint64_t c0 = TSC();
+    for (uint32_t r = 0; r < rounds; r++) {
+        for (const int32_t v : values) { old.put(v); bytes += old.len; old.clear(); }
+    }
+    uint64_t cycles = TSC() - c0;
+    double ns = now_ns() - t0;
+    printf("ltoa path:  %.1f ns/field, %.0f cycles/field, %.1f MB/s\n",
+           ns / fields, (double)cycles / fields, bytes * 1000.0 / ns);
+    bytes = 0;
+    t0 = now_ns();
+    c0 = TSC();
+    for (uint32_t r = 0; r < rounds; r++) {
+        for (const int32_t v : values) { s << v; bytes += s.len; s.clear(); }
+    }
+    cycles = TSC() - c0;
+    ns = now_ns() - t0;
+    printf("formatter:  %.1f ns/field, %.0f cycles/field, %.1f MB/s\n",
+           ns / fields, (double)cycles / fields, bytes * 1000.0 / ns);
+    bytes = 0;
+    t0 = now_ns();
+    c0 = TSC();
+    for (uint32_t r = 0; r < rounds; r++) {
+        for (const int32_t v : values) { s << stream::Fixed(3) << v; bytes += s.len; s.clear(); }
+    }
+    cycles = TSC() - c0;
+    ns = now_ns() - t0;
+    printf("fixed 3:    %.1f ns/field, %.0f cycles/field, %.1f MB/s\n",
+           ns / fields, (double)cycles / fields, bytes * 1000.0 / ns);
+    return 0;
+}
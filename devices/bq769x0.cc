@@ -14,11 +14,13 @@
  * limitations under the License.
  */
 
-#include <math.h>     // log for thermistor calculation
 #include "bq769x0.h"
+#include "ntc.h"
 
 #include <string.h>
 #include "mcu/timer.h"
+#include "utils/crc.h"
+#include "utils/cpp.h"
 #include <util/delay.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -28,47 +30,66 @@
 #include <stdint.h>
 
 using stream::Flags::PGM;
+using stream::Flags::PAD_ZERO;
+using stream::Flags::BIN;
 
 namespace devices {
 
-const char *byte2char(int x) {
-    static char b[9];
-    b[0] = '\0';
-    int z;
-    for (z = 128; z > 0; z >>= 1) {
-        strcat(b, ((x & z) == z) ? "1" : "0");
-    }
-    return b;
+namespace {
+// bits of the shadowed registers compared on readback (RSVD and
+// status bits are left out), CELLBAL1..UV_TRIP
+const uint8_t shadowMask[BQ769X0_SHADOW_REGS] PROGMEM = {
+    0x1F, 0x1F, 0x1F,   // CELLBAL1..3
+    0x18,               // SYS_CTRL1: ADC_EN, TEMP_SEL
+    0xFC,               // SYS_CTRL2: CHG_ON/DSG_ON are dropped by the chip itself
+    0x9F, 0x7F, 0xF0,   // PROTECT1..3
+    0xFF, 0xFF          // OV_TRIP, UV_TRIP
+};
+
+// whole units in rem + x, the rest stays in rem
+uint32_t carry(uint32_t &rem, const uint32_t x, const uint32_t unit) {
+    rem += x;
+    if (rem < unit) return 0;
+    const uint32_t n = rem / unit;
+    rem -= n * unit;
+    return n;
 }
-
-uint8_t _crc8_ccitt_update (uint8_t inCrc, uint8_t inData) {
-    uint8_t data = inCrc ^ inData;
-    for (uint8_t i = 0; i < 8; i++) {
-        if ((data & 0x80) != 0) {
-            data <<= 1;
-            data ^= 0x07;
-        } else {
-            data <<= 1;
-        }
-    }
-    return data;
 }
 
-bq769x0::bq769x0(bq769_conf &_conf, bq769_data &_data, bq769_stats &_stats):
+template <typename V>
+bq769x0<V>::bq769x0(bq769_conf<V> &_conf, bq769_data<V> &_data, bq769_stats<V> &_stats):
     cout(mcu::Usart::get()),
     conf(_conf),
     data(_data),
     stats(_stats),
+    sampleRequested_(false),
+    burstValid_(false),
     mChargingEnabled(false),
     mDischargingEnabled(false)
 {
     chargingDisabled_ = 0;
     dischargingDisabled_ = 0;
+    shadowValid_ = 0;
+    shadowDirty_ = 0;
+    shadowCheckIdx_ = 0;
+    shadowMismatch_ = 0;
+    lastAlertCC_ = 0;
+    lastCC_ = 0;
+    ccPhase_ = 0;
+    memset(&ccTiming_, 0, sizeof(ccTiming_));
+    ccRem_ = 0;
+    cc2Rem_ = 0;
+    chargeInRem_ = chargeOutRem_ = 0;
+    energyInRem_ = energyOutRem_ = 0;
+    energyInMsRem_ = energyOutMsRem_ = 0;
 }
 
-void bq769x0::begin() {
+template <typename V>
+void bq769x0<V>::begin() {
     memset(&data, 0, sizeof(data));
     data.alertInterruptFlag_ = true;
+    shadowValid_ = 0;
+    shadowDirty_ = 0;
     // test communication
     while (true) {
         // should be set to 0x19 according to datasheet
@@ -97,66 +118,69 @@ void bq769x0::begin() {
 // Fast function to check whether BMS has an error
 // (returns 0 if everything is OK)
 
-uint8_t bq769x0::checkStatus() {
-    if (data.alertInterruptFlag_ || errorStatus_.regByte) {
-        regSYS_STAT_t sys_stat;
-        sys_stat.regByte = readRegister(SYS_STAT);
-        // first check, if only a new CC reading is available
-        if (sys_stat.bits.CC_READY == 1) {
-            if(conf.BQ_dbg) cout << PGM << PSTR("bq769x0: CC ready\r\n");
-            updateCurrent();  // automatically clears CC ready flag
+template <typename V>
+uint8_t bq769x0<V>::checkStatus(regSYS_STAT_t sys_stat) {
+    // first check, if only a new CC reading is available
+    if (sys_stat.bits.CC_READY == 1) {
+        if(conf.BQ_dbg) cout << PGM << PSTR("bq769x0: CC ready\r\n");
+        updateCurrent(sys_stat);  // automatically clears CC ready flag
+    }
+    // Serious error occured
+    if (sys_stat.regByte & STAT_FLAGS) {
+        // the chip switches the FETs off by itself, keep the shadow in line
+        uint8_t &sys_ctrl2 = shadow_[SYS_CTRL2 - BQ769X0_SHADOW_FIRST];
+        if (sys_stat.regByte & (STAT_DEVICE_XREADY | STAT_OVRD_ALERT)) sys_ctrl2 &= ~0b00000011;
+        if (sys_stat.regByte & (STAT_UV | STAT_SCD | STAT_OCD)) sys_ctrl2 &= ~0b00000010;
+        if (sys_stat.bits.OV) sys_ctrl2 &= ~0b00000001;
+        if (!errorStatus_.bits.DEVICE_XREADY && sys_stat.bits.DEVICE_XREADY) { // XR error
+            mChargingEnabled = mDischargingEnabled = false;
+            shadowDirty_ = shadowValid_; // chip may have been reset, restore settings
+            chargingDisabled_ |= (1 << ERROR_XREADY);
+            dischargingDisabled_ |= (1 << ERROR_XREADY);
+            stats.errorCounter_[ERROR_XREADY]++;
+            stats.errorTimestamps_[ERROR_XREADY] = mcu::Timer::millis();
+            if(conf.BQ_dbg) cout << PGM << PSTR("bq769x0 ERROR: XREADY\r\n");
         }
-        // Serious error occured
-        if (sys_stat.regByte & STAT_FLAGS) {
-            if (!errorStatus_.bits.DEVICE_XREADY && sys_stat.bits.DEVICE_XREADY) { // XR error
-                mChargingEnabled = mDischargingEnabled = false;
-                chargingDisabled_ |= (1 << ERROR_XREADY);
-                dischargingDisabled_ |= (1 << ERROR_XREADY);
-                stats.errorCounter_[ERROR_XREADY]++;
-                stats.errorTimestamps_[ERROR_XREADY] = mcu::Timer::millis();
-                if(conf.BQ_dbg) cout << PGM << PSTR("bq769x0 ERROR: XREADY\r\n");
-            }
-            if (!errorStatus_.bits.OVRD_ALERT && sys_stat.bits.OVRD_ALERT) { // Alert error
-                mChargingEnabled = mDischargingEnabled = false;
-                chargingDisabled_ |= (1 << ERROR_ALERT);
-                dischargingDisabled_ |= (1 << ERROR_ALERT);
-                stats.errorCounter_[ERROR_ALERT]++;
-                stats.errorTimestamps_[ERROR_ALERT] = mcu::Timer::millis();
-                if(conf.BQ_dbg) cout << PGM << PSTR("bq769x0 ERROR: ALERT\r\n");
-            }
-            if (sys_stat.bits.UV) { // UV error
-                mDischargingEnabled = false;
-                dischargingDisabled_ |= (1 << ERROR_UVP);
-                stats.errorCounter_[ERROR_UVP]++;
-                stats.errorTimestamps_[ERROR_UVP] = mcu::Timer::millis();
-                if(conf.BQ_dbg) cout << PGM << PSTR("bq769x0 ERROR: UVP\r\n");
-            }
-            if (sys_stat.bits.OV) { // OV error
-                mChargingEnabled = false;
-                chargingDisabled_ |= (1 << ERROR_OVP);
-                stats.errorCounter_[ERROR_OVP]++;
-                stats.errorTimestamps_[ERROR_OVP] = mcu::Timer::millis();
-                if(conf.BQ_dbg) cout << PGM << PSTR("bq769x0 ERROR: OVP\r\n");
+        if (!errorStatus_.bits.OVRD_ALERT && sys_stat.bits.OVRD_ALERT) { // Alert error
+            mChargingEnabled = mDischargingEnabled = false;
+            chargingDisabled_ |= (1 << ERROR_ALERT);
+            dischargingDisabled_ |= (1 << ERROR_ALERT);
+            stats.errorCounter_[ERROR_ALERT]++;
+            stats.errorTimestamps_[ERROR_ALERT] = mcu::Timer::millis();
+            if(conf.BQ_dbg) cout << PGM << PSTR("bq769x0 ERROR: ALERT\r\n");
+        }
+        if (sys_stat.bits.UV) { // UV error
+            mDischargingEnabled = false;
+            dischargingDisabled_ |= (1 << ERROR_UVP);
+            stats.errorCounter_[ERROR_UVP]++;
+            stats.errorTimestamps_[ERROR_UVP] = mcu::Timer::millis();
+            if(conf.BQ_dbg) cout << PGM << PSTR("bq769x0 ERROR: UVP\r\n");
+        }
+        if (sys_stat.bits.OV) { // OV error
+            mChargingEnabled = false;
+            chargingDisabled_ |= (1 << ERROR_OVP);
+            stats.errorCounter_[ERROR_OVP]++;
+            stats.errorTimestamps_[ERROR_OVP] = mcu::Timer::millis();
+            if(conf.BQ_dbg) cout << PGM << PSTR("bq769x0 ERROR: OVP\r\n");
 
-            }
-            if (sys_stat.bits.SCD) { // SCD
-                mDischargingEnabled = false;
-                dischargingDisabled_ |= (1 << ERROR_SCD);
-                stats.errorCounter_[ERROR_SCD]++;
-                stats.errorTimestamps_[ERROR_SCD] = mcu::Timer::millis();
-                if(conf.BQ_dbg) cout << PGM << PSTR("bq769x0 ERROR: SCD\r\n");
-            }
-            if (sys_stat.bits.OCD) { // OCD
-                mDischargingEnabled = false;
-                dischargingDisabled_ |= (1 << ERROR_OCD);
-                stats.errorCounter_[ERROR_OCD]++;
-                stats.errorTimestamps_[ERROR_OCD] = mcu::Timer::millis();
+        }
+        if (sys_stat.bits.SCD) { // SCD
+            mDischargingEnabled = false;
+            dischargingDisabled_ |= (1 << ERROR_SCD);
+            stats.errorCounter_[ERROR_SCD]++;
+            stats.errorTimestamps_[ERROR_SCD] = mcu::Timer::millis();
+            if(conf.BQ_dbg) cout << PGM << PSTR("bq769x0 ERROR: SCD\r\n");
+        }
+        if (sys_stat.bits.OCD) { // OCD
+            mDischargingEnabled = false;
+            dischargingDisabled_ |= (1 << ERROR_OCD);
+            stats.errorCounter_[ERROR_OCD]++;
+            stats.errorTimestamps_[ERROR_OCD] = mcu::Timer::millis();
 
-                if(conf.BQ_dbg) cout << PGM << PSTR("bq769x0 ERROR: OCD\r\n");
-            }
-            errorStatus_.regByte = sys_stat.regByte;
-        } else { errorStatus_.regByte = 0;
+            if(conf.BQ_dbg) cout << PGM << PSTR("bq769x0 ERROR: OCD\r\n");
         }
+        errorStatus_.regByte = sys_stat.regByte;
+    } else { errorStatus_.regByte = 0;
     }
     return errorStatus_.regByte;
 }
@@ -164,7 +188,8 @@ uint8_t bq769x0::checkStatus() {
 //----------------------------------------------------------------------------
 // tries to clear errors which have been found by checkStatus()
 
-void bq769x0::clearErrors() {
+template <typename V>
+void bq769x0<V>::clearErrors() {
     
     if (errorStatus_.bits.DEVICE_XREADY) {
         // datasheet recommendation: try to clear after waiting a few seconds
@@ -225,11 +250,36 @@ void bq769x0::clearErrors() {
 //----------------------------------------------------------------------------
 // should be called at least once every 250 ms to get correct coulomb counting
 
-uint8_t bq769x0::update() {
-    
-    uint8_t ret = checkStatus(); // does updateCurrent()
-    //updateCurrent(); // will only read new current value if alert was triggered
+template <typename V>
+uint8_t bq769x0<V>::update() {
+    mcu::I2CMaster &Wire = mcu::I2CMaster::get();
+    if (!sampleRequested_) requestSample();
+    Wire.wait(statTr_);
+    Wire.wait(burstTr_);
+    sampleRequested_ = false;
+    // SYS_STAT is read ahead of the burst, so a CC_READY seen here
+    // always belongs to the CC value of the same sample
+    regSYS_STAT_t sys_stat;
+    sys_stat.regByte = statBuf_[0];
+#ifdef BQ769X0_CRC_ENABLED
+    if (statTr_.status != mcu::I2CMaster::I2C_DONE ||
+        utils::crc8_update(utils::crc8_update(0, (BQ769X0_I2C_ADDR << 1) | 1), statBuf_[0]) != statBuf_[1]) {
+        sys_stat.regByte = readRegister(SYS_STAT);
+    }
+#endif
+    burstValid_ = (burstTr_.status == mcu::I2CMaster::I2C_DONE) && decodeBurst();
+    // with ALERT servicing the CC belongs to serviceAlert(), this SYS_STAT
+    // may predate it. Poll only if the edges stopped (ALERT held by a fault)
+    if (conf.AlertDriven && (uint32_t)(mcu::Timer::millis() - lastAlertCC_) < 500) {
+        sys_stat.bits.CC_READY = 0;
+    }
+    uint8_t ret = checkStatus(sys_stat); // does updateCurrent()
+    verifyShadow();
+    flushShadow();
     updateVoltages();
+    if (conf.SOC_Mode == SOC_EKF && burstValid_ && getNumberOfConnectedCells()) {
+        ekf_.correct(getAvgCellVoltage(), data.batCurrent_, conf.OCV_Curve);
+    }
     updateTemperatures();
     updateBalancingSwitches();
     if(ret) { clearErrors(); }
@@ -237,20 +287,96 @@ uint8_t bq769x0::update() {
     return ret;
 }
 
+//----------------------------------------------------------------------------
+// Called on the bq769x0 ALERT edge (INT0): reads the new CC sample and
+// handles faults immediately, voltages and temperatures stay in update()
+
+template <typename V>
+uint8_t bq769x0<V>::serviceAlert() {
+    regSYS_STAT_t sys_stat;
+    sys_stat.regByte = readRegister(SYS_STAT);
+    data.alertInterruptFlag_ = true;
+    burstValid_ = false; // CC straight from the chip, not from an older burst
+    if (sys_stat.bits.CC_READY) lastAlertCC_ = mcu::Timer::millis();
+    return checkStatus(sys_stat);
+}
+
+//----------------------------------------------------------------------------
+// Queues SYS_STAT and the VC1..CC register block, bus time then overlaps
+// with whatever the caller does until sampleReady()
+
+template <typename V>
+bool bq769x0<V>::requestSample() {
+    static const uint8_t regStat  = SYS_STAT;
+    static const uint8_t regBurst = VC1_HI_BYTE;
+    if (sampleRequested_) return false;
+    statTr_.addr      = BQ769X0_I2C_ADDR;
+    statTr_.wdata     = &regStat;
+    statTr_.wlen      = 1;
+    statTr_.rdata     = statBuf_;
+    statTr_.rlen      = sizeof(statBuf_);
+    statTr_.callback  = nullptr;
+    burstTr_.addr     = BQ769X0_I2C_ADDR;
+    burstTr_.wdata    = &regBurst;
+    burstTr_.wlen     = 1;
+    burstTr_.rdata    = burst_.raw;
+    burstTr_.rlen     = sizeof(burst_.raw);
+    burstTr_.callback = nullptr;
+    mcu::I2CMaster &Wire = mcu::I2CMaster::get();
+    Wire.submit(statTr_);
+    Wire.submit(burstTr_);
+    sampleRequested_ = true;
+    return true;
+}
+
+template <typename V>
+bool bq769x0<V>::sampleReady() {
+    return sampleRequested_ &&
+        !mcu::I2CMaster::pending(statTr_) && !mcu::I2CMaster::pending(burstTr_);
+}
+
+//----------------------------------------------------------------------------
+// Checks the CRC of every byte pair in one pass and packs the block into
+// burst_.word[] in place (word i never overlaps bytes not yet consumed)
+
+template <typename V>
+bool bq769x0<V>::decodeBurst() {
+    uint8_t *b = burst_.raw;
+#ifdef BQ769X0_CRC_ENABLED
+    // CRC of first byte includes slave address (including R/W bit),
+    // all subsequent bytes contain only data
+    uint8_t crc = utils::crc8_update(0, (BQ769X0_I2C_ADDR << 1) | 1);
+    for (uint8_t i = 0; i < BQ769X0_BURST_WORDS; i++, b += 4) {
+        const uint8_t hi = b[0];
+        const uint8_t lo = b[2];
+        if (utils::crc8_update(crc, hi) != b[1]) return false;
+        if (utils::crc8_update(0, lo) != b[3]) return false;
+        crc = 0;
+        burst_.word[i] = ((uint16_t)hi << 8) | lo;
+    }
+#else
+    for (uint8_t i = 0; i < BQ769X0_BURST_WORDS; i++, b += 2) {
+        burst_.word[i] = ((uint16_t)b[0] << 8) | b[1];
+    }
+#endif
+    return true;
+}
+
 //----------------------------------------------------------------------------
 // puts BMS IC into SHIP mode (i.e. switched off)
-void bq769x0::shutdown() {
+template <typename V>
+void bq769x0<V>::shutdown() {
     writeRegister(SYS_CTRL1, 0x0);
     writeRegister(SYS_CTRL1, 0x1);
     writeRegister(SYS_CTRL1, 0x2);
 }
 
 //----------------------------------------------------------------------------
-bool bq769x0::enableCharging(uint16_t flag) {
+template <typename V>
+bool bq769x0<V>::enableCharging(uint16_t flag) {
     chargingDisabled_ &= ~flag;
     if(!mChargingEnabled && !chargingDisabled_) {
-        int sys_ctrl2;
-        sys_ctrl2 = readRegister(SYS_CTRL2);
+        uint8_t sys_ctrl2 = readShadow(SYS_CTRL2);
         writeRegister(SYS_CTRL2, sys_ctrl2 | 0b00000001);  // switch CHG on
         mChargingEnabled = true;
 
@@ -260,11 +386,11 @@ bool bq769x0::enableCharging(uint16_t flag) {
 }
 
 //----------------------------------------------------------------------------
-void bq769x0::disableCharging(uint16_t flag) {
+template <typename V>
+void bq769x0<V>::disableCharging(uint16_t flag) {
     chargingDisabled_ |= flag;
     if(mChargingEnabled && chargingDisabled_) {
-        int sys_ctrl2;
-        sys_ctrl2 = readRegister(SYS_CTRL2);
+        uint8_t sys_ctrl2 = readShadow(SYS_CTRL2);
         writeRegister(SYS_CTRL2, sys_ctrl2 & ~0b00000001);  // switch CHG off
         mChargingEnabled = false;
         if(conf.BQ_dbg) cout << PGM << PSTR("Disabling CHG FET\r\n");
@@ -272,12 +398,12 @@ void bq769x0::disableCharging(uint16_t flag) {
 }
 
 //----------------------------------------------------------------------------
-bool bq769x0::enableDischarging(uint16_t flag) {
+template <typename V>
+bool bq769x0<V>::enableDischarging(uint16_t flag) {
     dischargingDisabled_ &= ~flag;
     
     if(!mDischargingEnabled && !dischargingDisabled_) {
-        int sys_ctrl2;
-        sys_ctrl2 = readRegister(SYS_CTRL2);
+        uint8_t sys_ctrl2 = readShadow(SYS_CTRL2);
         writeRegister(SYS_CTRL2, sys_ctrl2 | 0b00000010);  // switch DSG on
         mDischargingEnabled = true;
         if(conf.BQ_dbg) cout << PGM << PSTR("Enabling DISCHG FET\r\n");
@@ -286,12 +412,12 @@ bool bq769x0::enableDischarging(uint16_t flag) {
 }
 
 //----------------------------------------------------------------------------
-void bq769x0::disableDischarging(uint16_t flag) {
+template <typename V>
+void bq769x0<V>::disableDischarging(uint16_t flag) {
     dischargingDisabled_ |= flag;
 
     if(mDischargingEnabled && dischargingDisabled_) {
-        int sys_ctrl2;
-        sys_ctrl2 = readRegister(SYS_CTRL2);
+        uint8_t sys_ctrl2 = readShadow(SYS_CTRL2);
         writeRegister(SYS_CTRL2, sys_ctrl2 & ~0b00000010);  // switch DSG off
         mDischargingEnabled = false;
         if(conf.BQ_dbg) cout << PGM << PSTR("Disabling DISCHG FET\r\n");
@@ -302,9 +428,9 @@ void bq769x0::disableDischarging(uint16_t flag) {
 // sets balancing registers if balancing is allowed
 // (sufficient idle time + voltage)
 
-void bq769x0::updateBalancingSwitches(void) {
+template <typename V>
+void bq769x0<V>::updateBalancingSwitches(void) {
     int32_t idleSeconds = (mcu::Timer::millis() - stats.idleTimestamp_) / 1000;
-    uint8_t numberOfSections = (MAX_NUMBER_OF_CELLS + 4) / 5;
 
     // check for millis() overflow
     if (idleSeconds < 0) {
@@ -321,11 +447,10 @@ void bq769x0::updateBalancingSwitches(void) {
         //Serial.println("Balancing enabled!");
         data.balancingStatus_ = 0;  // current status will be set in following loop
 
-        //regCELLBAL_t cellbal;
-        uint16_t balancingFlags;
-        uint16_t balancingFlagsTarget;
-
-        for (uint8_t section = 0; section < numberOfSections; section++) {
+        // one CELLBAL register per section, unrolled for the variant
+        utils::Unroll<V::sections>::run([this](const uint8_t section) {
+            uint16_t balancingFlags;
+            uint16_t balancingFlagsTarget;
             // find cells which should be balanced and sort them by voltage descending
             uint8_t cellList[5];
             uint8_t cellCounter = 0;
@@ -358,63 +483,65 @@ void bq769x0::updateBalancingSwitches(void) {
 
             if(conf.BQ_dbg) {
                 cout << PGM << PSTR("Setting CELLBAL ") << uint8_t(section+1);
-                cout << PGM << PSTR(" register to: ") << byte2char(balancingFlags) << EOL;
+                cout << PGM << PSTR(" register to: ") << BIN << PAD_ZERO << stream::Width(8) << balancingFlags << EOL;
             }
             
             data.balancingStatus_ |= balancingFlags << section*5;
 
             // set balancing register for this section
             writeRegister(CELLBAL1+section, balancingFlags);
-        } // section loop
+        });
     } else if (data.balancingStatus_ > 0) {
         // clear all CELLBAL registers
-        for (uint8_t section = 0; section < numberOfSections; section++) {
+        utils::Unroll<V::sections>::run([this](const uint8_t section) {
             if(conf.BQ_dbg) { cout << PGM << PSTR("Clearing Register CELLBAL ") << uint8_t(section+1) << EOL; }
             writeRegister(CELLBAL1+section, 0x0);
-        }
+        });
         data.balancingStatus_ = 0;
     }
 }
 
 //----------------------------------------------------------------------------
-void bq769x0::setOCV(uint16_t voltageVsSOC[NUM_OCV_POINTS]) { OCV_ = voltageVsSOC; }
-
-//----------------------------------------------------------------------------
-float bq769x0::getSOC(void) { return (float) coulombCounter_ / conf.Batt_CapaNom_mAsec * 100.0; }
+template <typename V>
+float bq769x0<V>::getSOC(void) {
+    if (conf.SOC_Mode == SOC_EKF) return ekf_.soc() / 100.0;
+    return (float) coulombCounter_ / conf.Batt_CapaNom_mAsec * 100.0;
+}
 
 //----------------------------------------------------------------------------
 // SOC calculation based on average cell open circuit voltage
 
-void bq769x0::resetSOC(int percent) {
+template <typename V>
+void bq769x0<V>::resetSOC(int percent) {
+    uint16_t permille;
+    uint16_t sigma = 100;  // 1 %, a forced value is trusted
     if (percent <= 100 && percent >= 0) {
-        coulombCounter_ = (int32_t)(conf.Batt_CapaNom_mAsec * percent) / 100L;
-    } else {  // reset based on OCV
-        if(conf.BQ_dbg) {
-            cout << PGM << PSTR("NumCells: ") << getNumberOfConnectedCells() << 
-            PGM << PSTR(", voltage: ") << data.batVoltage_ << 'V';
-        }
+        permille = percent * 10;
+    } else {
+        sigma = 500;       // OCV is only as good as the rest period  // reset based on OCV
+        if (!getNumberOfConnectedCells()) return; // no valid voltages yet
         uint16_t voltage = data.batVoltage_ / getNumberOfConnectedCells();
-        coulombCounter_ = 0;  // initialize with totally depleted battery (0% SOC)
-        for (int i = 0; i < NUM_OCV_POINTS; i++) {
-            if (OCV_[i] <= voltage) {
-                if (i == 0) { coulombCounter_ = conf.Batt_CapaNom_mAsec;  // 100% full 
-                } else {
-                    // interpolate between OCV[i] and OCV[i-1]
-                    coulombCounter_ = (double) conf.Batt_CapaNom_mAsec / (NUM_OCV_POINTS - 1.0) *
-                    (NUM_OCV_POINTS - 1.0 - i + ((float)voltage - OCV_[i])/(OCV_[i-1] - OCV_[i]));
-                }
-                return;
-            }
+        permille = ocv_soc_permille(conf.OCV_Curve, voltage);
+        if(conf.BQ_dbg) {
+            cout << PGM << PSTR("NumCells: ") << getNumberOfConnectedCells() <<
+            PGM << PSTR(", cell: ") << voltage << PGM << PSTR(" mV, SOC: ") << permille << PGM << PSTR(" 0.1%\r\n");
         }
     }
+    // capacity / 1000 * permille cannot overflow for a 580 Ah pack
+    const uint32_t cap = conf.Batt_CapaNom_mAsec;
+    coulombCounter_ = (cap / 1000) * permille + ((cap % 1000) * permille) / 1000;
+    ekf_.init(permille * 10, sigma);
 }
 
 //----------------------------------------------------------------------------
 
-int16_t bq769x0::getADCOffset() { return stats.adcOffset_; }
-int16_t bq769x0::getADCCellOffset(uint8_t cell) { return stats.adcOffset_ + conf.adcCellsOffset_[cell]; }
+template <typename V>
+int16_t bq769x0<V>::getADCOffset() { return stats.adcOffset_; }
+template <typename V>
+int16_t bq769x0<V>::getADCCellOffset(uint8_t cell) { return stats.adcOffset_ + conf.adcCellsOffset_[cell]; }
 
-uint32_t bq769x0::setShortCircuitProtection(uint32_t current_mA, uint16_t delay_us) {
+template <typename V>
+uint32_t bq769x0<V>::setShortCircuitProtection(uint32_t current_mA, uint16_t delay_us) {
     conf.Cell_SCD_mA = current_mA;
     conf.Cell_SCD_us = delay_us;
     regPROTECT1_t protect1;
@@ -441,7 +568,8 @@ uint32_t bq769x0::setShortCircuitProtection(uint32_t current_mA, uint16_t delay_
 
 //----------------------------------------------------------------------------
 
-uint32_t bq769x0::setOvercurrentChargeProtection(uint32_t current_mA, uint16_t delay_ms) {
+template <typename V>
+uint32_t bq769x0<V>::setOvercurrentChargeProtection(uint32_t current_mA, uint16_t delay_ms) {
     conf.Cell_OCD_mA = current_mA;
     conf.Cell_OCD_ms = delay_ms;
     return current_mA;
@@ -449,7 +577,8 @@ uint32_t bq769x0::setOvercurrentChargeProtection(uint32_t current_mA, uint16_t d
 
 //----------------------------------------------------------------------------
 
-uint32_t bq769x0::setOvercurrentDischargeProtection(uint32_t current_mA, uint16_t delay_ms) {
+template <typename V>
+uint32_t bq769x0<V>::setOvercurrentDischargeProtection(uint32_t current_mA, uint16_t delay_ms) {
     conf.Cell_ODP_mA = current_mA;
     conf.Cell_ODP_ms = delay_ms;
     regPROTECT2_t protect2;
@@ -476,11 +605,12 @@ uint32_t bq769x0::setOvercurrentDischargeProtection(uint32_t current_mA, uint16_
 
 //----------------------------------------------------------------------------
 
-uint16_t bq769x0::setCellUndervoltageProtection(uint16_t voltage_mV, uint16_t delay_s) {
+template <typename V>
+uint16_t bq769x0<V>::setCellUndervoltageProtection(uint16_t voltage_mV, uint16_t delay_s) {
     conf.Cell_UVP_mV = voltage_mV;
     conf.Cell_UVP_sec = delay_s;
     regPROTECT3_t protect3;
-    protect3.regByte = readRegister(PROTECT3);
+    protect3.regByte = readShadow(PROTECT3);
     uint16_t uv_trip = ((((voltage_mV - stats.adcOffset_) * 1000UL) / stats.adcGain_) >> 4) & 0x00FF;
     uv_trip += 1;   // always round up for lower cell voltage
     writeRegister(UV_TRIP, uv_trip);
@@ -498,11 +628,12 @@ uint16_t bq769x0::setCellUndervoltageProtection(uint16_t voltage_mV, uint16_t de
 
 //----------------------------------------------------------------------------
 
-uint16_t bq769x0::setCellOvervoltageProtection(uint16_t voltage_mV, uint16_t delay_s) {
+template <typename V>
+uint16_t bq769x0<V>::setCellOvervoltageProtection(uint16_t voltage_mV, uint16_t delay_s) {
     conf.Cell_OVP_mV = voltage_mV;
     conf.Cell_OVP_sec = delay_s;
     regPROTECT3_t protect3;
-    protect3.regByte = readRegister(PROTECT3);
+    protect3.regByte = readShadow(PROTECT3);
     uint16_t ov_trip = ((((voltage_mV - stats.adcOffset_) * 1000UL) / stats.adcGain_) >> 4) & 0x00FF;
     writeRegister(OV_TRIP, ov_trip);
     protect3.bits.OV_DELAY = 0;
@@ -518,115 +649,123 @@ uint16_t bq769x0::setCellOvervoltageProtection(uint16_t voltage_mV, uint16_t del
 }
 
 //----------------------------------------------------------------------------
-uint16_t bq769x0::getMaxCellVoltage() { return stats.cellVoltages_[stats.idCellMaxVoltage_]; }
+template <typename V>
+uint16_t bq769x0<V>::getMaxCellVoltage() { return stats.cellVoltages_[stats.idCellMaxVoltage_]; }
 
 //----------------------------------------------------------------------------
-uint16_t bq769x0::getMinCellVoltage() { return stats.cellVoltages_[stats.idCellMinVoltage_]; }
+template <typename V>
+uint16_t bq769x0<V>::getMinCellVoltage() { return stats.cellVoltages_[stats.idCellMinVoltage_]; }
 
 //----------------------------------------------------------------------------
-uint16_t bq769x0::getAvgCellVoltage() { return data.batVoltage_ / getNumberOfConnectedCells(); }
+template <typename V>
+uint16_t bq769x0<V>::getAvgCellVoltage() {
+    const uint8_t cells = getNumberOfConnectedCells();
+    return cells ? data.batVoltage_ / cells : 0;
+}
 
 //----------------------------------------------------------------------------
-uint16_t bq769x0::getCellVoltage(uint8_t idCell, bool raw) {
+template <typename V>
+uint16_t bq769x0<V>::getCellVoltage(uint8_t idCell, bool raw) {
     uint8_t i = stats.cellIdMap_[idCell];
     if (raw) return data.cellVoltages_raw_[i];
     return stats.cellVoltages_[i];
 }
 
 //----------------------------------------------------------------------------
-uint16_t bq769x0::getCellVoltage_(uint8_t i, bool raw) {
+template <typename V>
+uint16_t bq769x0<V>::getCellVoltage_(uint8_t i, bool raw) {
     if (raw) return data.cellVoltages_raw_[i];
     return stats.cellVoltages_[i];
 }
 
-//----------------------------------------------------------------------------
-uint8_t bq769x0::getNumberOfCells(void) { return MAX_NUMBER_OF_CELLS; }
-
 //----------------------------------------------------------------------------
 
-uint8_t bq769x0::getNumberOfConnectedCells(void) { return data.connectedCells_; }
+template <typename V>
+uint8_t bq769x0<V>::getNumberOfConnectedCells(void) { return data.connectedCells_; }
 
 //----------------------------------------------------------------------------
 
-float bq769x0::getTemperatureDegC(uint8_t channel) {
-    if (channel <= 2) {
+template <typename V>
+float bq769x0<V>::getTemperatureDegC(uint8_t channel) {
+    if (channel < V::thermistors) {
         return (float)stats.temperatures_[channel] / 10.0;
     } else { return -273.15; }  // Error: Return absolute minimum temperature
 }
 
 //----------------------------------------------------------------------------
 
-float bq769x0::getTemperatureDegF(uint8_t channel) { return getTemperatureDegC(channel) * 1.8 + 32; }
+template <typename V>
+float bq769x0<V>::getTemperatureDegF(uint8_t channel) { return getTemperatureDegC(channel) * 1.8 + 32; }
 
 //----------------------------------------------------------------------------
 
-int16_t bq769x0::getLowestTemperature() {
+template <typename V>
+int16_t bq769x0<V>::getLowestTemperature() {
     int16_t minTemp = INT16_MAX;
-    for(uint8_t i = 0; i < MAX_NUMBER_OF_THERMISTORS; i++) {
+    for(uint8_t i = 0; i < V::thermistors; i++) {
         if(conf.RT_bits & (1 << i) && stats.temperatures_[i] < minTemp) minTemp = stats.temperatures_[i];
     }
     return minTemp;
 }
 
-int16_t bq769x0::getHighestTemperature() {
+template <typename V>
+int16_t bq769x0<V>::getHighestTemperature() {
     int16_t maxTemp = INT16_MIN;
-    for(uint8_t i = 0; i < MAX_NUMBER_OF_THERMISTORS; i++) {
+    for(uint8_t i = 0; i < V::thermistors; i++) {
         if(conf.RT_bits & (1 << i) && stats.temperatures_[i] > maxTemp) maxTemp = stats.temperatures_[i];
     }
     return maxTemp;
 }
 
 //----------------------------------------------------------------------------
-int16_t updateTemperatures_calc(const uint16_t val, const uint16_t beta) {
-    // calculate R_thermistor according to bq769x0 datasheet
-    uint16_t vtsx = val * 0.382; // mV
-    uint32_t rts = 10000.0 * vtsx / (3300.0 - vtsx); // Ohm
-    // Temperature calculation using Beta equation
-    // - According to bq769x0 datasheet, only 10k thermistors should be used
-    // - 25°C reference temperature for Beta equation assumed
-    float tmp = 1.0/(1.0/(273.15+25) + 1.0/beta * log(rts/10000.0)); // K
-    return (tmp - 273.15) * 10.0;
-}
-
-void bq769x0::updateTemperatures() {
-    stats.temperatures_[0] = updateTemperatures_calc(readDoubleRegister(TS1_HI_BYTE), conf.RT_Beta[0]);
-#ifdef IC_BQ76930
-    stats.temperatures_[1] = updateTemperatures_calc(readDoubleRegister(TS2_HI_BYTE), conf.RT_Beta[1]);
-#endif
-#ifdef IC_BQ76940
-    stats.temperatures_[1] = updateTemperatures_calc(readDoubleRegister(TS2_HI_BYTE), conf.RT_Beta[1]);
-    stats.temperatures_[2] = updateTemperatures_calc(readDoubleRegister(TS3_HI_BYTE), conf.RT_Beta[1]);
-#endif
+template <typename V>
+void bq769x0<V>::updateTemperatures() {
+    if (!burstValid_) return; // keep last good values
+    // only 10k thermistors per datasheet, beta equation referenced to 25 degC
+    // TS1..TS3 are consecutive register pairs
+    for (uint8_t i = 0; i < V::thermistors; i++) {
+        stats.temperatures_[i] = devices::ntc_temperature(burstWord(TS1_HI_BYTE + 2 * i), conf.RT_Beta[i]);
+    }
 }
 
 
 //----------------------------------------------------------------------------
 
-void bq769x0::updateCurrent() {
-    regSYS_STAT_t sys_stat;
-    sys_stat.regByte = readRegister(SYS_STAT);
+template <typename V>
+void bq769x0<V>::updateCurrent(regSYS_STAT_t sys_stat) {
     // check if new current reading available
     if (sys_stat.bits.CC_READY == 1) {
-        //Serial.println("reading CC register...");
-        data.batCurrent_ = (int16_t)readDoubleRegister(CC_HI_BYTE);
-        data.batCurrent_ = ((int32_t)data.batCurrent_ * 8440L) / (int32_t)conf.RS_uOhm;  // mA
-
-        // is read every 250 ms
-        coulombCounter_ += data.batCurrent_ / 4;
-
-        if (coulombCounter_ > conf.Batt_CapaNom_mAsec) {
-            coulombCounter_ = conf.Batt_CapaNom_mAsec;
-        }
-        if (coulombCounter_ < 0) {
-            coulombCounter_ = 0;
-        }
-
-        if (data.batCurrent_ < 0) {
-            coulombCounter2_ += -data.batCurrent_ / 4;
-            if (coulombCounter2_ > conf.Batt_CapaNom_mAsec) {
-                stats.batCycles_++;
-                coulombCounter2_ = 0;
+        data.batCurrent_raw_ = (int16_t)(burstValid_ ? burstWord(CC_HI_BYTE) : readDoubleRegister(CC_HI_BYTE));
+        data.batCurrent_ = ((int32_t)data.batCurrent_raw_ * 8440L) / (int32_t)conf.RS_uOhm;  // mA
+
+        // Each CC_READY is one 250 ms conversion of the chip. Weight the sample
+        // by the conversions that really passed: late reads (sleep loop,
+        // console load) would otherwise lose charge, early ones count twice.
+        // What the whole conversions leave of dt is carried in ccPhase_, so
+        // the integrated time follows the elapsed time at any read period.
+        const uint32_t now = mcu::Timer::millis();
+        uint8_t n = 1;
+        if (lastCC_) {
+            const uint32_t dt = now - lastCC_;
+            const uint32_t conversions = (dt + ccPhase_ + 125) / 250;
+            if (conversions > 8) {
+                n = 8;                  // current unknown beyond 2 s, the gap is dropped
+                ccPhase_ = 0;
+            } else {
+                n = conversions;
+                if (n) ccPhase_ += (int16_t)(dt - n * 250);
+                const uint16_t jitter = abs(ccPhase_);
+                if (jitter > ccTiming_.jitterMax_ms) ccTiming_.jitterMax_ms = jitter;
             }
+            if (conversions > 1) ccTiming_.missed += conversions - 1;
+            ccTiming_.lastDt_ms = dt > UINT16_MAX ? UINT16_MAX : dt;
+        }
+        if (n) {
+            lastCC_ = now ? now : 1;
+            ccTiming_.samples++;
+            integrate(n * 250);
+        } else {
+            ccTiming_.duplicates++;
         }
 
         if (data.batCurrent_ > (int32_t)conf.CurrentThresholdIdle_mA) {
@@ -656,38 +795,65 @@ void bq769x0::updateCurrent() {
     }
 }
 
+//----------------------------------------------------------------------------
+// Adds one CC sample covering dt_ms to the charge and energy counters.
+// Integer only, every remainder is carried to the next sample so small
+// (idle) currents are not lost to truncation.
+
+template <typename V>
+void bq769x0<V>::integrate(const uint16_t dt_ms) {
+    const int32_t current = data.batCurrent_;
+    // mA * ms, 1 mAs = 1000, 1 mAh = 3600000
+    const int32_t q = current * (int32_t)dt_ms;
+    const uint32_t absq = q < 0 ? -q : q;
+
+    int32_t num = q + ccRem_;
+    int32_t dq = num / 1000;
+    ccRem_ = num - dq * 1000;
+    coulombCounter_ += dq;
+    if (coulombCounter_ > conf.Batt_CapaNom_mAsec) {
+        coulombCounter_ = conf.Batt_CapaNom_mAsec;
+    }
+    if (coulombCounter_ < 0) {
+        coulombCounter_ = 0;
+    }
+    if (conf.SOC_Mode == SOC_EKF) {
+        ekf_.setParallel(conf.Cells_Parallel);
+        ekf_.predict(current, dt_ms, conf.Batt_CapaNom_mAsec);
+    }
+
+    // mW = mV * mA / 1000, battery voltage < 65.5 V: (mV / 4) * mA / 250
+    const uint32_t p_mW = ((data.batVoltage_ >> 2) * (current < 0 ? -current : current)) / 250;
+    // p_mW * dt_ms passes 2^32 at 2.1 kW for 2 s: whole W times ms go in as
+    // mW * s, the mW below 1 W through a mW * ms remainder; 1 mWh = 3600 mW * s
+    const uint32_t w_ms = (p_mW / 1000) * dt_ms;
+    const uint32_t mw_ms = (p_mW % 1000) * dt_ms;
+    if (current < 0) {
+        coulombCounter2_ += carry(cc2Rem_, absq, 1000);
+        if (coulombCounter2_ > conf.Batt_CapaNom_mAsec) {
+            stats.batCycles_++;
+            coulombCounter2_ = 0;
+        }
+        stats.chargeOut_mAh_ += carry(chargeOutRem_, absq, 3600000UL);
+        stats.energyOut_mWh_ += carry(energyOutRem_, w_ms + carry(energyOutMsRem_, mw_ms, 1000), 3600);
+    } else {
+        stats.chargeIn_mAh_ += carry(chargeInRem_, absq, 3600000UL);
+        stats.energyIn_mWh_ += carry(energyInRem_, w_ms + carry(energyInMsRem_, mw_ms, 1000), 3600);
+    }
+}
+
 //----------------------------------------------------------------------------
 // reads all cell voltages to array cellVoltages[NUM_CELLS] and updates batVoltage
 
-void bq769x0::updateVoltages() {
-    mcu::I2CMaster Wire;
+template <typename V>
+void bq769x0<V>::updateVoltages() {
+    if (!burstValid_) return; // don't save corrupted values
     uint16_t adcVal = 0;
     uint8_t idCell = 0;
-    // read cell voltages
-    i2buf[0] = VC1_HI_BYTE;
-    Wire.write(BQ769X0_I2C_ADDR, i2buf, 1);
     stats.idCellMaxVoltage_ = 0;
     stats.idCellMinVoltage_ = 0;
-    for (int i = 0; i < MAX_NUMBER_OF_CELLS; i++) {
-#ifdef BQ769X0_CRC_ENABLED
-        Wire.read(BQ769X0_I2C_ADDR, i2buf, 4);
-        uint8_t crc;
-        uint8_t data_b = i2buf[0];
-        adcVal = (data_b & 0b00111111) << 8;
-        // CRC of first bytes includes slave address (including R/W bit) and data
-        crc = _crc8_ccitt_update(0, (BQ769X0_I2C_ADDR << 1) | 1);
-        crc = _crc8_ccitt_update(crc, data_b);
-        if (crc != i2buf[1]) return; // don't save corrupted value
-        data_b = i2buf[2];
-        adcVal |= data_b;
-        // CRC of subsequent bytes contain only data
-        crc = _crc8_ccitt_update(0, data_b);
-        if (crc != i2buf[3]) return; // don't save corrupted value
-#else
-        Wire.read(BQ769X0_I2C_ADDR, i2buf, 2);
-        // reply
-        adcVal = (i2buf[0] & 0b00111111) << 8 | i2buf[1];
-#endif
+    for (int i = 0; i < V::cells; i++) {
+        adcVal = burstWord(VC1_HI_BYTE + 2 * i) & 0x3FFF;
         data.cellVoltages_raw_[i] = adcVal;
         stats.cellVoltages_[i] = ((uint32_t)adcVal * stats.adcGain_) / 1000 + getADCCellOffset(i);
         if (stats.cellVoltages_[i] < 500) { continue; }
@@ -698,7 +864,7 @@ void bq769x0::updateVoltages() {
     }
     data.connectedCells_ = idCell;
     // read battery pack voltage
-    data.batVoltage_raw_ = readDoubleRegister(BAT_HI_BYTE);
+    data.batVoltage_raw_ = burstWord(BAT_HI_BYTE);
     data.batVoltage_ = ((uint32_t)4.0 * stats.adcGain_ * data.batVoltage_raw_) / 1000.0 + data.connectedCells_ * getADCOffset(); // TODO common offset!
     if(data.batVoltage_ >= data.connectedCells_ * conf.Cell_CapaFull_mV) {
         if(fullVoltageCount_ == 240) { // 60s * 4(250ms)
@@ -713,15 +879,25 @@ void bq769x0::updateVoltages() {
 
 //----------------------------------------------------------------------------
 
-void bq769x0::writeRegister(uint8_t address, uint8_t data) {
-    mcu::I2CMaster Wire;
+template <typename V>
+void bq769x0<V>::writeRegister(uint8_t address, uint8_t data) {
+    if (address >= BQ769X0_SHADOW_FIRST && address < BQ769X0_SHADOW_FIRST + BQ769X0_SHADOW_REGS) {
+        const uint8_t idx = address - BQ769X0_SHADOW_FIRST;
+        const uint16_t bit = 1 << idx;
+        // skip no-op writes, unless the chip is known to differ
+        if ((shadowValid_ & bit) && !(shadowDirty_ & bit) && shadow_[idx] == data) return;
+        shadow_[idx] = data;
+        shadowValid_ |= bit;
+        shadowDirty_ &= ~bit;
+    }
+    mcu::I2CMaster &Wire = mcu::I2CMaster::get();
     i2buf[0] = address;
     i2buf[1] = data;
 #ifdef BQ769X0_CRC_ENABLED
     // CRC is calculated over the slave address (including R/W bit), register address, and data.
-    i2buf[2] = _crc8_ccitt_update(0, (BQ769X0_I2C_ADDR << 1) | 0);
-    i2buf[2] = _crc8_ccitt_update(i2buf[2], address);
-    i2buf[2] = _crc8_ccitt_update(i2buf[2], data);
+    i2buf[2] = utils::crc8_update(0, (BQ769X0_I2C_ADDR << 1) | 0);
+    i2buf[2] = utils::crc8_update(i2buf[2], address);
+    i2buf[2] = utils::crc8_update(i2buf[2], data);
     Wire.write(BQ769X0_I2C_ADDR, i2buf, 3);
 #else
     Wire.write(BQ769X0_I2C_ADDR, i2buf, 2);
@@ -731,55 +907,98 @@ void bq769x0::writeRegister(uint8_t address, uint8_t data) {
 
 //----------------------------------------------------------------------------
 
-uint8_t bq769x0::readRegister(uint8_t address) {
-    mcu::I2CMaster Wire;
-    i2buf[0] = address;
-    Wire.write(BQ769X0_I2C_ADDR, i2buf, 1);
+template <typename V>
+uint8_t bq769x0<V>::readRegister(uint8_t address) {
+    mcu::I2CMaster &Wire = mcu::I2CMaster::get();
     uint8_t data;
 #ifdef BQ769X0_CRC_ENABLED
     uint8_t wantcrc;
     uint8_t gotcrc;
     do {
-        Wire.read(BQ769X0_I2C_ADDR, i2buf, 2);
+        // register address and reply in one transaction (repeated START)
+        Wire.write_read(BQ769X0_I2C_ADDR, &address, 1, i2buf, 2);
         data   = i2buf[0];
         gotcrc = i2buf[1];
         // CRC is calculated over the slave address (including R/W bit) and data.
-        wantcrc = _crc8_ccitt_update(0, (BQ769X0_I2C_ADDR << 1) | 1);
-        wantcrc = _crc8_ccitt_update(wantcrc, data);
+        wantcrc = utils::crc8_update(0, (BQ769X0_I2C_ADDR << 1) | 1);
+        wantcrc = utils::crc8_update(wantcrc, data);
     } while (gotcrc != wantcrc);
 #else
-    Wire.read(BQ769X0_I2C_ADDR, i2buf, 1);
+    Wire.write_read(BQ769X0_I2C_ADDR, &address, 1, i2buf, 1);
     data = i2buf[0];
 #endif
     return data;
 }
 
 //----------------------------------------------------------------------------
+// control register value as last written, read from the chip only once
+
+template <typename V>
+uint8_t bq769x0<V>::readShadow(uint8_t address) {
+    const uint8_t idx = address - BQ769X0_SHADOW_FIRST;
+    if (!(shadowValid_ & (1 << idx))) {
+        shadow_[idx] = readRegister(address);
+        shadowValid_ |= (1 << idx);
+    }
+    return shadow_[idx];
+}
 
-uint16_t bq769x0::readDoubleRegister(uint8_t address) {
-    mcu::I2CMaster Wire;
-    i2buf[0] = address;
-    Wire.write(BQ769X0_I2C_ADDR, i2buf, 1);
+//----------------------------------------------------------------------------
+// background readback, one shadowed register per update() call
+
+template <typename V>
+void bq769x0<V>::verifyShadow() {
+    const uint8_t idx = shadowCheckIdx_;
+    if (++shadowCheckIdx_ >= BQ769X0_SHADOW_REGS) shadowCheckIdx_ = 0;
+    const uint16_t bit = 1 << idx;
+    if (!(shadowValid_ & bit) || (shadowDirty_ & bit)) return;
+    const uint8_t address = BQ769X0_SHADOW_FIRST + idx;
+    const uint8_t chip = readRegister(address);
+    if (address == SYS_CTRL2) {
+        shadow_[idx] = (shadow_[idx] & ~0b00000011) | (chip & 0b00000011);
+        mChargingEnabled    = chip & 0b00000001;
+        mDischargingEnabled = chip & 0b00000010;
+    }
+    if ((chip ^ shadow_[idx]) & pgm_read_byte(&shadowMask[idx])) {
+        shadowMismatch_++;
+        shadowDirty_ |= bit;
+        if(conf.BQ_dbg) cout << PGM << PSTR("bq769x0: register ") << address << PGM << PSTR(" diverged\r\n");
+    }
+}
+
+template <typename V>
+void bq769x0<V>::flushShadow() {
+    if (!shadowDirty_) return;
+    for (uint8_t idx = 0; idx < BQ769X0_SHADOW_REGS; idx++) {
+        if (shadowDirty_ & (1 << idx)) writeRegister(BQ769X0_SHADOW_FIRST + idx, shadow_[idx]);
+    }
+}
+
+//----------------------------------------------------------------------------
+
+template <typename V>
+uint16_t bq769x0<V>::readDoubleRegister(uint8_t address) {
+    mcu::I2CMaster &Wire = mcu::I2CMaster::get();
     uint16_t result;
 #ifdef BQ769X0_CRC_ENABLED
     while(true) {
-        Wire.read(BQ769X0_I2C_ADDR, i2buf, 4);
+        Wire.write_read(BQ769X0_I2C_ADDR, &address, 1, i2buf, 4);
         uint8_t crc;
         uint8_t data = i2buf[0];
         result = (uint16_t)data << 8;
         // CRC of first bytes includes slave address (including R/W bit) and data
-        crc = _crc8_ccitt_update(0, (BQ769X0_I2C_ADDR << 1) | 1);
-        crc = _crc8_ccitt_update(crc, data);
+        crc = utils::crc8_update(0, (BQ769X0_I2C_ADDR << 1) | 1);
+        crc = utils::crc8_update(crc, data);
         if (crc != i2buf[1]) continue;
         data = i2buf[2];
         result |= data;
         // CRC of subsequent bytes contain only data
-        crc = _crc8_ccitt_update(0, data);
+        crc = utils::crc8_update(0, data);
         if (crc != i2buf[3]) continue;
         break;
     }
 #else
-    Wire.read(BQ769X0_I2C_ADDR, i2buf, 2);
+    Wire.write_read(BQ769X0_I2C_ADDR, &address, 1, i2buf, 2);
     result = ((uint16_t)i2buf[0] << 8) | i2buf[1];
 #endif
     return result;
@@ -787,7 +1006,8 @@ uint16_t bq769x0::readDoubleRegister(uint8_t address) {
 
 //----------------------------------------------------------------------------
 // Check custom error conditions like over/under temperature, over charge current
-void bq769x0::checkUser() {
+template <typename V>
+void bq769x0<V>::checkUser() {
     // charge temperature limits
     if(getLowestTemperature() < conf.Cell_TempCharge_min || getHighestTemperature() > conf.Cell_TempCharge_max) {
         if(!(chargingDisabled_ & (1 << ERROR_USER_CHG_TEMP))) {
@@ -812,7 +1032,7 @@ void bq769x0::checkUser() {
     // charge current limit
     // charge current can also come through discharge FET that we can't turn off (regen on P-)
     // that's why this looks a bit funky
-    if(data.batCurrent_ > conf.Cell_OCD_mA) {
+    if(data.batCurrent_ > (int32_t)conf.Cell_OCD_mA) {
         user_CHGOCD_ReleaseTimestamp_ = 0;
         if(mChargingEnabled && !(chargingDisabled_ & (1 << ERROR_USER_CHG_OCD))) {
             if(!user_CHGOCD_TriggerTimestamp_)
@@ -838,25 +1058,59 @@ void bq769x0::checkUser() {
     }
 }
 
-void bq769x0::printRegisters() {
-    cout 
-        << PGM << PSTR("\r\n   ADCGAIN: ") << stats.adcGain_
-        << PGM << PSTR("\r\n ADCOFFSET: ") << stats.adcOffset_
-        << PGM << PSTR("\r\n   CHG DIS: ") << chargingDisabled_
-        << PGM << PSTR("\r\nDISCHG DIS: ") << dischargingDisabled_ << EOL
-        << PGM << PSTR("\r\n0x00  SYS_STAT: ") << byte2char(readRegister(SYS_STAT))
-        << PGM << PSTR("\r\n0x01  CELLBAL1: ") << byte2char(readRegister(CELLBAL1))
-        << PGM << PSTR("\r\n0x04 SYS_CTRL1: ") << byte2char(readRegister(SYS_CTRL1))
-        << PGM << PSTR("\r\n0x05 SYS_CTRL2: ") << byte2char(readRegister(SYS_CTRL2))
-        << PGM << PSTR("\r\n0x06  PROTECT1: ") << byte2char(readRegister(PROTECT1))
-        << PGM << PSTR("\r\n0x07  PROTECT2: ") << byte2char(readRegister(PROTECT2))
-        << PGM << PSTR("\r\n0x08  PROTECT3: ") << byte2char(readRegister(PROTECT3))
-        << PGM << PSTR("\r\n0x09   OV_TRIP: ") << byte2char(readRegister(OV_TRIP))
-        << PGM << PSTR("\r\n0x0A   UV_TRIP: ") << byte2char(readRegister(UV_TRIP))
-        << PGM << PSTR("\r\n0x0B    CC_CFG: ") << byte2char(readRegister(CC_CFG))
-        << PGM << PSTR("\r\n0x32  CC_HI_LO: ") << readDoubleRegister(CC_HI_BYTE)
-        << PGM << PSTR("\r\n0x2A BAT_HI_LO: ") << readDoubleRegister(BAT_HI_BYTE)
-        << EOL;
+namespace {
+
+struct RegisterLine { uint8_t address; bool word; char label[20]; };
+
+const RegisterLine REGISTER_LINES[] PROGMEM = {
+    { SYS_STAT,     false,  "\r\n0x00  SYS_STAT: " },
+    { CELLBAL1,     false,  "\r\n0x01  CELLBAL1: " },
+    { SYS_CTRL1,    false,  "\r\n0x04 SYS_CTRL1: " },
+    { SYS_CTRL2,    false,  "\r\n0x05 SYS_CTRL2: " },
+    { PROTECT1,     false,  "\r\n0x06  PROTECT1: " },
+    { PROTECT2,     false,  "\r\n0x07  PROTECT2: " },
+    { PROTECT3,     false,  "\r\n0x08  PROTECT3: " },
+    { OV_TRIP,      false,  "\r\n0x09   OV_TRIP: " },
+    { UV_TRIP,      false,  "\r\n0x0A   UV_TRIP: " },
+    { CC_CFG,       false,  "\r\n0x0B    CC_CFG: " },
+    { CC_HI_BYTE,   true,   "\r\n0x32  CC_HI_LO: " },
+    { BAT_HI_BYTE,  true,   "\r\n0x2A BAT_HI_LO: " },
+};
+
+constexpr uint8_t REGISTER_COUNT = sizeof(REGISTER_LINES) / sizeof(REGISTER_LINES[0]);
+
+}
+
+// one chip register per part after the driver's state, the console
+// prints them between samples
+template <typename V>
+bool bq769x0<V>::printRegisters(const uint8_t part) {
+    switch (part) {
+        case 0:
+            cout
+                << PGM << PSTR("\r\n   ADCGAIN: ") << stats.adcGain_
+                << PGM << PSTR("\r\n ADCOFFSET: ") << stats.adcOffset_;
+            return true;
+        case 1:
+            cout
+                << PGM << PSTR("\r\n   CHG DIS: ") << chargingDisabled_
+                << PGM << PSTR("\r\nDISCHG DIS: ") << dischargingDisabled_;
+            return true;
+        case 2:
+            cout << PGM << PSTR("\r\nSHADOW ERR: ") << shadowMismatch_ << EOL;
+            return true;
+    }
+    const RegisterLine *r = &REGISTER_LINES[part - 3];
+    const uint8_t address = pgm_read_byte(&r->address);
+    cout << PGM << r->label;
+    if (pgm_read_byte(&r->word)) cout << readDoubleRegister(address);
+    else cout << BIN << PAD_ZERO << stream::Width(8) << readRegister(address);
+    if (part - 3 < REGISTER_COUNT - 1) return true;
+    cout << EOL;
+    return false;
 }
 
+// only the variant this image is built for, see BQ_VARIANT in Makefile.inc
+template class bq769x0<BQ769X0_VARIANT>;
+
 }
@@ -17,43 +17,63 @@
 #pragma once
 
 #include "bq769x0_registers.h"
+#include "ocv.h"
+#include "soc_ekf.h"
 #include "mcu/i2c_master.h"
 #include "stream/uartstream.h"
 
-//#define IC_BQ76920
-//#define IC_BQ76930
-#define IC_BQ76940
-
-#ifdef IC_BQ76920
-#define MAX_NUMBER_OF_CELLS         5
-#define MAX_NUMBER_OF_THERMISTORS   1
+// Address and CRC depend on the ordered part number, not on the variant
 #define BQ769X0_I2C_ADDR            0x08
 #define BQ769X0_CRC_ENABLED
-#define BQ769X0_THERMISTORS         0b001
-#endif
 
-#ifdef IC_BQ76930
-#define MAX_NUMBER_OF_CELLS         10
-#define MAX_NUMBER_OF_THERMISTORS   2
-#define BQ769X0_I2C_ADDR            0x08
-#define BQ769X0_CRC_ENABLED
-#define BQ769X0_THERMISTORS         0b011
+// Chip variant, one per firmware image (make BQ_VARIANT=bq76920 ...)
+#ifndef BQ769X0_VARIANT
+#define BQ769X0_VARIANT             bq76940
 #endif
 
-#ifdef IC_BQ76940
-#define MAX_NUMBER_OF_CELLS         15
-#define MAX_NUMBER_OF_THERMISTORS   3
-#define BQ769X0_I2C_ADDR            0x08
-#define BQ769X0_CRC_ENABLED
-#define BQ769X0_THERMISTORS         0b111
-#endif
+// write-through shadow of the control registers CELLBAL1..UV_TRIP
+#define BQ769X0_SHADOW_FIRST        CELLBAL1
+#define BQ769X0_SHADOW_REGS         (UV_TRIP - CELLBAL1 + 1)
 
-#define NUM_OCV_POINTS 21
+// VC1_HI_BYTE..CC_LO_BYTE are read in one auto-incrementing transaction
+#define BQ769X0_BURST_WORDS         ((CC_LO_BYTE - VC1_HI_BYTE + 1) / 2)
+#ifdef BQ769X0_CRC_ENABLED
+#define BQ769X0_BURST_LEN           (BQ769X0_BURST_WORDS * 4)   // every data byte followed by CRC
+#define BQ769X0_STAT_LEN            2
+#else
+#define BQ769X0_BURST_LEN           (BQ769X0_BURST_WORDS * 2)
+#define BQ769X0_STAT_LEN            1
+#endif
 
 namespace devices {
 
-const char *byte2char(int x);
-uint8_t _crc8_ccitt_update (uint8_t inCrc, uint8_t inData); 
+// Part geometry, a section is one CELLBAL register of up to 5 cells
+struct bq76920 {
+    static constexpr uint8_t cells          = 5;
+    static constexpr uint8_t thermistors    = 1;
+    static constexpr uint8_t sections       = (cells + 4) / 5;
+    static constexpr uint8_t thermistorBits = (1 << thermistors) - 1;
+};
+
+struct bq76930 {
+    static constexpr uint8_t cells          = 10;
+    static constexpr uint8_t thermistors    = 2;
+    static constexpr uint8_t sections       = (cells + 4) / 5;
+    static constexpr uint8_t thermistorBits = (1 << thermistors) - 1;
+};
+
+struct bq76940 {
+    static constexpr uint8_t cells          = 15;
+    static constexpr uint8_t thermistors    = 3;
+    static constexpr uint8_t sections       = (cells + 4) / 5;
+    static constexpr uint8_t thermistorBits = (1 << thermistors) - 1;
+};
+
+
+enum SOCMode : uint8_t {
+    SOC_COULOMB,    // coulomb counter, reset at full and from OCV
+    SOC_EKF         // Kalman filter over coulomb count + OCV/RC model
+};
 
 enum BQ769xERR {
     ERROR_XREADY = 0,
@@ -69,10 +89,17 @@ enum BQ769xERR {
     NUM_ERRORS
 };
 
-typedef struct __attribute__((packed)) {
+template <typename V>
+struct __attribute__((packed)) bq769_conf {
     bool        BQ_dbg;                 // false
     bool        Allow_Charging;         // false
     bool        Allow_Discharging;      // false
+    bool        AlertDriven;            // true, CC read on the ALERT edge instead of polling
+    uint8_t     OCV_Curve;              // OCV_NMC, cell chemistry for the OCV based SOC reset
+    uint8_t     SOC_Mode;               // SOC_COULOMB or SOC_EKF
+    uint8_t     Baud;                   // USART_BAUD_DEFAULT, console rate, index into mcu::BAUD_RATES
+    uint8_t     Modbus;                 // 0, Modbus RTU slave address to boot as, 0 boots the text console
+    uint8_t     Cells_Parallel;         // 1, cells in parallel per series group, for the EKF cell model
     int32_t     Batt_CapaNom_mAsec;     // *3600 mAs, nominal capacity of battery pack, max. 580 Ah possible @ 3.7V
     uint16_t    Cell_CapaNom_mV;        // 3600 mV, nominal voltage of single cell in battery pack
     uint16_t    Cell_CapaFull_mV;       // 4200 mV, full voltage of single cell in battery pack
@@ -102,13 +129,14 @@ typedef struct __attribute__((packed)) {
     uint16_t    BalancingIdleTimeMin_s; // 1800
     uint32_t    CurrentThresholdIdle_mA;// 30 mA
     uint8_t     BalancingCellMaxDifference_mV;          // 20 mV
-    int16_t     adcCellsOffset_[MAX_NUMBER_OF_CELLS];   // 0 mV
-    uint16_t    RT_Beta[MAX_NUMBER_OF_THERMISTORS];     // 3435 typical value for Semitec 103AT-5 thermistor: 3435
+    int16_t     adcCellsOffset_[V::cells];              // 0 mV
+    uint16_t    RT_Beta[V::thermistors];                // 3435 typical value for Semitec 103AT-5 thermistor: 3435
     uint32_t    ts;
     uint8_t     crc8;
-} bq769_conf;
+};
 
-typedef struct __attribute__((packed)) {
+template <typename V>
+struct __attribute__((packed)) bq769_data {
     bool        alertInterruptFlag_;        // true, indicates if a new current reading or an error is available from BMS IC
     bool        user_CHGOCD_ReleasedNow_;   // false
     uint8_t     charging_;
@@ -118,10 +146,11 @@ typedef struct __attribute__((packed)) {
     int32_t     batCurrent_;            // 0, mA
     int16_t     batCurrent_raw_;        // adc val
     uint32_t    balancingStatus_;       // 0 holds on/off status of balancing switches
-    uint16_t    cellVoltages_raw_[MAX_NUMBER_OF_CELLS];     //null, adc val
-} bq769_data;
+    uint16_t    cellVoltages_raw_[V::cells];                //null, adc val
+};
 
-typedef struct __attribute__((packed)) {
+template <typename V>
+struct __attribute__((packed)) bq769_stats {
     uint16_t    adcGain_;               // 0 uV/LSB
     int8_t      adcOffset_;             // 0 mV
     uint16_t    batCycles_;
@@ -131,35 +160,54 @@ typedef struct __attribute__((packed)) {
     uint32_t    idleTimestamp_;
     uint32_t    chargeTimestamp_;
     uint8_t     errorCounter_[NUM_ERRORS];
-    uint8_t     cellIdMap_[MAX_NUMBER_OF_CELLS];            // null, logical cell id -> physical cell id
-    uint16_t    cellVoltages_[MAX_NUMBER_OF_CELLS];         //null, mV
-    int16_t     temperatures_[MAX_NUMBER_OF_THERMISTORS];   // null, C/10
+    uint8_t     cellIdMap_[V::cells];                       // null, logical cell id -> physical cell id
+    uint16_t    cellVoltages_[V::cells];                    //null, mV
+    int16_t     temperatures_[V::thermistors];              // null, C/10
     uint32_t    errorTimestamps_[NUM_ERRORS];               // null
+    uint32_t    chargeIn_mAh_;          // lifetime throughput
+    uint32_t    chargeOut_mAh_;
+    uint32_t    energyIn_mWh_;
+    uint32_t    energyOut_mWh_;
     uint32_t    ts;
     uint8_t     crc8;
-} bq769_stats;
-
-
-
-
-
-
-
+};
 
+// Timing of the CC samples as seen by the MCU, the chip converts every 250 ms
+struct CCTiming {
+    uint32_t    samples;
+    uint16_t    missed;         // conversions overwritten before they were read
+    uint16_t    duplicates;     // CC_READY seen twice for one conversion
+    uint16_t    jitterMax_ms;   // worst carried phase, distance from the 250 ms grid
+    uint16_t    lastDt_ms;
+};
 
+// The driver is instantiated for BQ769X0_VARIANT only (bq769x0.cc)
+template <typename V>
 class bq769x0 {
     stream::UartStream  cout;
-    bq769_conf          &conf;
-    bq769_data          &data;
-    bq769_stats         &stats;
+    bq769_conf<V>       &conf;
+    bq769_data<V>       &data;
+    bq769_stats<V>      &stats;
     uint8_t             i2buf[4];
+    uint8_t             statBuf_[BQ769X0_STAT_LEN];
+    union {
+        uint8_t     raw[BQ769X0_BURST_LEN];
+        uint16_t    word[BQ769X0_BURST_WORDS];  // decoded in place, VC1 first
+    } burst_;
+    mcu::I2CMaster::Transaction statTr_;
+    mcu::I2CMaster::Transaction burstTr_;
+    bool                sampleRequested_;
+    bool                burstValid_;
 public:
-    bq769x0(bq769_conf &_conf, bq769_data &_data, bq769_stats &_stats);
+    bq769x0(bq769_conf<V> &_conf, bq769_data<V> &_data, bq769_stats<V> &_stats);
     void begin();
-    uint8_t checkStatus();  // returns 0 if everything is OK
+    uint8_t checkStatus(regSYS_STAT_t sys_stat);  // returns 0 if everything is OK
     void checkUser();
     void clearErrors();
-    uint8_t update(void);  // returns checkStatus retval
+    uint8_t serviceAlert(); // ALERT edge: SYS_STAT, CC and faults right now
+    bool requestSample();   // queue SYS_STAT + burst read, non-blocking
+    bool sampleReady();
+    uint8_t update(void);  // returns checkStatus retval, waits for a requested sample
     void shutdown(void);
     // charging control
     bool enableCharging(uint16_t flag=(1 << ERROR_USER_SWITCH));
@@ -167,10 +215,9 @@ public:
     bool enableDischarging(uint16_t flag=(1 << ERROR_USER_SWITCH));
     void disableDischarging(uint16_t flag=(1 << ERROR_USER_SWITCH));
     void resetSOC(int percent = -1); // 0-100 %, -1 for automatic reset based on OCV
-    void setOCV(uint16_t voltageVsSOC[NUM_OCV_POINTS]);
     int16_t getADCOffset();
     int16_t getADCCellOffset(uint8_t cell);
-    uint8_t getNumberOfCells(void);
+    static constexpr uint8_t getNumberOfCells(void) { return V::cells; }
     uint8_t getNumberOfConnectedCells(void);
     uint32_t setShortCircuitProtection(uint32_t current_mA, uint16_t delay_us = 70);
     uint32_t setOvercurrentChargeProtection(uint32_t current_mA, uint16_t delay_ms);
@@ -187,27 +234,52 @@ public:
     int16_t getLowestTemperature(); // °C/10
     int16_t getHighestTemperature(); // °C/10
     float getSOC(void);
-    void printRegisters(void);
+    const SocEkf &getEkf() const { return ekf_; }
+    const CCTiming &getCCTiming() const { return ccTiming_; }
+    bool isChargingEnabled() const { return mChargingEnabled; }
+    bool isDischargingEnabled() const { return mDischargingEnabled; }
+    bool printRegisters(const uint8_t part);  // part by part, false after the last
 private:
     uint16_t    chargingDisabled_;
     uint16_t    dischargingDisabled_;
     bool mChargingEnabled;
     bool mDischargingEnabled;
-    uint16_t *OCV_; // Open Circuit Voltage of cell for SOC 100%, 95%, ..., 5%, 0%
     uint8_t fullVoltageCount_;
     uint32_t user_CHGOCD_TriggerTimestamp_;
     uint32_t user_CHGOCD_ReleaseTimestamp_;
     int32_t coulombCounter_; // mAs (= milli Coulombs) for current integration
     int32_t coulombCounter2_; // mAs (= milli Coulombs) for tracking battery cycles
+    // remainders below one count, mA*ms, mW*s or mW*ms, never dropped
+    int16_t ccRem_;
+    uint32_t cc2Rem_;
+    uint32_t chargeInRem_, chargeOutRem_;
+    uint32_t energyInRem_, energyOutRem_;
+    uint32_t energyInMsRem_, energyOutMsRem_;
+    uint32_t lastAlertCC_;    // millis() of the last CC sample taken on ALERT
+    uint32_t lastCC_;         // millis() of the last CC sample, 0 before the first
+    int16_t ccPhase_;         // ms from the last counted conversion to lastCC_, -125..124
+    CCTiming ccTiming_;
     regSYS_STAT_t errorStatus_;
+    SocEkf ekf_;
+    uint8_t shadow_[BQ769X0_SHADOW_REGS];
+    uint16_t shadowValid_;
+    uint16_t shadowDirty_;      // chip diverged, rewrite on next update
+    uint8_t shadowCheckIdx_;
+    uint16_t shadowMismatch_;
     // Methods    
     void updateVoltages(void);
-    void updateCurrent(void);
+    void updateCurrent(regSYS_STAT_t sys_stat);
+    void integrate(const uint16_t dt_ms);
+    bool decodeBurst(void);
+    uint16_t burstWord(uint8_t address) { return burst_.word[(address - VC1_HI_BYTE) >> 1]; }
     void updateTemperatures(void);
     void updateBalancingSwitches(void);
     uint8_t readRegister(uint8_t address);
     uint16_t readDoubleRegister(uint8_t address);
     void writeRegister(uint8_t address, uint8_t data);
+    uint8_t readShadow(uint8_t address);
+    void verifyShadow(void);
+    void flushShadow(void);
 };
     
 }
@@ -0,0 +1,65 @@
+#include "ntc.h"
+#include <avr/pgmspace.h>
+
+namespace {
+
+using devices::ntc::TempTable;
+
+// constexpr: a table that fails to evaluate at compile time is an error,
+// never a silent run-time initialiser
+constexpr TempTable<3435> ntc3435 PROGMEM = TempTable<3435>();
+constexpr TempTable<3380> ntc3380 PROGMEM = TempTable<3380>();
+constexpr TempTable<3950> ntc3950 PROGMEM = TempTable<3950>();
+constexpr devices::ntc::LnTable ntcLn PROGMEM = devices::ntc::LnTable();
+
+// linear between the two nodes around code, in the segment that holds it
+int16_t interpolate(const int16_t *table, const uint16_t code) {
+    const devices::ntc::Segment *s = devices::ntc::SEGMENTS;
+    uint16_t start = 0;
+    uint8_t i = 0;
+    uint8_t shift;
+    for (;; s++) {
+        const uint16_t end = pgm_read_word(&s->end);
+        shift = pgm_read_byte(&s->shift);
+        if (code < end) break;     // code <= NTC_CODE_MAX ends in the last one
+        i += (end - start) >> shift;
+        start = end;
+    }
+    i += (code - start) >> shift;
+    const int16_t a = pgm_read_word(&table[i]);
+    const int16_t b = pgm_read_word(&table[i + 1]);
+    const uint8_t frac = (code - start) & ((1 << shift) - 1);
+    return a + (int16_t)((((int32_t)b - a) * frac + (1 << shift >> 1)) >> shift);
+}
+
+const int16_t *table_for(const uint16_t beta) {
+    switch (beta) {
+        case 3435: return ntc3435.v;
+        case 3380: return ntc3380.v;
+        case 3950: return ntc3950.v;
+        default:   return nullptr;
+    }
+}
+
+}  // namespace
+
+namespace devices {
+
+bool ntc::tabulated(const uint16_t beta) { return table_for(beta) != nullptr; }
+
+int16_t ntc_temperature(uint16_t code, const uint16_t beta) {
+    if (code > NTC_CODE_MAX) code = NTC_CODE_MAX;
+    const int16_t *table = table_for(beta);
+    if (table) {
+        const int16_t t = interpolate(table, code);   // 0.01 degC
+        return (t + (t < 0 ? -5 : 5)) / 10;
+    }
+    // T = beta * T0 / (beta + T0 * ln(R/R0)), in 0.1 K scaled by 8:
+    // 2981.5 * 8 = 23852 and 298.15 * 8 / 4096 = 29815 / 51200
+    const int32_t ln = interpolate(ntcLn.v, code);
+    const int32_t den = (int32_t)beta * 8 + (29815L * ln) / 51200;
+    if (den <= 0) return INT16_MAX; // nonsense beta, read as too hot
+    return (int16_t)(((uint32_t)beta * 23852UL) / (uint32_t)den) - 2731;
+}
+
+}  // namespace devices
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+// 10k NTC on a bq769x0 TSx input: ADC code (382 uV/LSB, 10k pull-up to
+// 3.3 V) to temperature in 0.1 degC, no floating point at run time.
+//
+// Common betas (3435 Semitec 103AT, 3380 Murata NCP, 3950) have their
+// temperature curve in a constexpr generated PROGMEM table, interpolated
+// linearly. Any other beta goes through a beta-independent table of
+// ln(R/R0) and one integer division of the beta equation. Both stay
+// within 0.1 degC of the beta equation from -40 to +120 degC.
+
+#define NTC_BLOCK       128                         // every segment end is a multiple
+#define NTC_SEGMENTS    11
+#define NTC_POINTS      174                         // nodes of all segments and the last end
+#define NTC_CODE_MAX    (8704 - 1)
+
+namespace devices {
+namespace ntc {
+
+constexpr double T0_K       = 298.15;   // 25 degC reference
+constexpr double VREF_MV    = 3300.0;
+constexpr double LSB_MV     = 0.382;
+constexpr int16_t LN_Q      = 4096;     // ln table scale
+constexpr int16_t TEMP_Q    = 100;      // temperature tables in 0.01 degC
+
+// The curve bends hard at both ends of the range: segment nodes are
+// 1 << shift codes apart, 8 near +120 and -40 degC, 128 in the middle.
+// Read at compile time by the tables, with pgm_read_*() at run time.
+struct Segment {
+    uint16_t end;
+    uint8_t shift;
+};
+
+constexpr Segment SEGMENTS[NTC_SEGMENTS] PROGMEM = {
+    {  128, 7 }, {  384, 3 }, {  768, 4 }, { 1280, 5 }, { 2176, 6 }, { 7424, 7 },
+    { 7936, 6 }, { 8320, 5 }, { 8448, 4 }, { 8576, 3 }, { 8704, 7 },
+};
+
+constexpr uint16_t points() {
+    uint16_t n = 1, start = 0;
+    for (uint8_t s = 0; s < NTC_SEGMENTS; s++) {
+        n += (SEGMENTS[s].end - start) >> SEGMENTS[s].shift;
+        start = SEGMENTS[s].end;
+    }
+    return n;
+}
+static_assert(points() == NTC_POINTS, "NTC_POINTS does not match SEGMENTS");
+
+// ADC code of table node i, compile time only
+constexpr uint16_t node(uint8_t i) {
+    uint16_t start = 0;
+    for (uint8_t s = 0; s < NTC_SEGMENTS; s++) {
+        const uint16_t n = (SEGMENTS[s].end - start) >> SEGMENTS[s].shift;
+        if (i < n) return start + (i << SEGMENTS[s].shift);
+        i -= n;
+        start = SEGMENTS[s].end;
+    }
+    return start;
+}
+
+// ln() for table generation only, never called at run time
+constexpr double ln(double x) {
+    double k = 0;
+    while (x > 2.0) { x /= 2.0; k += 1.0; }
+    while (x < 1.0) { x *= 2.0; k -= 1.0; }
+    const double y = (x - 1.0) / (x + 1.0);
+    const double y2 = y * y;
+    double term = y, sum = 0;
+    for (uint8_t n = 1; n < 40; n += 2) {
+        sum += term / n;
+        term *= y2;
+    }
+    return k * 0.69314718055994530942 + 2.0 * sum;
+}
+
+// R_ts / 10k for an ADC code, clamped to the usable input range
+constexpr double ratio(const uint16_t code) {
+    double v = (code < 16 ? 16 : code) * LSB_MV;
+    if (v > VREF_MV - 10.0) v = VREF_MV - 10.0;
+    return v / (VREF_MV - v);
+}
+
+constexpr int16_t rnd(const double x) { return (int16_t)(x < 0 ? x - 0.5 : x + 0.5); }
+
+// 0.01 degC, the clamped hot end of a low beta would not fit
+constexpr int16_t temp100(const uint16_t code, const uint16_t beta) {
+    const double t = (1.0 / (1.0 / T0_K + ln(ratio(code)) / beta) - 273.15) * TEMP_Q;
+    return t > INT16_MAX ? INT16_MAX : rnd(t);
+}
+
+template <uint16_t BETA>
+struct TempTable {
+    int16_t v[NTC_POINTS];
+    constexpr TempTable() : v() {
+        for (uint8_t i = 0; i < NTC_POINTS; i++) v[i] = temp100(node(i), BETA);
+    }
+};
+
+struct LnTable {
+    int16_t v[NTC_POINTS];
+    constexpr LnTable() : v() {
+        for (uint8_t i = 0; i < NTC_POINTS; i++) v[i] = rnd(ln(ratio(node(i))) * LN_Q);
+    }
+};
+
+// true if beta has its own table (exact to the interpolation error)
+bool tabulated(const uint16_t beta);
+
+}  // namespace ntc
+
+int16_t ntc_temperature(uint16_t code, const uint16_t beta); // C/10
+
+}  // namespace devices
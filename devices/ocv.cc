@@ -0,0 +1,60 @@
+#include "ocv.h"
+#include <avr/pgmspace.h>
+
+namespace {
+
+// mV, SOC 100% first, strictly descending
+const uint16_t ocvCurves[devices::NUM_OCV_CURVES][NUM_OCV_POINTS] PROGMEM = {
+    { 4180, 4110, 4060, 4020, 3980, 3950, 3910, 3880, 3850, 3820, 3790,
+      3770, 3750, 3730, 3710, 3690, 3660, 3620, 3560, 3450, 3000 },
+    { 3400, 3350, 3335, 3330, 3325, 3320, 3310, 3300, 3295, 3290, 3285,
+      3280, 3275, 3270, 3260, 3250, 3230, 3210, 3180, 3100, 2500 },
+    { 2700, 2600, 2550, 2500, 2470, 2440, 2410, 2390, 2370, 2350, 2330,
+      2310, 2290, 2270, 2250, 2230, 2200, 2160, 2100, 2000, 1500 },
+};
+
+char const ocvNMC[] PROGMEM = "NMC";
+char const ocvLFP[] PROGMEM = "LFP";
+char const ocvLTO[] PROGMEM = "LTO";
+
+const char * const ocvNames[devices::NUM_OCV_CURVES] PROGMEM = { ocvNMC, ocvLFP, ocvLTO };
+
+}  // namespace
+
+namespace devices {
+
+uint16_t ocv_soc_permille(const uint8_t curve, const uint16_t cell_mV) {
+    const uint16_t *ocv = ocvCurves[curve < NUM_OCV_CURVES ? curve : (uint8_t)OCV_NMC];
+    if (cell_mV >= pgm_read_word(&ocv[0])) return 1000;
+    if (cell_mV <= pgm_read_word(&ocv[NUM_OCV_POINTS - 1])) return 0;
+    // ocv[lo] > cell_mV >= ocv[hi], hi = lo + 1 at the end
+    uint8_t lo = 0, hi = NUM_OCV_POINTS - 1;
+    while (hi - lo > 1) {
+        const uint8_t mid = (lo + hi) / 2;
+        if (pgm_read_word(&ocv[mid]) > cell_mV) lo = mid; else hi = mid;
+    }
+    const uint16_t vhi = pgm_read_word(&ocv[lo]);
+    const uint16_t vlo = pgm_read_word(&ocv[hi]);
+    const uint16_t step = 1000 / (NUM_OCV_POINTS - 1);
+    return (NUM_OCV_POINTS - 1 - hi) * step + ((uint32_t)(cell_mV - vlo) * step) / (vhi - vlo);
+}
+
+uint16_t ocv_voltage(const uint8_t curve, uint16_t soc_bp, int16_t *slope_q12) {
+    const uint16_t *ocv = ocvCurves[curve < NUM_OCV_CURVES ? curve : (uint8_t)OCV_NMC];
+    const uint16_t step = 10000 / (NUM_OCV_POINTS - 1);
+    if (soc_bp > 10000) soc_bp = 10000;
+    // segment between point i (higher SOC) and i + 1
+    uint8_t i = (10000 - soc_bp) / step;
+    if (i > NUM_OCV_POINTS - 2) i = NUM_OCV_POINTS - 2;
+    const uint16_t vhi = pgm_read_word(&ocv[i]);
+    const uint16_t vlo = pgm_read_word(&ocv[i + 1]);
+    const uint16_t base = (NUM_OCV_POINTS - 2 - i) * step; // SOC at vlo
+    if (slope_q12) *slope_q12 = ((uint32_t)(vhi - vlo) << 12) / step;
+    return vlo + ((uint32_t)(vhi - vlo) * (soc_bp - base)) / step;
+}
+
+const char *ocv_name(const uint8_t curve) {
+    return (const char *)pgm_read_ptr(&ocvNames[curve < NUM_OCV_CURVES ? curve : (uint8_t)OCV_NMC]);
+}
+
+}  // namespace devices
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+// Cell open circuit voltage vs. state of charge, built-in PROGMEM curves
+// for the common chemistries. Points are mV at SOC 100%, 95%, ..., 0%.
+
+#define NUM_OCV_POINTS 21
+
+namespace devices {
+
+enum OCVCurve : uint8_t {
+    OCV_NMC,    // Li-ion NMC/NCA, 4.2 V
+    OCV_LFP,    // LiFePO4, 3.6 V
+    OCV_LTO,    // Li-titanate, 2.7 V
+    NUM_OCV_CURVES
+};
+
+// SOC in 0.1 % for a rested cell voltage, binary search + linear interpolation
+uint16_t ocv_soc_permille(const uint8_t curve, const uint16_t cell_mV);
+// Inverse: OCV in mV at SOC in 0.01 %, slope of that segment in Q12 mV per 0.01 %
+uint16_t ocv_voltage(const uint8_t curve, const uint16_t soc_bp, int16_t *slope_q12);
+const char *ocv_name(const uint8_t curve); // PGM string
+
+}  // namespace devices
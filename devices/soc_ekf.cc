@@ -0,0 +1,126 @@
+#include "soc_ekf.h"
+#include "ocv.h"
+
+#define EKF_P00_MAX     (1L << 20)  // bp^2, sigma 10 %
+#define EKF_P11_MAX     (1L << 16)  // mV^2, sigma 256 mV
+#define EKF_Q_SOC       1           // bp^2 per step, coulomb counter drift
+#define EKF_Q_RC        1           // mV^2 per step
+#define EKF_R           400         // mV^2, cell ADC + model error (20 mV)
+#define EKF_INNOV_MAX   256         // mV, a larger residual is a glitch
+
+namespace {
+
+uint8_t nbits(uint32_t x) {
+    uint8_t n = 0;
+    while (x) { x >>= 1; n++; }
+    return n;
+}
+
+// a * b / c with 32-bit arithmetic only. When the product would overflow,
+// the surplus bits are taken from the divisor first (keeping it >= 2^15),
+// then from the larger operand and the result is scaled back.
+int32_t muldiv(const int32_t a, const int32_t b, const int32_t c) {
+    if (c == 0) return 0;
+    const bool neg = (a < 0) ^ (b < 0) ^ (c < 0);
+    uint32_t ua = a < 0 ? -(uint32_t)a : a;
+    uint32_t ub = b < 0 ? -(uint32_t)b : b;
+    uint32_t uc = c < 0 ? -(uint32_t)c : c;
+    int8_t over = nbits(ua) + nbits(ub) - 32;
+    int8_t up = 0;
+    if (over > 0) {
+        const int8_t nc = nbits(uc) - 16;
+        const int8_t dc = nc > 0 ? (nc < over ? nc : over) : 0;
+        uc >>= dc;
+        up = over - dc;
+        for (int8_t i = 0; i < over; i++) {
+            if (ua > ub) ua >>= 1; else ub >>= 1;
+        }
+    }
+    uint32_t r = (ua * ub) / uc;
+    if (up > 0) r = nbits(r) + up > 31 ? INT32_MAX : r << up;
+    return neg ? -(int32_t)r : (int32_t)r;
+}
+
+int32_t clamp(const int32_t x, const int32_t lo, const int32_t hi) {
+    return x < lo ? lo : (x > hi ? hi : x);
+}
+
+}  // namespace
+
+namespace devices {
+
+SocEkf::SocEkf() : parallel_(1) {
+    setModel(30, 15, 30);   // 2-3 Ah NMC cell
+    init(5000, 5000);
+}
+
+void SocEkf::setModel(const uint16_t r0_mOhm, const uint16_t r1_mOhm, const uint16_t tau_s) {
+    r0_ = r0_mOhm;
+    r1_ = r1_mOhm;
+    tau_ = tau_s ? tau_s : 1;
+    r0u_ = (int32_t)r0_ * 1000 / parallel_;
+    r1u_ = (int32_t)r1_ * 1000 / parallel_;
+}
+
+void SocEkf::setParallel(const uint8_t cells) {
+    if (!cells || cells == parallel_) return;
+    parallel_ = cells;
+    setModel(r0_, r1_, tau_);
+}
+
+void SocEkf::init(const uint16_t soc_bp, const uint16_t sigma_bp) {
+    soc_ = soc_bp > 10000 ? 10000 : soc_bp;
+    vrc_ = 0;
+    rem_ = 0;
+    p00_ = clamp((int32_t)sigma_bp * sigma_bp, 1, EKF_P00_MAX);
+    p01_ = 0;
+    p11_ = 100;  // 10 mV, the pack was at rest or near it
+}
+
+uint16_t SocEkf::sigma() const {
+    uint16_t s = 0;
+    while ((int32_t)(s + 1) * (s + 1) <= p00_) s++;
+    return s;
+}
+
+void SocEkf::predict(const int32_t current_mA, const uint16_t dt_ms, const int32_t capacity_mAs) {
+    if (capacity_mAs < 10) return;
+    // SOC: 1 bp is capacity / 10 mA * ms, the remainder is carried
+    const int32_t bp = capacity_mAs / 10;
+    const int32_t num = current_mA * (int32_t)dt_ms + rem_;
+    const int32_t dsoc = num / bp;
+    rem_ = num - dsoc * bp;
+    soc_ = clamp(soc_ + dsoc, 0, 10000);
+    // RC branch, a = 1 - dt / tau in Q15 (dt << tau)
+    int32_t a = 32768L - ((int32_t)dt_ms * 32768L) / ((int32_t)tau_ * 1000L);
+    if (a < 0) a = 0;
+    // (1 - a) * R1 * I: uOhm * mA / 1000 = uV, to mV/16
+    int32_t v = ((int32_t)vrc_ * a) >> 15;
+    v += muldiv(muldiv(r1u_, current_mA, 1000), 32768L - a, 2048000L);
+    vrc_ = clamp(v, INT16_MIN, INT16_MAX);
+    // P = F P F' + Q, F = diag(1, a)
+    p00_ = clamp(p00_ + EKF_Q_SOC, 1, EKF_P00_MAX);
+    p01_ = muldiv(p01_, a, 32768L);
+    p11_ = clamp(muldiv(muldiv(p11_, a, 32768L), a, 32768L) + EKF_Q_RC, 1, EKF_P11_MAX);
+}
+
+void SocEkf::correct(const uint16_t cell_mV, const int32_t current_mA, const uint8_t curve) {
+    int16_t h;  // dOCV/dSOC, Q12 mV per bp
+    int32_t vpred = ocv_voltage(curve, soc_, &h);
+    vpred += (vrc_ >> 4) + muldiv(r0u_, current_mA, 1000000L);
+    if (h < 1) h = 1;
+    if (h > 2047) h = 2047;
+    const int32_t y = clamp((int32_t)cell_mV - vpred, -EKF_INNOV_MAX, EKF_INNOV_MAX);
+    // H = [h, 1]: PH' and S = HPH' + R
+    const int32_t pht0 = muldiv(p00_, h, 4096) + p01_;
+    const int32_t pht1 = muldiv(p01_, h, 4096) + p11_;
+    const int32_t s = muldiv(pht0, h, 4096) + pht1 + EKF_R;
+    // x += K y, P -= K S K' with K = PH' / S
+    soc_ = clamp(soc_ + muldiv(pht0, y, s), 0, 10000);
+    vrc_ = clamp(vrc_ + muldiv(pht1, y * 16, s), INT16_MIN, INT16_MAX);
+    p00_ = clamp(p00_ - muldiv(pht0, pht0, s), 1, EKF_P00_MAX);
+    p01_ -= muldiv(pht0, pht1, s);
+    p11_ = clamp(p11_ - muldiv(pht1, pht1, s), 1, EKF_P11_MAX);
+}
+
+}  // namespace devices
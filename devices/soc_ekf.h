@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+// SOC estimator, extended Kalman filter over a one-RC cell model:
+//
+//   V = OCV(SOC) + Vrc + R0 * I,    Vrc' = a * Vrc + (1 - a) * R1 * I
+//
+// with the coulomb count as the process and the average cell voltage as
+// the measurement. Integer only: SOC in 0.01 % (bp), Vrc in mV/16, the
+// covariance in bp^2, bp*mV and mV^2. Current is positive when charging,
+// one step holds up to 2^31 mA * ms (about 1000 A for 2 s).
+
+namespace devices {
+
+class SocEkf {
+public:
+    SocEkf();
+    // Cell model: ohmic and RC resistance in mOhm, RC time constant in s
+    void setModel(const uint16_t r0_mOhm, const uint16_t r1_mOhm, const uint16_t tau_s);
+    // Cells in parallel per series group, the pack current splits over them
+    void setParallel(const uint8_t cells);
+    // Restart at a known SOC, sigma is its uncertainty in 0.01 %
+    void init(const uint16_t soc_bp, const uint16_t sigma_bp);
+    void predict(const int32_t current_mA, const uint16_t dt_ms, const int32_t capacity_mAs);
+    void correct(const uint16_t cell_mV, const int32_t current_mA, const uint8_t curve);
+    uint16_t soc() const { return soc_; }               // 0.01 %
+    int16_t vrc() const { return vrc_ >> 4; }           // mV
+    uint16_t sigma() const;                             // 0.01 %
+private:
+    int32_t     p00_, p01_, p11_;
+    int32_t     rem_;           // coulomb remainder below 1 bp, mA * ms
+    int32_t     r0u_, r1u_;     // of a series group, uOhm
+    int16_t     soc_;
+    int16_t     vrc_;
+    uint16_t    r0_, r1_, tau_;
+    uint8_t     parallel_;
+};
+
+}  // namespace devices
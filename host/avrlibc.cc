@@ -0,0 +1,51 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+
+volatile uint8_t host_io[0x100];
+
+namespace {
+
+char *ultoa_impl(unsigned long val, char *s, const int radix, const bool neg) {
+    char tmp[sizeof(long) * 8 + 1];
+    uint8_t n = 0;
+    do {
+        const uint8_t d = val % radix;
+        tmp[n++] = d < 10 ? '0' + d : 'a' + d - 10;
+        val /= radix;
+    } while (val);
+    char *p = s;
+    if (neg) *p++ = '-';
+    while (n) *p++ = tmp[--n];
+    *p = 0;
+    return s;
+}
+
+}  // namespace
+
+extern "C" {
+
+char *itoa(int val, char *s, int radix) {
+    if (radix == 10 && val < 0) return ultoa_impl(-(unsigned long)(long)val, s, radix, true);
+    return ultoa_impl((unsigned int)val, s, radix, false);
+}
+
+char *utoa(unsigned int val, char *s, int radix) { return ultoa_impl(val, s, radix, false); }
+
+char *ltoa(long val, char *s, int radix) {
+    if (radix == 10 && val < 0) return ultoa_impl(-(unsigned long)val, s, radix, true);
+    return ultoa_impl((unsigned long)val, s, radix, false);
+}
+
+char *ultoa(unsigned long val, char *s, int radix) { return ultoa_impl(val, s, radix, false); }
+
+char *dtostrf(double val, signed char width, unsigned char prec, char *s) {
+    sprintf(s, "%*.*f", width, prec, val);
+    return s;
+}
+
+// no heap/stack collision to measure on the host (protocol/console.cc)
+uint16_t get_free_mem() { return 0; }
+
+}
@@ -0,0 +1,372 @@
+#include <math.h>
+#include <string.h>
+
+#include "host/bq769x0_sim.h"
+#include "devices/bq769x0_registers.h"
+
+#define CONV_US         250000ULL   // ADC and CC conversion period
+#define TS_CYCLES       8           // TSx converted every 2 s
+#define CC_LSB_NV       8440        // 8.44 uV per CC count
+#define TS_LSB_UV       382.0
+#define NO_FAULT        UINT64_MAX
+
+// SYS_CTRL1 / SYS_CTRL2 bits
+#define CTRL1_LOAD_PRESENT  0x80
+#define CTRL1_ADC_EN        0x10
+#define CTRL1_TEMP_SEL      0x08
+#define CTRL2_DELAY_DIS     0x80
+#define CTRL2_CC_EN         0x40
+#define CTRL2_CC_ONESHOT    0x20
+#define CTRL2_DSG_ON        0x02
+#define CTRL2_CHG_ON        0x01
+
+namespace {
+
+enum Fault { F_OCD, F_SCD, F_OV, F_UV };
+
+const uint8_t faultFlag[] = { STAT_OCD, STAT_SCD, STAT_OV, STAT_UV };
+
+// thresholds in mV across the shunt, [RSNS][setting]
+const uint8_t scdThreshold[2][8] = {
+    { 22, 33, 44, 56, 67, 78, 89, 100 },
+    { 44, 67, 89, 111, 133, 155, 178, 200 }
+};
+const uint8_t ocdThreshold[2][16] = {
+    { 8, 11, 14, 17, 19, 22, 25, 28, 31, 33, 36, 39, 42, 44, 47, 50 },
+    { 17, 22, 28, 33, 39, 44, 50, 56, 61, 67, 72, 78, 83, 89, 94, 100 }
+};
+
+}  // namespace
+
+namespace host {
+
+Bq769x0Sim::Bq769x0Sim(const uint8_t addr, const uint8_t cells, const uint8_t thermistors):
+    RegisterFile(addr),
+    conversions(0),
+    cells_(cells > 15 ? 15 : cells),
+    thermistors_(thermistors > 3 ? 3 : thermistors),
+    current_mA_(0),
+    shunt_uOhm_(1000),
+    rbal_ohm_(100),
+    beta_(3435),
+    gainCode_(17),      // 382 uV/LSB
+    offsetTrim_(0)
+{
+    memset(trips, 0, sizeof(trips));
+    memset(bleed_, 0, sizeof(bleed_));
+    for (uint8_t i = 0; i < 15; i++) cell_mV_[i] = 3700;
+    for (uint8_t i = 0; i < 3; i++) temp_dC_[i] = 250;
+    boot();
+}
+
+//----------------------------------------------------------------------------
+// inputs, the model first runs up to now with the old values
+
+void Bq769x0Sim::setCell(const uint8_t cell, const uint16_t mV) {
+    step();
+    if (cell < cells_) cell_mV_[cell] = mV;
+    checkFaults(now_);
+}
+
+void Bq769x0Sim::setCells(const uint16_t mV) {
+    step();
+    for (uint8_t i = 0; i < cells_; i++) cell_mV_[i] = mV;
+    checkFaults(now_);
+}
+
+void Bq769x0Sim::setCurrent(const int32_t mA) {
+    step();
+    current_mA_ = mA;
+    checkFaults(now_);
+}
+
+void Bq769x0Sim::setTemperature(const uint8_t ts, const int16_t dC) {
+    step();
+    if (ts < 3) temp_dC_[ts] = dC;
+}
+
+void Bq769x0Sim::setTrim(const uint8_t gain_code, const int8_t offset_mV) {
+    gainCode_ = gain_code & 0x1F;
+    offsetTrim_ = offset_mV;
+    reg[ADCGAIN1] = (reg[ADCGAIN1] & ~0x0C) | ((gainCode_ >> 3) << 2);
+    reg[ADCGAIN2] = (reg[ADCGAIN2] & ~0xE0) | ((gainCode_ & 0x07) << 5);
+    reg[ADCOFFSET] = (uint8_t)offsetTrim_;
+}
+
+void Bq769x0Sim::injectXready() {
+    step();
+    trip(STAT_DEVICE_XREADY);
+}
+
+void Bq769x0Sim::overrideAlert() {
+    step();
+    trip(STAT_OVRD_ALERT);
+}
+
+// power-on reset values per datasheet, trim survives
+void Bq769x0Sim::boot() {
+    memset(reg, 0, sizeof(reg));
+    reg[OV_TRIP] = 0xAC;
+    reg[UV_TRIP] = 0x97;
+    setTrim(gainCode_, offsetTrim_);
+    shipped_ = false;
+    shipStep_ = 0;
+    now_ = host::micros();
+    nextConv_ = now_ + CONV_US;
+    tsCycle_ = 0;
+    ccCharge_ = 0;
+    for (uint8_t i = 0; i < 4; i++) since_[i] = NO_FAULT;
+}
+
+//----------------------------------------------------------------------------
+// outputs
+
+bool Bq769x0Sim::alert() {
+    step();
+    return !shipped_ && (reg[SYS_STAT] & (STAT_CC_READY | STAT_FLAGS));
+}
+
+bool Bq769x0Sim::chargeOn() {
+    step();
+    return !shipped_ && (reg[SYS_CTRL2] & CTRL2_CHG_ON);
+}
+
+bool Bq769x0Sim::dischargeOn() {
+    step();
+    return !shipped_ && (reg[SYS_CTRL2] & CTRL2_DSG_ON);
+}
+
+int32_t Bq769x0Sim::current() {
+    step();
+    return flowing();
+}
+
+double Bq769x0Sim::bleed_mAs(const uint8_t cell) {
+    step();
+    return cell < 15 ? bleed_[cell] / 1e6 : 0;
+}
+
+// back to back FETs: an open CHG FET blocks charge, an open DSG FET
+// blocks discharge, the other direction runs through the body diode
+int32_t Bq769x0Sim::flowing() const {
+    if (shipped_) return 0;
+    const uint8_t fets = reg[SYS_CTRL2];
+    if (current_mA_ > 0) return (fets & CTRL2_CHG_ON) ? current_mA_ : 0;
+    return (fets & CTRL2_DSG_ON) ? current_mA_ : 0;
+}
+
+//----------------------------------------------------------------------------
+// time
+
+void Bq769x0Sim::step() {
+    const uint64_t t = host::micros();
+    if (shipped_) {
+        now_ = t;
+        return;
+    }
+    for (uint64_t e = pending(); e <= t && !shipped_; e = pending()) {
+        integrate(e);
+        checkFaults(e);
+        if (e == nextConv_) {
+            convert();
+            nextConv_ += CONV_US;
+        }
+    }
+    integrate(t);
+}
+
+uint64_t Bq769x0Sim::nextEvent() {
+    step();
+    return shipped_ ? UINT64_MAX : pending();
+}
+
+// the next conversion or protection delay running out
+uint64_t Bq769x0Sim::pending() const {
+    uint64_t e = nextConv_;
+    for (uint8_t f = 0; f < 4; f++) {
+        if (since_[f] != NO_FAULT && since_[f] + delay_us(f) < e) e = since_[f] + delay_us(f);
+    }
+    return e < now_ ? now_ : e;
+}
+
+void Bq769x0Sim::integrate(const uint64_t t) {
+    if (t <= now_) return;
+    const double dt = t - now_;
+    ccCharge_ += flowing() * dt;
+    for (uint8_t s = 0; s < 3; s++) {
+        const uint8_t bal = reg[CELLBAL1 + s];
+        for (uint8_t i = 0; i < 5; i++) {
+            const uint8_t c = s * 5 + i;
+            if ((bal & (1 << i)) && c < cells_) bleed_[c] += (double)cell_mV_[c] / rbal_ohm_ * dt;
+        }
+    }
+    now_ = t;
+}
+
+//----------------------------------------------------------------------------
+// conversions, cells are measured with balancing paused as on the chip
+
+void Bq769x0Sim::putWord(const uint8_t address, const uint16_t value) {
+    reg[address] = value >> 8;
+    reg[address + 1] = value & 0xFF;
+}
+
+uint16_t Bq769x0Sim::gain_uV() const { return 365 + gainCode_; }
+
+void Bq769x0Sim::convert() {
+    conversions++;
+    const uint8_t ctrl1 = reg[SYS_CTRL1];
+    uint8_t &ctrl2 = reg[SYS_CTRL2];
+    if (ctrl1 & CTRL1_ADC_EN) {
+        uint32_t bat_uV = 0;
+        for (uint8_t i = 0; i < 15; i++) {
+            int32_t code = 0;
+            if (i < cells_) {
+                code = lround(((double)cell_mV_[i] * 1000.0 - offsetTrim_ * 1000.0) / gain_uV());
+                bat_uV += cell_mV_[i] * 1000UL;
+            }
+            putWord(VC1_HI_BYTE + 2 * i, code < 0 ? 0 : code > 0x3FFF ? 0x3FFF : code);
+        }
+        const int32_t bat = lround(((double)bat_uV - cells_ * offsetTrim_ * 1000.0) / (4.0 * gain_uV()));
+        putWord(BAT_HI_BYTE, bat < 0 ? 0 : bat > 0xFFFF ? 0xFFFF : bat);
+        if (tsCycle_++ % TS_CYCLES == 0) {
+            for (uint8_t i = 0; i < 3; i++) {
+                double v = 0;
+                const double t_C = temp_dC_[i] / 10.0;
+                if (ctrl1 & CTRL1_TEMP_SEL) {
+                    if (i < thermistors_) {
+                        const double r = 10000.0 * exp(beta_ * (1.0 / (t_C + 273.15) - 1.0 / 298.15));
+                        v = 3.3 * r / (r + 10000.0);
+                    }
+                } else {
+                    v = 1.200 - (t_C - 25.0) * 0.0042;  // die temperature
+                }
+                putWord(TS1_HI_BYTE + 2 * i, (uint16_t)lround(v * 1e6 / TS_LSB_UV) & 0x3FFF);
+            }
+        }
+    }
+    if (ctrl2 & (CTRL2_CC_EN | CTRL2_CC_ONESHOT)) {
+        const double mA = ccCharge_ / CONV_US;
+        long cc = lround(mA * shunt_uOhm_ / CC_LSB_NV);
+        if (cc > INT16_MAX) cc = INT16_MAX;
+        if (cc < INT16_MIN) cc = INT16_MIN;
+        putWord(CC_HI_BYTE, (uint16_t)(int16_t)cc);
+        reg[SYS_STAT] |= STAT_CC_READY;
+        ctrl2 &= ~CTRL2_CC_ONESHOT;
+    }
+    ccCharge_ = 0;
+}
+
+//----------------------------------------------------------------------------
+// protections
+
+uint32_t Bq769x0Sim::delay_us(const uint8_t fault) const {
+    if (reg[SYS_CTRL2] & CTRL2_DELAY_DIS) return 0;
+    switch (fault) {
+        case F_SCD: return SCD_delay_setting[(reg[PROTECT1] >> 3) & 0x03];
+        case F_OCD: return OCD_delay_setting[(reg[PROTECT2] >> 4) & 0x07] * 1000UL;
+        case F_UV:  return UV_delay_setting[(reg[PROTECT3] >> 6) & 0x03] * 1000000UL;
+        default:    return OV_delay_setting[(reg[PROTECT3] >> 4) & 0x03] * 1000000UL;
+    }
+}
+
+// true once the condition held for the fault's delay
+bool Bq769x0Sim::held(const uint8_t fault, const bool cond, const uint64_t t) {
+    if (!cond || (reg[SYS_STAT] & faultFlag[fault])) {
+        since_[fault] = NO_FAULT;
+        return false;
+    }
+    if (since_[fault] == NO_FAULT) since_[fault] = t;
+    return t - since_[fault] >= delay_us(fault);
+}
+
+void Bq769x0Sim::checkFaults(const uint64_t t) {
+    if (shipped_) return;
+    const uint8_t rsns = reg[PROTECT1] >> 7;
+    const int32_t i = flowing();
+    const uint32_t sense_uV = i < 0 ? (uint32_t)((int64_t)-i * shunt_uOhm_ / 1000) : 0;
+    const uint32_t scd_uV = scdThreshold[rsns][reg[PROTECT1] & 0x07] * 1000UL;
+    const uint32_t ocd_uV = ocdThreshold[rsns][reg[PROTECT2] & 0x0F] * 1000UL;
+    // OV and UV compare ADC codes: 10-OV_TRIP-1000 and 01-UV_TRIP-0000
+    const int32_t ov_mV = ((0x2008 | (reg[OV_TRIP] << 4)) * gain_uV()) / 1000 + offsetTrim_;
+    const int32_t uv_mV = ((0x1000 | (reg[UV_TRIP] << 4)) * gain_uV()) / 1000 + offsetTrim_;
+    bool ov = false, uv = false;
+    for (uint8_t c = 0; c < cells_; c++) {
+        if (cell_mV_[c] > ov_mV) ov = true;
+        if (cell_mV_[c] < uv_mV) uv = true;
+    }
+    ov = ov && (reg[SYS_CTRL1] & CTRL1_ADC_EN);   // OV protection runs on the ADC
+    if (held(F_SCD, sense_uV > scd_uV, t)) trip(STAT_SCD);
+    if (held(F_OCD, sense_uV > ocd_uV, t)) trip(STAT_OCD);
+    if (held(F_OV, ov, t)) trip(STAT_OV);
+    if (held(F_UV, uv, t)) trip(STAT_UV);
+}
+
+void Bq769x0Sim::trip(const uint8_t flag) {
+    reg[SYS_STAT] |= flag;
+    for (uint8_t b = 0; b < 6; b++) {
+        if (flag & (1 << b)) trips[b]++;
+    }
+    if (flag & STAT_OV) reg[SYS_CTRL2] &= ~CTRL2_CHG_ON;
+    if (flag & (STAT_UV | STAT_SCD | STAT_OCD)) reg[SYS_CTRL2] &= ~CTRL2_DSG_ON;
+    if (flag & (STAT_DEVICE_XREADY | STAT_OVRD_ALERT)) reg[SYS_CTRL2] &= ~(CTRL2_CHG_ON | CTRL2_DSG_ON);
+}
+
+//----------------------------------------------------------------------------
+// register access
+
+bool Bq769x0Sim::transfer(const uint8_t *wdata, const uint8_t wlen, uint8_t *rdata, const uint8_t rlen) {
+    step();
+    if (shipped_) return false;     // no I2C in SHIP mode
+    return RegisterFile::transfer(wdata, wlen, rdata, rlen);
+}
+
+uint8_t Bq769x0Sim::readReg(const uint8_t address) {
+    if (address == SYS_CTRL1) {
+        // load still connected after the DSG FET opened
+        const bool load = !(reg[SYS_CTRL2] & CTRL2_DSG_ON) && current_mA_ < 0;
+        return (reg[SYS_CTRL1] & ~CTRL1_LOAD_PRESENT) | (load ? CTRL1_LOAD_PRESENT : 0);
+    }
+    return reg[address];
+}
+
+void Bq769x0Sim::writeReg(const uint8_t address, const uint8_t value) {
+    const uint8_t stat = reg[SYS_STAT];
+    switch (address) {
+        case SYS_STAT:
+            reg[SYS_STAT] &= ~(value & (STAT_CC_READY | STAT_FLAGS));
+            break;
+        case CELLBAL1:
+        case CELLBAL2:
+        case CELLBAL3:
+            if ((address - CELLBAL1) * 5 < cells_) reg[address] = value & 0x1F;
+            break;
+        case SYS_CTRL1:
+            // SHIP: [SHUT_A, SHUT_B] = 01 followed by 10
+            if ((value & 0x03) == 0x02 && shipStep_ == 1) {
+                shipped_ = true;
+                return;
+            }
+            shipStep_ = (value & 0x03) == 0x01;
+            reg[SYS_CTRL1] = value & (CTRL1_ADC_EN | CTRL1_TEMP_SEL | 0x03);
+            break;
+        case SYS_CTRL2: {
+            uint8_t v = value & (CTRL2_DELAY_DIS | CTRL2_CC_EN | CTRL2_CC_ONESHOT | CTRL2_DSG_ON | CTRL2_CHG_ON);
+            // FETs stay open while their fault is flagged
+            if (stat & (STAT_OV | STAT_DEVICE_XREADY | STAT_OVRD_ALERT)) v &= ~CTRL2_CHG_ON;
+            if (stat & (STAT_UV | STAT_SCD | STAT_OCD | STAT_DEVICE_XREADY | STAT_OVRD_ALERT)) v &= ~CTRL2_DSG_ON;
+            reg[SYS_CTRL2] = v;
+            break;
+        }
+        case PROTECT1:  reg[address] = value & 0x9F; break;
+        case PROTECT2:  reg[address] = value & 0x7F; break;
+        case PROTECT3:  reg[address] = value & 0xF0; break;
+        case OV_TRIP:
+        case UV_TRIP:   reg[address] = value; break;
+        case CC_CFG:    reg[address] = value & 0x3F; break;
+        default:        break;      // measurement and trim registers are read only
+    }
+    checkFaults(now_);
+}
+
+}  // namespace host
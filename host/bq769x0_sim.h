@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+#include "host/regfile.h"
+
+namespace host {
+
+// Behavioural model of a bq769x0 (bq76940 by default) on the host I2C bus.
+//
+// The analog side is set through setCell()/setCurrent()/setTemperature()
+// and takes effect at the current virtual time. The chip side follows the
+// datasheet: 250 ms ADC and coulomb counter conversions (TSx every 2 s),
+// CC_READY, factory ADCGAIN/ADCOFFSET trim, PROTECT1..3 with their delays
+// opening the FETs, CELLBAL bleed, write-1-to-clear SYS_STAT, the SHIP
+// sequence and ALERT. Everything is computed lazily from host::micros(),
+// so the model runs as fast as the clock is advanced.
+class Bq769x0Sim : public RegisterFile {
+public:
+    Bq769x0Sim(const uint8_t addr, const uint8_t cells = 15, const uint8_t thermistors = 3);
+
+    // analog inputs
+    void setCell(const uint8_t cell, const uint16_t mV);
+    void setCells(const uint16_t mV);
+    void setCurrent(const int32_t mA);      // at the pack terminals, + is charge
+    void setTemperature(const uint8_t ts, const int16_t dC);
+    void setShunt(const uint32_t uOhm) { step(); shunt_uOhm_ = uOhm; }
+    void setBalanceResistor(const uint16_t ohm) { step(); rbal_ohm_ = ohm; }
+    void setThermistorBeta(const uint16_t beta) { step(); beta_ = beta; }
+    // factory trim: gain 365 + code (0..31) uV/LSB, offset in mV
+    void setTrim(const uint8_t gain_code, const int8_t offset_mV);
+
+    // faults that do not come from the analog inputs
+    void injectXready();
+    void overrideAlert();                   // ALERT pin driven high from outside
+    void boot();                            // leave SHIP mode, power-on reset
+
+    // observed state
+    bool alert() override;
+    bool chargeOn();
+    bool dischargeOn();
+    bool shipped() const { return shipped_; }
+    int32_t current();                      // what flows with the FETs as they are
+    uint16_t cell(const uint8_t cell) const { return cell_mV_[cell]; }
+    double bleed_mAs(const uint8_t cell);   // charge drawn by CELLBAL since boot
+    uint32_t conversions;
+    uint16_t trips[6];                      // per SYS_STAT bit OCD..XREADY
+
+    void step();                            // catch up with the virtual clock
+    uint64_t nextEvent() override;          // next conversion or protection trip
+
+protected:
+    bool transfer(const uint8_t *wdata, const uint8_t wlen, uint8_t *rdata, const uint8_t rlen) override;
+    uint8_t readReg(const uint8_t address) override;
+    void writeReg(const uint8_t address, const uint8_t value) override;
+
+private:
+    const uint8_t cells_;
+    const uint8_t thermistors_;
+    uint16_t cell_mV_[15];
+    int16_t temp_dC_[3];
+    int32_t current_mA_;
+    uint32_t shunt_uOhm_;
+    uint16_t rbal_ohm_;
+    uint16_t beta_;
+    bool shipped_;
+    uint8_t shipStep_;
+    uint64_t now_;                          // model time, us
+    uint64_t nextConv_;                     // end of the running 250 ms conversion
+    uint8_t tsCycle_;
+    double ccCharge_;                       // mA*us in the running CC conversion
+    double bleed_[15];                      // mA*us per cell
+    uint64_t since_[4];                     // OCD, SCD, OV, UV condition start, 0 = not present
+
+    uint8_t gainCode_;
+    int8_t offsetTrim_;
+
+    int32_t flowing() const;
+    uint16_t gain_uV() const;
+    void integrate(const uint64_t t);
+    uint64_t pending() const;
+    void convert();
+    void checkFaults(const uint64_t t);
+    bool held(const uint8_t fault, const bool cond, const uint64_t t);
+    uint32_t delay_us(const uint8_t fault) const;
+    void trip(const uint8_t flag);
+    void putWord(const uint8_t address, const uint16_t value);
+};
+
+}  // namespace host
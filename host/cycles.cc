@@ -0,0 +1,25 @@
+#include <time.h>
+
+#include "mcu/cycles.h"
+
+// Host stopwatch: thread CPU time scaled to F_CPU cycles, so figures read
+// like the on-target ones but measure the host CPU
+namespace {
+
+uint64_t cpu_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t start_ns = 0;
+
+}  // namespace
+
+namespace mcu {
+
+    void Cycles::start() { start_ns = cpu_ns(); }
+
+    uint32_t Cycles::stop() { return (uint32_t)((cpu_ns() - start_ns) * (F_CPU / 1000000UL) / 1000); }
+
+}  // namespace mcu
@@ -0,0 +1,113 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+
+#include "host/hal.h"
+
+// bounds of the EEMEM section, provided by the linker
+extern "C" {
+extern uint8_t __start_host_eeprom[] __attribute__((weak));
+extern uint8_t __stop_host_eeprom[] __attribute__((weak));
+}
+
+namespace {
+
+uint8_t image[E2END + 1];
+bool loaded = false;
+int fd = -1;
+uint32_t writes = 0;
+
+void load() {
+    if (loaded) return;
+    memset(image, 0xff, sizeof(image));     // erased cells
+    if (fd >= 0 && pread(fd, image, sizeof(image), 0) < 0) perror("host: eeprom");
+    loaded = true;
+}
+
+uint16_t offset(const void *p, const size_t n) {
+    const uintptr_t a = reinterpret_cast<uintptr_t>(p);
+    const uintptr_t start = reinterpret_cast<uintptr_t>(__start_host_eeprom);
+    const uintptr_t stop = reinterpret_cast<uintptr_t>(__stop_host_eeprom);
+    uintptr_t off = a;
+    if (start && a >= start && a < stop) off = a - start;
+    if (off + n > E2END + 1) {
+        fprintf(stderr, "host: eeprom access %p+%zu out of range\n", p, n);
+        abort();
+    }
+    load();
+    return off;
+}
+
+void store(const uint16_t off, const uint8_t *src, const size_t n) {
+    memcpy(&image[off], src, n);
+    writes += n;
+    if (fd >= 0 && pwrite(fd, &image[off], n, off) < 0) perror("host: eeprom");
+}
+
+}  // namespace
+
+namespace host {
+
+bool eepromOpen(const char *path) {
+    fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    loaded = false;
+    load();
+    // a new file starts out erased
+    if (lseek(fd, 0, SEEK_END) < (off_t)sizeof(image) && pwrite(fd, image, sizeof(image), 0) < 0) return false;
+    return true;
+}
+
+uint32_t eepromWrites() { return writes; }
+
+}  // namespace host
+
+extern "C" {
+
+void eeprom_read_block(void *dst, const void *src, size_t n) {
+    memcpy(dst, &image[offset(src, n)], n);
+}
+
+uint8_t eeprom_read_byte(const uint8_t *p) {
+    uint8_t v;
+    eeprom_read_block(&v, p, sizeof(v));
+    return v;
+}
+
+uint16_t eeprom_read_word(const uint16_t *p) {
+    uint16_t v;
+    eeprom_read_block(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t eeprom_read_dword(const uint32_t *p) {
+    uint32_t v;
+    eeprom_read_block(&v, p, sizeof(v));
+    return v;
+}
+
+void eeprom_write_block(const void *src, void *dst, size_t n) {
+    store(offset(dst, n), static_cast<const uint8_t *>(src), n);
+}
+
+void eeprom_write_byte(uint8_t *p, uint8_t value) { eeprom_write_block(&value, p, sizeof(value)); }
+void eeprom_write_word(uint16_t *p, uint16_t value) { eeprom_write_block(&value, p, sizeof(value)); }
+void eeprom_write_dword(uint32_t *p, uint32_t value) { eeprom_write_block(&value, p, sizeof(value)); }
+
+// only changed bytes count as writes, as on the chip
+void eeprom_update_block(const void *src, void *dst, size_t n) {
+    const uint16_t off = offset(dst, n);
+    const uint8_t *s = static_cast<const uint8_t *>(src);
+    for (size_t i = 0; i < n; i++) {
+        if (image[off + i] != s[i]) store(off + i, &s[i], 1);
+    }
+}
+
+void eeprom_update_byte(uint8_t *p, uint8_t value) { eeprom_update_block(&value, p, sizeof(value)); }
+
+}
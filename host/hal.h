@@ -0,0 +1,64 @@
+#pragma once
+
+// Host backend of the mcu:: drivers. The firmware sources build unchanged
+// against host/include, these hooks let the host main wire the backends.
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace host {
+
+//----------------------------------------------------------------------------
+// virtual clock (timer.cc), advanced by _delay_*, bus traffic and the idle
+// loop, never by the host's own execution time. Interactive runs let it
+// follow the wall clock, simulations jump it from one device event to the
+// next, which makes them deterministic and as fast as the host allows.
+
+uint64_t micros();
+void advance(const uint32_t us);
+void advanceTo(const uint64_t us);
+void syncRealtime();            // catch up with the wall clock, interactive runs
+
+//----------------------------------------------------------------------------
+// UART (usart.cc), a pseudo terminal or stdin/stdout
+
+bool uartOpenPty();             // prints the slave device name on stderr
+bool uartOpenStdio();           // LF is sent as CR when stdin is not a tty
+void uartOpenOutput(const int fd);      // output only, input comes from uartInject()
+void uartInject(const char *s); // typed into the console, LF sent as CR
+bool uartWait(const int timeout_ms);    // false once the input reached EOF
+bool uartEof();
+// output goes to buf, NUL terminated and cut at size, until called with nullptr
+void uartCapture(char *buf, const size_t size);
+
+//----------------------------------------------------------------------------
+// EEPROM (eeprom.cc), loaded from and written through to a file
+
+bool eepromOpen(const char *path);
+uint32_t eepromWrites();        // bytes written since start, for wear estimates
+
+//----------------------------------------------------------------------------
+// I2C bus (i2c_master.cc), one device object per 7-bit address
+
+class I2CDevice {
+public:
+    virtual ~I2CDevice() {}
+    // write phase, then read phase after a repeated START; false is a NACK
+    virtual bool transfer(const uint8_t *wdata, const uint8_t wlen, uint8_t *rdata, const uint8_t rlen) = 0;
+    // ALERT line, consumed by the main loop as the INT0 edge
+    virtual bool alert() { return false; }
+    // virtual time of the next internal state change, UINT64_MAX if none
+    virtual uint64_t nextEvent() { return UINT64_MAX; }
+};
+
+void i2cAttach(const uint8_t addr, I2CDevice *dev);
+bool i2cAlert();                // rising edge on any device ALERT since the last call
+uint64_t i2cNextEvent();        // earliest nextEvent() on the bus
+
+//----------------------------------------------------------------------------
+// reset (watchdog.cc), re-executes the binary keeping the UART and EEPROM
+
+void begin(const int argc, char **argv);
+void reset(const char *cause) __attribute__((noreturn));
+
+}  // namespace host
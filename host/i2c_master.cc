@@ -0,0 +1,100 @@
+#include <avr/io.h>
+
+#include "mcu/i2c_master.h"
+#include "host/hal.h"
+
+#define I2C_FREQ 100000UL
+#define I2C_BIT_US (1000000UL / I2C_FREQ)
+
+namespace {
+
+host::I2CDevice *i2c_dev[128];
+bool i2c_alert_prev = false;
+
+}  // namespace
+
+namespace host {
+
+void i2cAttach(const uint8_t addr, I2CDevice *dev) { i2c_dev[addr & 0x7f] = dev; }
+
+bool i2cAlert() {
+    bool level = false;
+    for (I2CDevice *dev : i2c_dev) {
+        if (dev && dev->alert()) level = true;
+    }
+    const bool edge = level && !i2c_alert_prev;
+    i2c_alert_prev = level;
+    return edge;
+}
+
+uint64_t i2cNextEvent() {
+    uint64_t e = UINT64_MAX;
+    for (I2CDevice *dev : i2c_dev) {
+        if (dev && dev->nextEvent() < e) e = dev->nextEvent();
+    }
+    return e;
+}
+
+}  // namespace host
+
+namespace mcu {
+
+I2CMaster &I2CMaster::get() {
+    static I2CMaster i2c;
+    return i2c;
+}
+
+I2CMaster::I2CMaster() {
+    power_twi_enable();
+    PORTC |= (1 << PC4) | (1 << PC5);
+    TWSR = 0x00;
+    TWBR = (F_CPU / I2C_FREQ - 16) / 2;
+    sei();
+}
+
+// The transaction runs to completion inside submit(), the virtual clock
+// advances by its time on the bus: 9 clocks per byte, START and STOP.
+bool I2CMaster::submit(Transaction &t) {
+    if (t.wlen == 0 && t.rlen == 0) {
+        t.status = I2C_DONE;
+        return false;
+    }
+    t.next = nullptr;
+    t.status = I2C_BUSY;
+    host::I2CDevice *dev = i2c_dev[t.addr & 0x7f];
+    const bool ack = dev && dev->transfer(t.wdata, t.wlen, t.rdata, t.rlen);
+    const uint16_t bytes = (t.wlen ? 1 + t.wlen : 0) + (t.rlen ? 1 + t.rlen : 0);
+    host::advance((bytes * 9 + 2) * I2C_BIT_US);
+    t.status = ack ? I2C_DONE : I2C_NOACK;
+    if (t.callback) t.callback(t);
+    return true;
+}
+
+bool I2CMaster::busy() { return false; }
+
+I2CMaster::Status I2CMaster::wait(Transaction &t) {
+    while (pending(t)) {}
+    return t.status;
+}
+
+I2CMaster::Status I2CMaster::write_read(const uint8_t addr, const uint8_t *wdata, const uint8_t wlen, uint8_t *rdata, const uint8_t rlen) {
+    Transaction t;
+    t.addr = addr;
+    t.wdata = wdata;
+    t.wlen = wlen;
+    t.rdata = rdata;
+    t.rlen = rlen;
+    t.callback = nullptr;
+    submit(t);
+    return wait(t);
+}
+
+I2CMaster::Status I2CMaster::write(const uint8_t addr, const uint8_t *data, const uint8_t len) {
+    return write_read(addr, data, len, nullptr, 0);
+}
+
+I2CMaster::Status I2CMaster::read(const uint8_t addr, uint8_t *data, const uint8_t len) {
+    return write_read(addr, nullptr, 0, data, len);
+}
+
+}
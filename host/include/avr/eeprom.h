@@ -0,0 +1,23 @@
+#pragma once
+
+// EEPROM of the host build, a file backed image of E2END + 1 bytes
+// (host/eeprom.cc). EEMEM objects are collected in their own section and
+// addressed relative to its start, small integers are raw EEPROM offsets.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define EEMEM __attribute__((section("host_eeprom"), used))
+
+extern "C" {
+uint8_t eeprom_read_byte(const uint8_t *p);
+uint16_t eeprom_read_word(const uint16_t *p);
+uint32_t eeprom_read_dword(const uint32_t *p);
+void eeprom_read_block(void *dst, const void *src, size_t n);
+void eeprom_write_byte(uint8_t *p, uint8_t value);
+void eeprom_write_word(uint16_t *p, uint16_t value);
+void eeprom_write_dword(uint32_t *p, uint32_t value);
+void eeprom_write_block(const void *src, void *dst, size_t n);
+void eeprom_update_byte(uint8_t *p, uint8_t value);
+void eeprom_update_block(const void *src, void *dst, size_t n);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+// The host build is single threaded: an "interrupt" is a backend calling
+// the handler from the main loop, so SREG_I only has to read back right
+// for utils::Atomic.
+
+#include <avr/io.h>
+
+#define sei()           (SREG |= _BV(SREG_I))
+#define cli()           (SREG &= ~_BV(SREG_I))
+#define ISR(vector, ...) void vector(void)
@@ -0,0 +1,186 @@
+#pragma once
+
+// ATmega328P I/O registers for the host build. Every register is a byte of
+// host_io[] at its data-space address, so code that takes register
+// addresses (mcu::Pin) behaves as on the chip. Nothing is wired to the
+// registers, the host backends in host/ replace the drivers that poke them.
+
+#include <stdint.h>
+
+extern volatile uint8_t host_io[0x100];
+
+#define _SFR_MEM8(a)    (host_io[a])
+#define _SFR_MEM16(a)   (*reinterpret_cast<volatile uint16_t *>(&host_io[a]))
+#define _BV(b)          (1 << (b))
+#define bit_is_set(r, b)    ((r) & _BV(b))
+#define bit_is_clear(r, b)  (!((r) & _BV(b)))
+
+#define FLASHEND    0x7FFF
+#define RAMEND      0x08FF
+#define E2END       0x3FF
+
+#define PINB    _SFR_MEM8(0x23)
+#define DDRB    _SFR_MEM8(0x24)
+#define PORTB   _SFR_MEM8(0x25)
+#define PINC    _SFR_MEM8(0x26)
+#define DDRC    _SFR_MEM8(0x27)
+#define PORTC   _SFR_MEM8(0x28)
+#define PIND    _SFR_MEM8(0x29)
+#define DDRD    _SFR_MEM8(0x2A)
+#define PORTD   _SFR_MEM8(0x2B)
+#define TIFR0   _SFR_MEM8(0x35)
+#define TIFR1   _SFR_MEM8(0x36)
+#define TIFR2   _SFR_MEM8(0x37)
+#define PCIFR   _SFR_MEM8(0x3B)
+#define EIFR    _SFR_MEM8(0x3C)
+#define EIMSK   _SFR_MEM8(0x3D)
+#define TCCR0A  _SFR_MEM8(0x44)
+#define TCCR0B  _SFR_MEM8(0x45)
+#define TCNT0   _SFR_MEM8(0x46)
+#define SMCR    _SFR_MEM8(0x53)
+#define MCUSR   _SFR_MEM8(0x54)
+#define MCUCR   _SFR_MEM8(0x55)
+#define SREG    _SFR_MEM8(0x5F)
+#define WDTCSR  _SFR_MEM8(0x60)
+#define PRR     _SFR_MEM8(0x64)
+#define PCICR   _SFR_MEM8(0x68)
+#define EICRA   _SFR_MEM8(0x69)
+#define PCMSK0  _SFR_MEM8(0x6B)
+#define PCMSK1  _SFR_MEM8(0x6C)
+#define PCMSK2  _SFR_MEM8(0x6D)
+#define TIMSK0  _SFR_MEM8(0x6E)
+#define TIMSK1  _SFR_MEM8(0x6F)
+#define TIMSK2  _SFR_MEM8(0x70)
+#define TCCR1A  _SFR_MEM8(0x80)
+#define TCCR1B  _SFR_MEM8(0x81)
+#define TCNT1   _SFR_MEM16(0x84)
+#define TCCR2A  _SFR_MEM8(0xB0)
+#define TCCR2B  _SFR_MEM8(0xB1)
+#define TCNT2   _SFR_MEM8(0xB2)
+#define OCR2A   _SFR_MEM8(0xB3)
+#define TWBR    _SFR_MEM8(0xB8)
+#define TWSR    _SFR_MEM8(0xB9)
+#define TWAR    _SFR_MEM8(0xBA)
+#define TWDR    _SFR_MEM8(0xBB)
+#define TWCR    _SFR_MEM8(0xBC)
+#define UCSR0A  _SFR_MEM8(0xC0)
+#define UCSR0B  _SFR_MEM8(0xC1)
+#define UCSR0C  _SFR_MEM8(0xC2)
+#define UBRR0L  _SFR_MEM8(0xC4)
+#define UBRR0H  _SFR_MEM8(0xC5)
+#define UDR0    _SFR_MEM8(0xC6)
+
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PC4 4
+#define PC5 5
+#define PC6 6
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+
+// SREG
+#define SREG_I  7
+// TIFRn / TIMSKn
+#define TOV0    0
+#define TOIE0   0
+#define OCIE0A  1
+#define OCIE0B  2
+#define TOV1    0
+#define TOIE1   0
+#define TOV2    0
+#define TOIE2   0
+#define OCF2A   1
+#define OCIE2A  1
+// TCCRnA / TCCRnB
+#define WGM00   0
+#define WGM01   1
+#define WGM02   3
+#define WGM21   1
+#define CS00    0
+#define CS01    1
+#define CS02    2
+#define CS10    0
+#define CS11    1
+#define CS12    2
+#define CS20    0
+#define CS21    1
+#define CS22    2
+// SMCR
+#define SE      0
+#define SM0     1
+#define SM1     2
+#define SM2     3
+// MCUSR
+#define PORF    0
+#define EXTRF   1
+#define BORF    2
+#define WDRF    3
+// PRR
+#define PRADC       0
+#define PRUSART0    1
+#define PRSPI       2
+#define PRTIM1      3
+#define PRTIM0      5
+#define PRTIM2      6
+#define PRTWI       7
+// EICRA / EIMSK / PCICR / PCMSK2
+#define ISC00   0
+#define ISC01   1
+#define ISC10   2
+#define ISC11   3
+#define INT0    0
+#define INT1    1
+#define PCIE0   0
+#define PCIE1   1
+#define PCIE2   2
+#define PCINT16 0
+#define PCINT17 1
+// TWCR
+#define TWIE    0
+#define TWEN    2
+#define TWWC    3
+#define TWSTO   4
+#define TWSTA   5
+#define TWEA    6
+#define TWINT   7
+// UCSR0A
+#define MPCM0   0
+#define U2X0    1
+#define UPE0    2
+#define DOR0    3
+#define FE0     4
+#define UDRE0   5
+#define TXC0    6
+#define RXC0    7
+// UCSR0B
+#define TXB80   0
+#define RXB80   1
+#define UCSZ02  2
+#define TXEN0   3
+#define RXEN0   4
+#define UDRIE0  5
+#define TXCIE0  6
+#define RXCIE0  7
+// UCSR0C
+#define UCPOL0  0
+#define UCSZ00  1
+#define UCSZ01  2
+#define USBS0   3
+#define UPM00   4
+#define UPM01   5
@@ -0,0 +1,24 @@
+#pragma once
+
+// Flash and RAM are one address space on the host
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s)             (s)
+#define PGM_P               const char *
+
+#define pgm_read_byte(p)    (*reinterpret_cast<const uint8_t *>(p))
+#define pgm_read_word(p)    (*reinterpret_cast<const uint16_t *>(p))
+#define pgm_read_dword(p)   (*reinterpret_cast<const uint32_t *>(p))
+#define pgm_read_float(p)   (*reinterpret_cast<const float *>(p))
+#define pgm_read_ptr(p)     (*(void * const *)(p))
+
+#define memcpy_P            memcpy
+#define strcpy_P            strcpy
+#define strlen_P            strlen
+#define strcmp_P            strcmp
+#define strncmp_P           strncmp
+#define strcasecmp_P        strcasecmp
+#define strncasecmp_P       strncasecmp
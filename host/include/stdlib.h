@@ -0,0 +1,18 @@
+#pragma once
+
+// The C library plus the avr-libc conversions the firmware relies on
+// (host/avrlibc.cc)
+
+#include_next <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+char *itoa(int val, char *s, int radix);
+char *utoa(unsigned int val, char *s, int radix);
+char *ltoa(long val, char *s, int radix);
+char *ultoa(unsigned long val, char *s, int radix);
+char *dtostrf(double val, signed char width, unsigned char prec, char *s);
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,6 @@
+#pragma once
+
+// Busy waits advance the virtual clock (host/timer.cc) instead of spinning
+
+void _delay_ms(double ms);
+void _delay_us(double us);
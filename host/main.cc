@@ -0,0 +1,95 @@
+/* Host (Linux) build of the shell console, see host/Makefile
+ *
+ * Runs the firmware's Console and bq769x0 driver against the host
+ * backends: UART on a pty (or stdin/stdout), EEPROM in a file, a virtual
+ * clock, and the bq769x0 model (host/bq769x0_sim.h) on the I2C bus.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/wdt.h>
+#include <util/delay.h>
+#include "mcu/watchdog.h"
+#include "mcu/usart.h"
+#include "mcu/pin.h"
+#include "protocol/console.h"
+#include "host/hal.h"
+#include "host/bq769x0_sim.h"
+
+#define PIN_LED_SCK MAKEPIN(B, 5, OUT)
+#define IDLE_POLL_MS 10
+#define EOF_PASSES 4    // loop passes after the last input byte, a command takes two
+
+namespace {
+
+void usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [-s] [-e file] [-v mV] [-i mA] [-t degC]\n"
+            "  -s       console on stdin/stdout instead of a pty, exits at EOF\n"
+            "  -e file  EEPROM image (default eeprom.bin)\n"
+            "  -v mV    simulated cell voltage (3700)\n"
+            "  -i mA    simulated pack current, + charge (0)\n"
+            "  -t degC  simulated thermistor temperature (25)\n", name);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    host::begin(argc, argv);
+    const char *eeprom = "eeprom.bin";
+    bool stdio = false;
+    uint16_t cell_mV = 3700;
+    int32_t current_mA = 0;
+    int16_t temp_dC = 250;
+    int opt;
+    while ((opt = getopt(argc, argv, "se:v:i:t:h")) != -1) {
+        switch (opt) {
+            case 's': stdio = true; break;
+            case 'e': eeprom = optarg; break;
+            case 'v': cell_mV = atoi(optarg); break;
+            case 'i': current_mA = atol(optarg); break;
+            case 't': temp_dC = atoi(optarg) * 10; break;
+            default: usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (!host::eepromOpen(eeprom)) { perror(eeprom); return 1; }
+    if (!(stdio ? host::uartOpenStdio() : host::uartOpenPty())) { perror("host: uart"); return 1; }
+    static host::Bq769x0Sim chip(BQ769X0_I2C_ADDR, protocol::BQ::cells, protocol::BQ::thermistors);
+    chip.setCells(cell_mV);
+    chip.setCurrent(current_mA);
+    for (uint8_t i = 0; i < protocol::BQ::thermistors; i++) chip.setTemperature(i, temp_dC);
+    host::i2cAttach(BQ769X0_I2C_ADDR, &chip);
+
+    // same sequence as main.cc, without the power-save sleep: the host
+    // idles in uartWait() and lets the virtual clock follow the wall clock
+    MCUSR = 0;
+    mcu::Watchdog::disable();
+    sei();
+    mcu::Pin led(PIN_LED_SCK);
+    led = 1;
+    mcu::Usart &ser = mcu::Usart::get();
+    protocol::Console proto; // Console load conf
+    _delay_ms(100);
+    led = 0;
+    _delay_ms(900);
+    mcu::Watchdog::enable(WDTO_4S);
+    proto.begin(); // init  bq769x0, print
+    uint8_t tail = EOF_PASSES;
+
+    while (1) {
+        const bool alert = host::i2cAlert();
+        const bool sampled = proto.update(led, alert);  // the edge is consumed, always serve it
+        if (ser.isActivity() || sampled || proto.Recv()) {
+            tail = EOF_PASSES;
+        }
+        mcu::Watchdog::reset();
+        // a long output goes on as the TX queue drains, not once per idle poll
+        if (!host::uartWait(proto.busy() ? 1 : IDLE_POLL_MS) && host::uartEof() && !tail--) break;
+        host::syncRealtime();
+    }
+    ser.flush();
+    return 0;
+}
@@ -0,0 +1,258 @@
+/* Modbus RTU test of the host build, see host/Makefile
+ *
+ * Starts the console next to this binary on its pty UART, switches it to
+ * the Modbus slave with the 'modbus' command and plays a master: reads of
+ * the cells, the live registers and the conf, single and multiple writes,
+ * the conf limits, a broadcast, the exceptions, frames to ignore, and the
+ * exit coil back to the text console. The CRC is computed bitwise here,
+ * independent of the firmware's table. Exits 1 if a check failed.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "protocol/modbus.h"
+
+#define SLAVE       1
+#define CELL_mV     3650
+#define REPLY_MS    500             // first byte of an answer
+#define QUIET_MS    50              // the answer is over
+#define TEXT_MS     300             // text output is over
+#define XSTR(x)     STR(x)
+#define STR(x)      #x
+
+namespace {
+
+int uart = -1;
+pid_t child = 0;
+unsigned failed = 0;
+
+uint16_t crc16(const uint8_t *p, size_t len) {
+    uint16_t crc = 0xFFFF;
+    while (len--) {
+        crc ^= *p++;
+        for (uint8_t b = 0; b < 8; b++) crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+    return crc;
+}
+
+// what the console sends until it is quiet for quiet_ms, first_ms for the first byte
+size_t receive(uint8_t *buf, const size_t size, const int first_ms, const int quiet_ms) {
+    size_t n = 0;
+    for (;;) {
+        struct pollfd p = { uart, POLLIN, 0 };
+        if (poll(&p, 1, n ? quiet_ms : first_ms) <= 0) return n;
+        uint8_t c;
+        if (read(uart, &c, 1) == 1 && n < size) buf[n++] = c;
+    }
+}
+
+void text(const char *s) {
+    if (write(uart, s, strlen(s)) < 0) perror("write");
+}
+
+bool text_until(const char *s, char *buf, const size_t size) {
+    const size_t n = receive((uint8_t *)buf, size - 1, REPLY_MS, TEXT_MS);
+    buf[n] = 0;
+    return strstr(buf, s) != nullptr;
+}
+
+// request with its CRC appended (unless bad_crc), the answer without it;
+// -1 if there was none, -2 if its CRC is wrong
+int transact(const uint8_t *req, const size_t len, uint8_t *ans, const bool bad_crc = false) {
+    uint8_t frame[300];
+    memcpy(frame, req, len);
+    const uint16_t crc = crc16(req, len) ^ (bad_crc ? 0x0101 : 0);
+    frame[len] = crc;
+    frame[len + 1] = crc >> 8;
+    if (write(uart, frame, len + 2) < 0) perror("write");
+    const size_t n = receive(ans, 300, REPLY_MS, QUIET_MS);
+    if (!n) return -1;
+    if (n < 4 || crc16(ans, n)) return -2;
+    return n - 2;
+}
+
+void check(const char *name, const bool ok, const char *detail = "") {
+    printf("%s %s%s%s\n", ok ? "PASS" : "FAIL", name, ok || !*detail ? "" : ": ", ok ? "" : detail);
+    if (!ok) failed++;
+}
+
+int read_regs(const uint8_t fc, const uint16_t start, const uint16_t n, uint16_t *v, uint8_t addr = SLAVE) {
+    const uint8_t req[] = { addr, fc, (uint8_t)(start >> 8), (uint8_t)start, (uint8_t)(n >> 8), (uint8_t)n };
+    uint8_t ans[300];
+    const int len = transact(req, sizeof(req), ans);
+    if (len < 0) return len;
+    if (ans[1] != fc) return -(int)ans[2] - 10;          // exception
+    if (len != 3 + 2 * n || ans[2] != 2 * n) return -3;
+    for (uint16_t i = 0; i < n; i++) v[i] = ans[3 + 2 * i] << 8 | ans[4 + 2 * i];
+    return n;
+}
+
+// the exception code of the answer, 0 for the echo of req, -1 without answer
+int write_reg(const uint16_t reg, const uint16_t value, const uint8_t fc = protocol::MB_WRITE_REGISTER, const uint8_t addr = SLAVE) {
+    const uint8_t req[] = { addr, fc, (uint8_t)(reg >> 8), (uint8_t)reg, (uint8_t)(value >> 8), (uint8_t)value };
+    uint8_t ans[300];
+    const int len = transact(req, sizeof(req), ans);
+    if (len < 0) return len;
+    if (ans[1] == (fc | 0x80)) return ans[2];
+    return len == 6 && !memcmp(ans, req, 6) ? 0 : -3;
+}
+
+void stop() {
+    if (child > 0) {
+        kill(child, SIGTERM);
+        waitpid(child, nullptr, 0);
+    }
+}
+
+// the console on its own pty, its device name comes on stderr
+bool start(const char *console, const char *eeprom) {
+    int err[2];
+    if (pipe(err) < 0) return false;
+    child = fork();
+    if (child < 0) return false;
+    if (!child) {
+        dup2(err[1], STDERR_FILENO);
+        close(err[0]);
+        execl(console, console, "-e", eeprom, "-v", XSTR(CELL_mV), (char *)nullptr);
+        perror(console);
+        _exit(127);
+    }
+    close(err[1]);
+    FILE *f = fdopen(err[0], "r");
+    char line[256];
+    const char *tag = "console on ";
+    while (fgets(line, sizeof(line), f)) {
+        const char *dev = strstr(line, tag);
+        if (!dev) continue;
+        dev += strlen(tag);
+        line[strcspn(line, "\r\n")] = 0;
+        uart = open(dev, O_RDWR | O_NOCTTY);
+        if (uart < 0) return false;
+        struct termios tio;
+        tcgetattr(uart, &tio);
+        cfmakeraw(&tio);
+        tcsetattr(uart, TCSANOW, &tio);
+        return true;
+    }
+    return false;
+}
+
+void usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [-c console]\n"
+            "  -c console  host console binary (console next to this one)\n", name);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    char console[512];
+    snprintf(console, sizeof(console), "%s/console", dirname(strdup(argv[0])));
+    int opt;
+    while ((opt = getopt(argc, argv, "c:h")) != -1) {
+        switch (opt) {
+            case 'c': snprintf(console, sizeof(console), "%s", optarg); break;
+            default: usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    char eeprom[] = "/tmp/modbustest-XXXXXX";
+    const int fd = mkstemp(eeprom);
+    if (fd < 0) { perror("mkstemp"); return 2; }
+    close(fd);
+    unlink(eeprom);                     // a fresh conf with the defaults
+    if (!start(console, eeprom)) { perror(console); stop(); return 2; }
+
+    using namespace protocol;
+    char buf[4096];
+    uint16_t v[MB_READ_MAX];
+    receive((uint8_t *)buf, sizeof(buf), 3000, TEXT_MS);       // boot dump
+    text("modbus 1\r");
+    check("modbus command", text_until("Modbus RTU slave 1", buf, sizeof(buf)));
+
+    // all cells in one request
+    int n = read_regs(MB_READ_INPUT, MB_IR_STATS + MB_SLOT * MB_STATS_cellVoltages, BQ::cells, v);
+    bool ok = n == BQ::cells;
+    for (int i = 0; ok && i < n; i++) ok = abs(v[i] - CELL_mV) <= 20;
+    snprintf(buf, sizeof(buf), "%d registers, first %u mV", n, n > 0 ? v[0] : 0);
+    check("FC04 cell voltages", ok, buf);
+
+    n = read_regs(MB_READ_INPUT, MB_IR_DATA + MB_SLOT * MB_DATA_connectedCells, 1, v);
+    check("FC04 connected cells", n == 1 && v[0] == BQ::cells);
+
+    n = read_regs(MB_READ_INPUT, MB_IR_LIVE, MB_LIVE_COUNT, v);
+    check("FC04 live SOC", n == MB_LIVE_COUNT && v[MB_LIVE_SOC] <= 10000);
+
+    // a 32 bit field and the gap after it read as one range
+    n = read_regs(MB_READ_INPUT, MB_IR_DATA + MB_SLOT * MB_DATA_batVoltage, 4, v);
+    snprintf(buf, sizeof(buf), "%d registers, %u %u %u %u", n, v[0], v[1], v[2], v[3]);
+    check("FC04 32 bit field and gap", n == 4 && abs((int)((((uint32_t)v[0] << 16) | v[1]) / BQ::cells) - CELL_mV) <= 20
+          && !v[2] && !v[3], buf);
+
+    const uint16_t ovp = MB_HR_CONF + MB_SLOT * Conf_Cell_OVP_mV;
+    n = read_regs(MB_READ_HOLDING, ovp, 1, v);
+    check("FC03 conf", n == 1 && v[0] == 4200);
+
+    check("FC06 write", write_reg(ovp, 4150) == 0);
+    n = read_regs(MB_READ_HOLDING, ovp, 1, v);
+    check("FC06 read back", n == 1 && v[0] == 4150);
+
+    const uint16_t capa = MB_HR_CONF + MB_SLOT * Conf_Batt_CapaNom_mAsec;
+    const uint8_t fc16[] = { SLAVE, MB_WRITE_REGISTERS, capa >> 8, capa & 0xFF, 0, 2, 4, 0x00, 0x0A, 0xFC, 0x80 };
+    uint8_t ans[300];
+    check("FC16 write", transact(fc16, sizeof(fc16), ans) == 6 && !memcmp(ans, fc16, 6));
+    n = read_regs(MB_READ_HOLDING, capa, 2, v);
+    check("FC16 read back", n == 2 && (((uint32_t)v[0] << 16) | v[1]) == 720000);
+    check("FC06 half of a 32 bit field", write_reg(capa + 1, 0) == MB_ILLEGAL_ADDRESS);
+
+    // limits of the conf table, nothing stored
+    check("FC06 out of range", write_reg(ovp, 0) == MB_ILLEGAL_VALUE);
+    const uint16_t shunt = MB_HR_CONF + MB_SLOT * Conf_RS_uOhm;
+    const uint8_t zero[] = { SLAVE, MB_WRITE_REGISTERS, shunt >> 8, shunt & 0xFF, 0, 2, 4, 0, 0, 0, 0 };
+    n = transact(zero, sizeof(zero), ans);
+    check("FC16 out of range", n == 3 && ans[1] == (MB_WRITE_REGISTERS | 0x80) && ans[2] == MB_ILLEGAL_VALUE);
+    n = read_regs(MB_READ_HOLDING, shunt, 2, v);
+    check("FC16 nothing stored", n == 2 && (((uint32_t)v[0] << 16) | v[1]) == 1000);
+
+    const uint16_t offsets = MB_HR_CONF + MB_SLOT * Conf_adcCellsOffset;
+    check("FC06 signed", write_reg(offsets, (uint16_t)-5) == 0);
+    n = read_regs(MB_READ_HOLDING, offsets, 1, v);
+    check("FC06 signed read back", n == 1 && v[0] == (uint16_t)-5);
+    write_reg(offsets, 0);
+
+    check("read only field", write_reg(MB_HR_CONF + MB_SLOT * Conf_ts, 1) == MB_ILLEGAL_ADDRESS);
+    check("byte field range", write_reg(MB_HR_CONF + MB_SLOT * Conf_Baud, 300) == MB_ILLEGAL_VALUE);
+    check("outside the map", read_regs(MB_READ_HOLDING, MB_HR_CONF + MB_SLOT * (LAST + 1), 1, v) == -10 - MB_ILLEGAL_ADDRESS);
+    check("quantity 0", read_regs(MB_READ_INPUT, MB_IR_LIVE, 0, v) == -10 - MB_ILLEGAL_VALUE);
+    check("quantity MB_READ_MAX", read_regs(MB_READ_INPUT, MB_IR_STATS, MB_READ_MAX, v) == MB_READ_MAX);
+    check("quantity above MB_READ_MAX", read_regs(MB_READ_INPUT, MB_IR_STATS, MB_READ_MAX + 1, v) == -10 - MB_ILLEGAL_VALUE);
+    check("unknown function", write_reg(0, 0, 0x2B) == MB_ILLEGAL_FUNCTION);
+
+    const uint8_t fc03[] = { SLAVE, MB_READ_HOLDING, ovp >> 8, ovp & 0xFF, 0, 1 };
+    check("bad CRC ignored", transact(fc03, sizeof(fc03), ans, true) == -1);
+    check("other slave ignored", read_regs(MB_READ_HOLDING, ovp, 1, v, SLAVE + 1) == -1);
+    check("broadcast unanswered", write_reg(ovp, 4100, MB_WRITE_REGISTER, 0) == -1);
+    n = read_regs(MB_READ_HOLDING, ovp, 1, v);
+    check("broadcast written", n == 1 && v[0] == 4100);
+
+    // the echo, then the prompt of the text console
+    const uint8_t exit[] = { SLAVE, MB_WRITE_COIL, 0, MB_COIL_EXIT, 0xFF, 0x00 };
+    n = transact(exit, sizeof(exit), ans);
+    check("exit coil", n != -1 && !memcmp(ans, exit, 6) && !crc16(ans, 8));
+    text("mbaddr\r");
+    check("text console back", text_until("mbaddr=0", buf, sizeof(buf)), buf);
+
+    stop();
+    unlink(eeprom);
+    printf("%s, %u failed\n", failed ? "FAIL" : "PASS", failed);
+    return failed ? 1 : 0;
+}
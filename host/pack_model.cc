@@ -0,0 +1,186 @@
+#include <math.h>
+
+#include "host/pack_model.h"
+#include "host/bq769x0_sim.h"
+
+namespace {
+
+// Li-ion NMC, not the firmware's table: an estimator that only works on
+// its own curve is not measured by the benchmark
+const uint16_t ocvNMC[PACK_OCV_POINTS] = {
+    3000, 3400, 3520, 3590, 3630, 3660, 3685, 3705, 3725, 3745, 3770,
+    3795, 3825, 3855, 3885, 3915, 3950, 3990, 4040, 4100, 4185
+};
+
+// xorshift32, uniform in -1..1
+class Spread {
+public:
+    explicit Spread(const uint32_t seed): s_(seed ? seed : 1) {}
+    double next() {
+        s_ ^= s_ << 13;
+        s_ ^= s_ >> 17;
+        s_ ^= s_ << 5;
+        return s_ / 2147483647.5 - 1.0;
+    }
+private:
+    uint32_t s_;
+};
+
+}  // namespace
+
+namespace host {
+
+//----------------------------------------------------------------------------
+// loads
+
+bool ConstantLoad::done(const PackModel &pack) {
+    if (!stop_mV_) return false;
+    if (mA_ < 0) return pack.minCell_mV() <= stop_mV_;
+    return pack.maxCell_mV() >= stop_mV_;
+}
+
+PulsedLoad::PulsedLoad(const int32_t base_mA, const int32_t peak_mA, const uint32_t period_ms, const uint32_t on_ms, const uint16_t stop_mV):
+    base_mA_(base_mA), peak_mA_(peak_mA), period_ms_(period_ms), on_ms_(on_ms), stop_mV_(stop_mV)
+{}
+
+int32_t PulsedLoad::current_mA(const PackModel &, const uint64_t now_us) {
+    return (now_us / 1000) % period_ms_ < on_ms_ ? peak_mA_ : base_mA_;
+}
+
+bool PulsedLoad::done(const PackModel &pack) { return stop_mV_ && pack.minCell_mV() <= stop_mV_; }
+
+DriveCycle::DriveCycle(const int8_t *pct, const uint16_t count, const uint32_t step_ms, const int32_t peak_mA, const uint16_t stop_mV):
+    pct_(pct), count_(count), step_ms_(step_ms), peak_mA_(peak_mA), stop_mV_(stop_mV)
+{}
+
+int32_t DriveCycle::current_mA(const PackModel &, const uint64_t now_us) {
+    return (int32_t)pct_[(now_us / 1000 / step_ms_) % count_] * peak_mA_ / 100;
+}
+
+bool DriveCycle::done(const PackModel &pack) { return stop_mV_ && pack.minCell_mV() <= stop_mV_; }
+
+int32_t CcCvCharger::current_mA(const PackModel &pack, const uint64_t) {
+    double mA = mA_;
+    for (uint8_t c = 0; c < pack.cells(); c++) {
+        // mV / mOhm = A
+        const double room = (cv_mV_ - pack.ocv_mV(c) - pack.rc_mV(c)) / pack.r0_mOhm(c) * 1000.0;
+        if (room < mA) mA = room;
+    }
+    last_ = mA > 0 ? (int32_t)mA : 0;
+    return last_;
+}
+
+//----------------------------------------------------------------------------
+
+PackModel::PackModel(const PackConfig &cfg, const uint8_t cells, const uint8_t thermistors, const uint32_t step_ms):
+    charge_mAs(0), bleed_mAs(0), heat_J(0),
+    cells_(cells > 15 ? 15 : cells), thermistors_(thermistors), step_us_(step_ms * 1000UL),
+    ocv_(cfg.ocv ? cfg.ocv : ocvNMC),
+    heatCapacity_(cfg.heatCapacity_J_K), cooling_(cfg.cooling_W_K), ambient_C_(cfg.ambient_C),
+    temp_C_(cfg.ambient_C), flowing_(0), load_(nullptr), last_(0), next_(0)
+{
+    Spread rnd(cfg.seed);
+    for (uint8_t c = 0; c < 15; c++) {
+        cap_[c] = cfg.capacity_mAh * 3600.0 * (1.0 + cfg.capacity_spread * rnd.next());
+        const double r = 1.0 + cfg.r_spread * rnd.next();
+        r0_[c] = cfg.r0_mOhm * r;
+        r1_[c] = cfg.r1_mOhm * r;
+        tau_[c] = cfg.tau_s;
+        leak_[c] = cap_[c] * cfg.selfDischarge_pct / 100.0 / (30.0 * 86400.0) * (1.0 + cfg.selfDischarge_spread * rnd.next());
+        double soc = cfg.soc + cfg.soc_spread * rnd.next();
+        if (soc < 0) soc = 0;
+        if (soc > 1) soc = 1;
+        q_[c] = cap_[c] * soc;
+        vrc_[c] = 0;
+        bled_[c] = 0;
+        v_[c] = ocv_mV(c);
+    }
+}
+
+double PackModel::ocv_mV(const uint8_t c) const {
+    double x = soc(c) * (PACK_OCV_POINTS - 1);
+    if (x <= 0) return ocv_[0];
+    if (x >= PACK_OCV_POINTS - 1) return ocv_[PACK_OCV_POINTS - 1];
+    const uint8_t i = (uint8_t)x;
+    x -= i;
+    return ocv_[i] + (ocv_[i + 1] - ocv_[i]) * x;
+}
+
+double PackModel::soc() const {
+    double q = 0, cap = 0;
+    for (uint8_t c = 0; c < cells_; c++) {
+        q += q_[c];
+        cap += cap_[c];
+    }
+    return q / cap;
+}
+
+double PackModel::socSpread() const {
+    double lo = 2, hi = -1;
+    for (uint8_t c = 0; c < cells_; c++) {
+        if (soc(c) < lo) lo = soc(c);
+        if (soc(c) > hi) hi = soc(c);
+    }
+    return hi - lo;
+}
+
+double PackModel::minCell_mV() const {
+    double v = v_[0];
+    for (uint8_t c = 1; c < cells_; c++) if (v_[c] < v) v = v_[c];
+    return v;
+}
+
+double PackModel::maxCell_mV() const {
+    double v = v_[0];
+    for (uint8_t c = 1; c < cells_; c++) if (v_[c] > v) v = v_[c];
+    return v;
+}
+
+double PackModel::ocvSpread_mV() const {
+    double lo = ocv_mV(0), hi = lo;
+    for (uint8_t c = 1; c < cells_; c++) {
+        const double v = ocv_mV(c);
+        if (v < lo) lo = v;
+        if (v > hi) hi = v;
+    }
+    return hi - lo;
+}
+
+void PackModel::update(Bq769x0Sim &chip, const uint64_t now_us) {
+    // the step that ended: flowing_ went through every cell, the bleed
+    // only through its own
+    const double dt = (now_us - last_) / 1e6;
+    const double i = flowing_;
+    double loss_W = 0;
+    for (uint8_t c = 0; c < cells_; c++) {
+        const double bleed = chip.bleed_mAs(c);
+        q_[c] += (i - leak_[c]) * dt - (bleed - bled_[c]);
+        if (q_[c] < 0) q_[c] = 0;
+        if (q_[c] > cap_[c]) q_[c] = cap_[c];   // charge past full is side reactions
+        bleed_mAs += bleed - bled_[c];
+        bled_[c] = bleed;
+        const double vrc0 = vrc_[c];
+        const double a = exp(-dt / tau_[c]);
+        vrc_[c] = vrc0 * a + i * r1_[c] / 1000.0 * (1.0 - a);
+        // I^2*R0 plus what R1 took over the step, mA * mV = uW
+        loss_W += (i * i * r0_[c] / 1000.0 + i * (vrc0 + vrc_[c]) / 2.0) * 1e-6;
+    }
+    charge_mAs += i * dt;
+    heat_J += loss_W * dt;
+    const double eq = ambient_C_ + loss_W / cooling_;
+    temp_C_ = eq + (temp_C_ - eq) * exp(-dt * cooling_ / heatCapacity_);
+    last_ = now_us;
+
+    // the next step: ask, see what the FETs let through
+    chip.setCurrent(load_ ? load_->current_mA(*this, now_us) : 0);
+    flowing_ = chip.current();
+    for (uint8_t c = 0; c < cells_; c++) {
+        v_[c] = ocv_mV(c) + flowing_ * r0_[c] / 1000.0 + vrc_[c];
+        chip.setCell(c, v_[c] < 0 ? 0 : (uint16_t)(v_[c] + 0.5));
+    }
+    const int16_t dC = (int16_t)lround(temp_C_ * 10);
+    for (uint8_t t = 0; t < thermistors_; t++) chip.setTemperature(t, dC);
+    next_ = now_us + step_us_;
+}
+
+}  // namespace host
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <stdint.h>
+#include "host/scenario.h"
+
+namespace host {
+
+// Cells of the pack as drawn from the spread, seeded: the same config is
+// the same pack on every run and every machine
+struct PackConfig {
+    uint32_t        capacity_mAh;
+    float           capacity_spread;        // relative, uniform +-
+    float           r0_mOhm;                // ohmic
+    float           r1_mOhm;                // one RC pair for the polarisation
+    float           tau_s;
+    float           r_spread;               // relative, R0 and R1 together
+    float           selfDischarge_pct;      // per 30 days
+    float           selfDischarge_spread;   // relative
+    float           soc;                    // initial, 0..1
+    float           soc_spread;             // absolute, uniform +-
+    float           heatCapacity_J_K;       // whole pack, lumped
+    float           cooling_W_K;            // to ambient
+    float           ambient_C;
+    const uint16_t  *ocv;                   // PACK_OCV_POINTS mV, SOC 0 % first, nullptr for NMC
+    uint32_t        seed;
+};
+
+#define PACK_OCV_POINTS 21                  // 5 % steps
+
+class PackModel;
+
+// What the pack is connected to: the current it asks for, + is charge.
+// Whether it flows is up to the FETs.
+class Load {
+public:
+    virtual ~Load() {}
+    virtual int32_t current_mA(const PackModel &pack, const uint64_t now_us) = 0;
+    virtual bool done(const PackModel &) { return false; }
+};
+
+// Constant current until a cell reaches stop_mV (under load), 0 runs forever
+class ConstantLoad : public Load {
+public:
+    ConstantLoad(const int32_t mA, const uint16_t stop_mV = 0): mA_(mA), stop_mV_(stop_mV) {}
+    int32_t current_mA(const PackModel &, const uint64_t) override { return mA_; }
+    bool done(const PackModel &pack) override;
+private:
+    const int32_t   mA_;
+    const uint16_t  stop_mV_;
+};
+
+// base_mA with peak_mA for on_ms out of every period_ms
+class PulsedLoad : public Load {
+public:
+    PulsedLoad(const int32_t base_mA, const int32_t peak_mA, const uint32_t period_ms, const uint32_t on_ms, const uint16_t stop_mV = 0);
+    int32_t current_mA(const PackModel &pack, const uint64_t now_us) override;
+    bool done(const PackModel &pack) override;
+private:
+    const int32_t   base_mA_;
+    const int32_t   peak_mA_;
+    const uint32_t  period_ms_;
+    const uint32_t  on_ms_;
+    const uint16_t  stop_mV_;
+};
+
+// A speed trace repeated end to end: one sample per step_ms in percent of
+// peak_mA, negative is traction, positive regenerative braking
+class DriveCycle : public Load {
+public:
+    DriveCycle(const int8_t *pct, const uint16_t count, const uint32_t step_ms, const int32_t peak_mA, const uint16_t stop_mV = 0);
+    int32_t current_mA(const PackModel &pack, const uint64_t now_us) override;
+    bool done(const PackModel &pack) override;
+private:
+    const int8_t    *pct_;
+    const uint16_t  count_;
+    const uint32_t  step_ms_;
+    const int32_t   peak_mA_;
+    const uint16_t  stop_mV_;
+};
+
+// CC until the highest cell reaches cv_mV, then the current that keeps it
+// there, done below cutoff_mA
+class CcCvCharger : public Load {
+public:
+    CcCvCharger(const int32_t mA, const uint16_t cv_mV, const int32_t cutoff_mA):
+        mA_(mA), cv_mV_(cv_mV), cutoff_mA_(cutoff_mA), last_(mA) {}
+    int32_t current_mA(const PackModel &pack, const uint64_t now_us) override;
+    bool done(const PackModel &) override { return last_ < cutoff_mA_; }
+private:
+    const int32_t   mA_;
+    const uint16_t  cv_mV_;
+    const int32_t   cutoff_mA_;
+    int32_t         last_;
+};
+
+// Equivalent circuit per cell: OCV(SOC) + R0 + one R1||C1 pair, its own
+// capacity and self-discharge, and one lumped thermal mass heated by the
+// cell losses. The current is what the simulator lets through its FETs,
+// CELLBAL bleed comes off the cells it is drawn from. Steps every step_ms
+// (exact for a constant current over the step), the chip sees terminal
+// voltages and the pack temperature on every TSx input.
+class PackModel : public Plant {
+public:
+    PackModel(const PackConfig &cfg, const uint8_t cells, const uint8_t thermistors, const uint32_t step_ms = 100);
+    void update(Bq769x0Sim &chip, const uint64_t now_us) override;
+    uint64_t nextEvent() override { return next_; }
+    void setLoad(Load *load) { load_ = load; }
+    void setAmbient(const float degC) { ambient_C_ = degC; }
+
+    uint8_t cells() const { return cells_; }
+    double soc(const uint8_t c) const { return q_[c] / cap_[c]; }
+    double soc() const;                     // charge over capacity of the pack
+    double socSpread() const;               // max - min
+    double ocv_mV(const uint8_t c) const;
+    double terminal_mV(const uint8_t c) const { return v_[c]; }
+    double minCell_mV() const;
+    double maxCell_mV() const;
+    double ocvSpread_mV() const;
+    double r0_mOhm(const uint8_t c) const { return r0_[c]; }
+    double rc_mV(const uint8_t c) const { return vrc_[c]; }
+    double temperature() const { return temp_C_; }
+    int32_t flowing() const { return flowing_; }
+    double charge_mAs;                      // through the terminals, + is charge
+    double bleed_mAs;                       // all cells
+    double heat_J;
+
+private:
+    const uint8_t   cells_;
+    const uint8_t   thermistors_;
+    const uint32_t  step_us_;
+    const uint16_t  *ocv_;
+    const double    heatCapacity_;
+    const double    cooling_;
+    double          ambient_C_;
+    double          cap_[15];               // mAs
+    double          q_[15];                 // mAs
+    double          r0_[15];                // mOhm
+    double          r1_[15];
+    double          tau_[15];               // s
+    double          leak_[15];              // mA
+    double          vrc_[15];               // mV
+    double          v_[15];                 // mV, terminal
+    double          bled_[15];              // CELLBAL bleed seen so far, mAs
+    double          temp_C_;
+    int32_t         flowing_;
+    Load            *load_;
+    uint64_t        last_;
+    uint64_t        next_;
+};
+
+}  // namespace host
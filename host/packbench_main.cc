@@ -0,0 +1,325 @@
+/* Pack benchmark of the host build, see host/Makefile
+ *
+ * Runs the console firmware against the bq769x0 model wired to an
+ * equivalent-circuit pack (host/pack_model.h) and reports what matters to
+ * the driver's SOC, balancing and protection code: SOC error against the
+ * model's charge, time for the balancer to bring the cells together and
+ * the delay from a fault condition to the FET opening. Every case starts
+ * a fresh firmware and pack in its own process, on the virtual clock.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/wdt.h>
+#include "mcu/watchdog.h"
+#include "mcu/pin.h"
+#include "mcu/usart.h"
+#include "protocol/console.h"
+#include "host/hal.h"
+#include "host/bq769x0_sim.h"
+#include "host/pack_model.h"
+#include "host/scenario.h"
+
+#define PIN_LED_SCK MAKEPIN(B, 5, OUT)
+
+// protection settings the cases are built around, set explicitly so a
+// change of the console defaults does not silently change the benchmark
+#define OVP_mV      4200
+#define UVP_mV      2850
+#define CHG_OCD_mA  5500
+#define TEMP_CHG_MAX_dC 500
+#define XSTR(x)     STR(x)
+#define STR(x)      #x
+
+namespace {
+
+// 5 Ah cells, a little more spread than a matched pack
+const host::PackConfig pack5Ah = {
+    5000, 0.03f,            // mAh
+    20.0f, 15.0f, 40.0f, 0.15f,
+    3.0f, 0.5f,             // %/30 days
+    0.5f, 0.01f,            // SOC
+    700.0f, 1.5f, 25.0f,    // J/K, W/K, degC
+    nullptr,
+    1
+};
+
+// urban stop and go, 1 s per sample, % of peak: mean about 20 % traction
+const int8_t urban[] = {
+      0,   0, -20, -45, -70, -90,-100, -85, -60, -40,
+    -30, -30, -28, -30, -32, -30, -25, -10,  10,  25,
+     30,  20,  10,   0,   0,   0, -30, -60, -80, -75,
+    -50, -35, -35, -35, -35, -35, -35, -30, -20,   0,
+     15,  25,  15,   5,   0,   0,   0, -15, -40, -55,
+    -50, -40, -30, -20, -10,   5,  15,  10,   0,   0,
+};
+
+uint32_t quantum = 10000;
+uint32_t seed = 1;
+bool trace = false;
+
+double wall() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//----------------------------------------------------------------------------
+
+// firmware, chip and pack as the scenario runner wires them
+class Rig {
+public:
+    explicit Rig(host::PackConfig cfg) {
+        cfg.seed = seed;
+        host::uartOpenOutput(-1);
+        chip = new host::Bq769x0Sim(BQ769X0_I2C_ADDR, protocol::BQ::cells, protocol::BQ::thermistors);
+        host::i2cAttach(BQ769X0_I2C_ADDR, chip);
+        pack = new host::PackModel(cfg, protocol::BQ::cells, protocol::BQ::thermistors);
+        pack->update(*chip, host::micros());
+        sei();
+        led = new mcu::Pin(PIN_LED_SCK);
+        console = new protocol::Console;
+        mcu::Watchdog::enable(WDTO_4S);
+        console->begin();
+        runner = new host::Runner(*chip, *console, *led, quantum);
+        if (trace) runner->trace(stdout);
+        char line[40];
+        snprintf(line, sizeof(line), "nominalcapacity %u\n", (unsigned)cfg.capacity_mAh);
+        runner->command(line);
+        // the reset in Console::begin() came before the first conversion:
+        // restart the counter from OCV, at the new capacity
+        run(1000);
+        runner->command("ocv 0\n");
+        runner->command("overvoltagemv " XSTR(OVP_mV) "\n");
+        runner->command("undervoltagemv " XSTR(UVP_mV) "\n");
+        runner->command("maxchargecurrent " XSTR(CHG_OCD_mA) "\n");
+        runner->command("celltempchargemax " XSTR(TEMP_CHG_MAX_dC) "\n");
+        runner->command("charging 1\n");
+        runner->command("discharging 1\n");
+        runner->command("autobalancing 1\n");
+        runner->command("balancecharging 1\n");
+    }
+    host::Bq769x0Sim    *chip;
+    host::PackModel     *pack;
+    mcu::Pin            *led;
+    protocol::Console   *console;
+    host::Runner        *runner;
+    void run(const uint32_t ms) { runner->run(*pack, host::micros() + ms * 1000ULL); }
+    // switches the load at once, not at the next pack step
+    void load(host::Load *l) {
+        pack->setLoad(l);
+        pack->update(*chip, host::micros());
+    }
+    // what the console prints as SOC, in %
+    double soc() {
+        static char buf[4096];
+        host::uartCapture(buf, sizeof(buf));
+        runner->command("print\n");
+        mcu::Usart::get().flush();
+        host::uartCapture(nullptr, 0);
+        const char *p = strstr(buf, "SOC: ");
+        return p ? atof(p + 5) : NAN;
+    }
+    void summary() {
+        printf("  %u decisions, hash %08x\n", runner->decisions, runner->hash);
+    }
+};
+
+//----------------------------------------------------------------------------
+// SOC: the drive cycle down to 3.3 V, rest, CC-CV back up, rest, against
+// the model's charge every minute
+
+struct SocError {
+    double sum2;
+    double max;
+    uint32_t n;
+    void add(const double e) {
+        sum2 += e * e;
+        if (fabs(e) > max) max = fabs(e);
+        n++;
+    }
+};
+
+void stage(Rig &rig, host::Load &l, const uint32_t max_s, SocError &err) {
+    rig.load(&l);
+    for (uint32_t s = 0; s < max_s && !l.done(*rig.pack); s += 60) {
+        rig.run(60000);
+        err.add(rig.soc() - rig.pack->soc() * 100.0);
+    }
+}
+
+void caseSoc(const uint8_t mode) {
+    host::PackConfig cfg = pack5Ah;
+    cfg.soc = 0.9f;
+    cfg.soc_spread = 0.02f;
+    Rig rig(cfg);
+    rig.runner->command(mode ? "socmode 1\n" : "socmode 0\n");
+    rig.run(5000);
+    const double start = rig.soc() - rig.pack->soc() * 100.0;
+    SocError err = { 0, 0, 0 };
+    host::DriveCycle drive(urban, sizeof(urban), 1000, 10000, 3300);
+    host::ConstantLoad rest(0);
+    host::CcCvCharger charger(2500, 4150, 100);
+    stage(rig, drive, 6 * 3600, err);
+    const double low = rig.pack->soc() * 100.0;
+    stage(rig, rest, 3600, err);
+    stage(rig, charger, 5 * 3600, err);
+    stage(rig, rest, 3600, err);
+    printf("soc %-7s start %+6.2f %%  rms %5.2f %%  max %5.2f %%  end %+6.2f %%  (true 90 %% -> %.0f %% -> %.0f %%, %u samples)\n",
+           mode ? "EKF" : "coulomb", start, sqrt(err.sum2 / err.n), err.max,
+           rig.soc() - rig.pack->soc() * 100.0, low, rig.pack->soc() * 100.0, err.n);
+    rig.summary();
+}
+
+//----------------------------------------------------------------------------
+// balancing: a pack 5 % apart charged and left to rest, until the
+// balancer has been idle for an hour
+
+void caseBalance(const uint8_t) {
+    host::PackConfig cfg = pack5Ah;
+    cfg.soc = 0.6f;
+    cfg.soc_spread = 0.05f;
+    Rig rig(cfg);
+    const double spread0 = rig.pack->socSpread() * 100.0;
+    const uint64_t t0 = host::micros();
+    host::CcCvCharger charger(2500, 4150, 100);
+    host::ConstantLoad rest(0);
+    rig.load(&charger);
+    uint64_t under2 = 0, stopped = 0;
+    for (uint32_t s = 0; s < 48 * 3600; s += 60) {
+        if (charger.done(*rig.pack)) rig.load(&rest);
+        rig.run(60000);
+        if (!under2 && rig.pack->socSpread() < 0.02) under2 = host::micros();
+        const uint8_t *bal = &rig.chip->reg[CELLBAL1];
+        if (bal[0] | bal[1] | bal[2]) continue;
+        stopped = rig.runner->changed[host::Runner::CHANGED_CELLBAL1];
+        for (uint8_t i = 1; i < 3; i++) {
+            if (rig.runner->changed[host::Runner::CHANGED_CELLBAL1 + i] > stopped) stopped = rig.runner->changed[host::Runner::CHANGED_CELLBAL1 + i];
+        }
+        if (charger.done(*rig.pack) && host::micros() - stopped > 3600000000ULL) break;
+    }
+    printf("balance spread %.1f %% -> %.2f %% (OCV %.1f mV), bleed %.0f mAh, ",
+           spread0, rig.pack->socSpread() * 100.0, rig.pack->ocvSpread_mV(), rig.pack->bleed_mAs / 3600.0);
+    if (under2) printf("under 2 %% after %.2f h, ", (under2 - t0) / 3.6e9);
+    if (stopped > t0 && stopped + 3600000000ULL <= host::micros()) printf("done after %.2f h\n", (stopped - t0) / 3.6e9);
+    else printf("still balancing after 48 h\n");
+    rig.summary();
+}
+
+//----------------------------------------------------------------------------
+// protection: delay from the condition to the FET opening
+
+enum Fault { SCD, OCD, CHG_OCD, OV, UV, CHG_TEMP };
+
+void caseProtect(const uint8_t f) {
+    static const char *const name[] = { "SCD 120 A", "OCD 50 A", "CHG OCD 8 A", "OV at 5 A", "UV at 10 A", "CHG at 60 degC" };
+    host::PackConfig cfg = pack5Ah;
+    if (f == OV) cfg.soc = 0.97f;
+    if (f == UV) cfg.soc = 0.05f;
+    Rig rig(cfg);
+    rig.run(5000);
+    const bool charge = f == CHG_OCD || f == OV || f == CHG_TEMP;
+    host::ConstantLoad scd(-120000), ocd(-50000), chgocd(8000), ov(5000), uv(-10000), warm(1000);
+    host::Load *const loads[] = { &scd, &ocd, &chgocd, &ov, &uv, &warm };
+    if (f == CHG_TEMP) rig.pack->setAmbient(60);
+    rig.load(loads[f]);
+    uint64_t onset = 0;
+    if (f == SCD || f == OCD || f == CHG_OCD) onset = host::micros();
+    const uint64_t t0 = host::micros();
+    const uint8_t fet = charge ? 0x01 : 0x02;      // CHG_ON, DSG_ON in SYS_CTRL2
+    uint64_t off = 0;
+    while (host::micros() - t0 < 3600000000ULL) {
+        if (!onset) {
+            if ((f == OV && rig.pack->maxCell_mV() > OVP_mV) ||
+                (f == UV && rig.pack->minCell_mV() < UVP_mV) ||
+                (f == CHG_TEMP && rig.pack->temperature() * 10 > TEMP_CHG_MAX_dC)) onset = host::micros();
+        }
+        // the runner saw the FET open, at the exact event time
+        if (!off && !(rig.chip->reg[SYS_CTRL2] & fet) && rig.runner->changed[host::Runner::CHANGED_FET] >= t0)
+            off = rig.runner->changed[host::Runner::CHANGED_FET];
+        // an early trip still waits for the condition, to say how early
+        if (off && onset) break;
+        if ((off && host::micros() - off > 60000000ULL) || (onset && host::micros() - onset > 60000000ULL)) break;
+        rig.run(100);
+    }
+    printf("protect %-15s ", name[f]);
+    if (!off) printf("FET still on\n");
+    else if (!onset) printf("FET off after %.1f s, condition not reached\n", (off - t0) / 1e6);
+    else if (off < onset) printf("FET off %9.3f ms before the condition\n", (onset - off) / 1e3);
+    else printf("FET off after %9.3f ms\n", (off - onset) / 1e3);
+    rig.summary();
+}
+
+//----------------------------------------------------------------------------
+
+struct Case {
+    const char  *name;
+    void        (*run)(const uint8_t);
+    uint8_t     arg;
+};
+
+const Case cases[] = {
+    { "soc",        caseSoc,        0 },
+    { "soc",        caseSoc,        1 },
+    { "balance",    caseBalance,    0 },
+    { "protect",    caseProtect,    SCD },
+    { "protect",    caseProtect,    OCD },
+    { "protect",    caseProtect,    CHG_OCD },
+    { "protect",    caseProtect,    OV },
+    { "protect",    caseProtect,    UV },
+    { "protect",    caseProtect,    CHG_TEMP },
+};
+
+void usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [-c case] [-s seed] [-q us] [-T]\n"
+            "  -c case   soc, balance or protect (all)\n"
+            "  -s seed   cell spread of the pack (1)\n"
+            "  -q us     longest step of the virtual clock between events (10000)\n"
+            "  -T        print the decision logs\n", name);
+}
+
+// every run of a case in a child, from the same pristine process
+void fork_run(const Case &c) {
+    fflush(stdout);
+    const pid_t pid = fork();
+    if (pid == 0) {
+        c.run(c.arg);
+        fflush(stdout);
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    host::begin(argc, argv);
+    const char *only = nullptr;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:s:q:Th")) != -1) {
+        switch (opt) {
+            case 'c': only = optarg; break;
+            case 's': seed = atol(optarg); break;
+            case 'q': quantum = atol(optarg); break;
+            case 'T': trace = true; break;
+            default: usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    printf("%u cells, 5 Ah, seed %u\n", protocol::BQ::cells, seed);
+    const double t0 = wall();
+    for (const Case &c : cases) {
+        if (only && strcmp(only, c.name)) continue;
+        fork_run(c);
+    }
+    printf("%.2f s\n", wall() - t0);
+    return 0;
+}
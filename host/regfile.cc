@@ -0,0 +1,43 @@
+#include <string.h>
+
+#include "host/regfile.h"
+#include "utils/crc.h"
+
+namespace host {
+
+RegisterFile::RegisterFile(const uint8_t addr, const bool crc):
+    crcErrors(0), addr_(addr), crc_(crc), ptr_(0)
+{
+    memset(reg, 0, sizeof(reg));
+}
+
+bool RegisterFile::transfer(const uint8_t *wdata, const uint8_t wlen, uint8_t *rdata, const uint8_t rlen) {
+    if (wlen) {
+        ptr_ = wdata[0];
+        uint8_t crc = utils::crc8_update(utils::crc8_update(0, addr_ << 1), ptr_);
+        for (uint8_t i = 1; i < wlen; ) {
+            const uint8_t value = wdata[i++];
+            if (crc_) {
+                crc = utils::crc8_update(crc, value);
+                if (i >= wlen || wdata[i++] != crc) {
+                    crcErrors++;
+                    break;
+                }
+                crc = 0;
+            }
+            writeReg(ptr_++, value);
+        }
+    }
+    uint8_t crc = utils::crc8_update(0, (addr_ << 1) | 1);
+    for (uint8_t i = 0; i < rlen; ) {
+        const uint8_t value = readReg(ptr_++);
+        rdata[i++] = value;
+        if (crc_ && i < rlen) {
+            rdata[i++] = utils::crc8_update(crc, value);
+            crc = 0;
+        }
+    }
+    return true;
+}
+
+}  // namespace host
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+#include "host/hal.h"
+
+namespace host {
+
+// 256 byte register file behind the bq769x0 I2C framing: a write is the
+// register address followed by data bytes, a read returns data from the
+// auto-incremented address. With CRC every data byte carries a CRC-8, the
+// first one also covering the slave address (and register on writes).
+// Derived models hook readReg()/writeReg(); the plain file is enough for
+// the driver to come up.
+class RegisterFile : public I2CDevice {
+public:
+    explicit RegisterFile(const uint8_t addr, const bool crc = true);
+    bool transfer(const uint8_t *wdata, const uint8_t wlen, uint8_t *rdata, const uint8_t rlen) override;
+    uint8_t reg[256];
+    uint16_t crcErrors;         // writes ignored because of a bad CRC
+protected:
+    virtual uint8_t readReg(const uint8_t address) { return reg[address]; }
+    virtual void writeReg(const uint8_t address, const uint8_t value) { reg[address] = value; }
+private:
+    const uint8_t addr_;
+    const bool crc_;
+    uint8_t ptr_;
+};
+
+}  // namespace host
@@ -0,0 +1,113 @@
+#include <string.h>
+
+#include "host/scenario.h"
+#include "host/hal.h"
+#include "devices/bq769x0_registers.h"
+#include "mcu/watchdog.h"
+
+#define FNV_OFFSET  2166136261UL
+#define FNV_PRIME   16777619UL
+#define COMMAND_STEP_US 1000        // about 11 bytes at 115200
+
+namespace host {
+
+//----------------------------------------------------------------------------
+
+RampPlant::RampPlant(const Phase *phases, const uint8_t count, const int16_t *imbalance_mV, const float mV_per_As):
+    phases_(phases), count_(count), imbalance_(imbalance_mV), mV_per_As_(mV_per_As),
+    phase_(0), start_(0), next_(0)
+{}
+
+void RampPlant::update(Bq769x0Sim &chip, const uint64_t now_us) {
+    while (phase_ < count_ && now_us >= start_ + phases_[phase_].seconds * 1000000ULL) {
+        start_ += phases_[phase_].seconds * 1000000ULL;
+        phase_++;
+    }
+    if (phase_ >= count_) {
+        chip.setCurrent(0);
+        next_ = UINT64_MAX;
+        return;
+    }
+    const Phase &p = phases_[phase_];
+    const float f = (float)(now_us - start_) / (p.seconds * 1e6f);
+    const float base = p.from_mV + (p.to_mV - p.from_mV) * f;
+    for (uint8_t c = 0; c < protocol::BQ::cells; c++) {
+        const float mV = base + imbalance_[c] - chip.bleed_mAs(c) / 1000.0f * mV_per_As_;
+        chip.setCell(c, (uint16_t)(mV + 0.5f));
+    }
+    chip.setCurrent(p.current_mA);
+    // the ramp moves 1 mV at a time at most once a second
+    next_ = now_us + 1000000ULL;
+}
+
+//----------------------------------------------------------------------------
+
+Runner::Runner(Bq769x0Sim &chip, protocol::Console &console, mcu::Pin &led, const uint32_t quantum_us):
+    decisions(0), hash(FNV_OFFSET), passes(0),
+    chip_(chip), console_(console), led_(led), quantum_(quantum_us), trace_(nullptr)
+{
+    memset(state_, 0, sizeof(state_));
+    memset(changed, 0, sizeof(changed));
+}
+
+// one iteration of the firmware main loop (main.cc)
+void Runner::pass() {
+    const bool alert = host::i2cAlert();
+    console_.update(led_, alert);
+    console_.Recv();
+    mcu::Watchdog::reset();
+    passes++;
+}
+
+void Runner::observe() {
+    chip_.step();                       // trips that fell due since the last access
+    uint8_t s[5];
+    s[0] = chip_.reg[SYS_CTRL2] & 0x03;
+    s[1] = chip_.reg[CELLBAL1];
+    s[2] = chip_.reg[CELLBAL2];
+    s[3] = chip_.reg[CELLBAL3];
+    s[4] = chip_.reg[SYS_STAT] & STAT_FLAGS;
+    static const char *const what[] = { "FET", "CELLBAL1", "CELLBAL2", "CELLBAL3", "SYS_STAT" };
+    const uint32_t ms = host::micros() / 1000;
+    for (uint8_t i = 0; i < sizeof(s); i++) {
+        if (s[i] == state_[i]) continue;
+        state_[i] = s[i];
+        changed[i] = host::micros();
+        decisions++;
+        const uint8_t rec[6] = { (uint8_t)ms, (uint8_t)(ms >> 8), (uint8_t)(ms >> 16), (uint8_t)(ms >> 24), i, s[i] };
+        for (uint8_t b : rec) hash = (hash ^ b) * FNV_PRIME;
+        if (trace_) fprintf(trace_, "%10.3f %-8s 0x%02x\n", ms / 1000.0, what[i], s[i]);
+    }
+}
+
+void Runner::run(Plant &plant, const uint64_t until_us) {
+    while (host::micros() < until_us) {
+        const uint64_t now = host::micros();
+        if (now >= plant.nextEvent()) plant.update(chip_, now);
+        pass();
+        observe();
+        uint64_t next = host::i2cNextEvent();
+        if (plant.nextEvent() < next) next = plant.nextEvent();
+        if (now + quantum_ < next) next = now + quantum_;
+        if (until_us < next) next = until_us;
+        host::advanceTo(next > now ? next : now + 1);
+    }
+}
+
+// the line is finished on injection; the passes go on, a wire byte of
+// time apart at least, until the console has taken it and printed all
+// it queued (a boot dump still going first)
+void Runner::command(const char *line) {
+    host::uartInject(line);
+    for (;;) {
+        pass();
+        observe();
+        if (!console_.busy()) break;
+        const uint64_t now = host::micros();
+        uint64_t next = host::i2cNextEvent();
+        if (now + COMMAND_STEP_US < next) next = now + COMMAND_STEP_US;
+        host::advanceTo(next > now ? next : now + 1);
+    }
+}
+
+}  // namespace host
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include "host/bq769x0_sim.h"
+#include "mcu/pin.h"
+#include "protocol/console.h"
+
+namespace host {
+
+// What the chip measures: drives the simulator's analog inputs from the
+// scenario time. The runner calls update() once nextEvent() is due.
+class Plant {
+public:
+    virtual ~Plant() {}
+    virtual void update(Bq769x0Sim &chip, const uint64_t now_us) = 0;
+    virtual uint64_t nextEvent() = 0;
+};
+
+// One step of a piecewise linear profile: pack current and the cell
+// voltage ramp it produces over the step
+struct Phase {
+    const char  *name;
+    uint32_t    seconds;
+    int32_t     current_mA;
+    uint16_t    from_mV;
+    uint16_t    to_mV;
+};
+
+// Cells follow the phase ramp plus a fixed imbalance that CELLBAL bleed
+// removes at mV_per_As, enough to exercise the driver's decisions
+class RampPlant : public Plant {
+public:
+    RampPlant(const Phase *phases, const uint8_t count, const int16_t *imbalance_mV, const float mV_per_As);
+    void update(Bq769x0Sim &chip, const uint64_t now_us) override;
+    uint64_t nextEvent() override { return next_; }
+    const char *phase() const { return phase_ < count_ ? phases_[phase_].name : "end"; }
+private:
+    const Phase     *phases_;
+    const uint8_t   count_;
+    const int16_t   *imbalance_;
+    const float     mV_per_As_;
+    uint8_t         phase_;
+    uint64_t        start_;     // of the current phase
+    uint64_t        next_;
+};
+
+// Runs the firmware main loop on the virtual clock, jumping from one event
+// (chip conversion, protection delay, plant step) to the next and at most
+// quantum_us at a time for the firmware's own millis() timers. Decisions
+// the driver makes on the chip (FETs, CELLBAL, protection trips) are
+// logged and hashed, equal hashes mean equal behaviour.
+class Runner {
+public:
+    Runner(Bq769x0Sim &chip, protocol::Console &console, mcu::Pin &led, const uint32_t quantum_us);
+    void run(Plant &plant, const uint64_t until_us);
+    void command(const char *line);     // typed into the console, runs it and its output
+    void trace(FILE *f) { trace_ = f; }
+    uint32_t decisions;
+    uint32_t hash;                      // FNV-1a over the decision log
+    uint32_t passes;                    // main loop iterations
+    enum { CHANGED_FET, CHANGED_CELLBAL1, CHANGED_CELLBAL2, CHANGED_CELLBAL3, CHANGED_FAULTS };
+    uint64_t changed[5];                // virtual time of the last change, us
+private:
+    Bq769x0Sim          &chip_;
+    protocol::Console   &console_;
+    mcu::Pin            &led_;
+    const uint32_t      quantum_;
+    FILE                *trace_;
+    uint8_t             state_[5];      // FETs, CELLBAL1..3, SYS_STAT faults
+    void pass();
+    void observe();
+};
+
+}  // namespace host
@@ -0,0 +1,107 @@
+/* Scenario runner of the host build, see host/Makefile
+ *
+ * Runs the console firmware against the bq769x0 model through a 24 h
+ * charge / rest / discharge / rest profile on the virtual clock, as fast
+ * as the host allows, and reports what the driver decided.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/wdt.h>
+#include "mcu/watchdog.h"
+#include "mcu/pin.h"
+#include "protocol/console.h"
+#include "host/hal.h"
+#include "host/bq769x0_sim.h"
+#include "host/scenario.h"
+
+#define PIN_LED_SCK MAKEPIN(B, 5, OUT)
+
+namespace {
+
+const host::Phase day[] = {
+    { "charge",     16200,  5000, 3400, 4150 },     // 4.5 h
+    { "rest",        5400,     0, 4150, 4120 },     // 1.5 h
+    { "discharge",  28800, -4000, 4120, 3300 },     // 8 h
+    { "rest",       36000,     0, 3300, 3350 },     // 10 h
+};
+
+// cell offsets against the ramp, repeated over the pack
+const int16_t spread[] = { 0, 25, -10, 40, 5, -20, 15, 0, 30, -5, 10, -15, 35, 0, 20 };
+
+double wall() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [-H hours] [-q us] [-e file] [-T] [-p]\n"
+            "  -H hours  simulated time (24)\n"
+            "  -q us     longest step of the virtual clock between events (10000)\n"
+            "  -e file   EEPROM image (default in memory)\n"
+            "  -T        print the decision log\n"
+            "  -p        print the console status at the end\n", name);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    host::begin(argc, argv);
+    uint32_t hours = 24;
+    uint32_t quantum = 10000;
+    bool log = false, status = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "H:q:e:Tph")) != -1) {
+        switch (opt) {
+            case 'H': hours = atol(optarg); break;
+            case 'q': quantum = atol(optarg); break;
+            case 'e': if (!host::eepromOpen(optarg)) { perror(optarg); return 1; } break;
+            case 'T': log = true; break;
+            case 'p': status = true; break;
+            default: usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    host::uartOpenOutput(-1);
+    static host::Bq769x0Sim chip(BQ769X0_I2C_ADDR, protocol::BQ::cells, protocol::BQ::thermistors);
+    host::i2cAttach(BQ769X0_I2C_ADDR, &chip);
+    host::RampPlant plant(day, sizeof(day) / sizeof(day[0]), spread, 0.3f);
+    plant.update(chip, 0);
+
+    sei();
+    mcu::Pin led(PIN_LED_SCK);
+    protocol::Console proto;
+    mcu::Watchdog::enable(WDTO_4S);
+    proto.begin();
+    host::Runner runner(chip, proto, led, quantum);
+    if (log) runner.trace(stdout);
+    runner.command("charging 1\n");
+    runner.command("discharging 1\n");
+    runner.command("autobalancing 1\n");
+    runner.command("balancecharging 1\n");
+
+    const double t0 = wall();
+    runner.run(plant, host::micros() + hours * 3600000000ULL);
+    const double dt = wall() - t0;
+
+    printf("simulated %u h in %.2f s (%.0fx), %u loop passes, %u conversions\n",
+           hours, dt, hours * 3600.0 / dt, runner.passes, chip.conversions);
+    printf("decisions %u, hash %08x\n", runner.decisions, runner.hash);
+    printf("trips OCD %u SCD %u OV %u UV %u OVRD %u XREADY %u\n",
+           chip.trips[0], chip.trips[1], chip.trips[2], chip.trips[3], chip.trips[4], chip.trips[5]);
+    printf("bleed mAh:");
+    for (uint8_t c = 0; c < protocol::BQ::cells; c++) printf(" %.0f", chip.bleed_mAs(c) / 3600.0);
+    printf("\n");
+    if (status) {
+        fflush(stdout);
+        host::uartOpenOutput(STDOUT_FILENO);
+        runner.command("print\n");
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,57 @@
+#include <time.h>
+#include <util/delay.h>
+
+#include "mcu/timer.h"
+#include "host/hal.h"
+
+namespace {
+
+uint64_t now_us = 0;            // virtual time since start
+int64_t offset_ms = 0;          // setmillis() adjustment
+uint64_t wall0_us = 0;
+
+uint64_t wall_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+}  // namespace
+
+namespace host {
+
+void watchdogCheck(const uint64_t now);     // watchdog.cc
+
+uint64_t micros() { return now_us; }
+
+void advance(const uint32_t us) {
+    now_us += us;
+    watchdogCheck(now_us);
+}
+
+void advanceTo(const uint64_t us) {
+    if (us > now_us) {
+        now_us = us;
+        watchdogCheck(now_us);
+    }
+}
+
+void syncRealtime() {
+    const uint64_t wall = wall_us();
+    if (!wall0_us) wall0_us = wall - now_us;
+    const uint64_t t = wall - wall0_us;
+    if (t > now_us) advance(t - now_us);
+}
+
+}  // namespace host
+
+void _delay_ms(double ms) { host::advance((uint32_t)(ms * 1000.0)); }
+void _delay_us(double us) { host::advance((uint32_t)us); }
+
+namespace mcu {
+
+    void Timer::setmillis(const uint32_t nnm) { offset_ms = (int64_t)nnm - (int64_t)(now_us / 1000); }
+
+    uint32_t Timer::millis() { return (uint32_t)(now_us / 1000 + offset_ms); }
+
+}  // namespace mcu
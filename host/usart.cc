@@ -0,0 +1,409 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <avr/io.h>
+
+#include "mcu/usart.h"
+#include "mcu/baud.h"
+#include "mcu/line_editor.h"
+#include "mcu/tx_queue.h"
+#include "host/hal.h"
+
+#define USART0_RX_BUFFER_SIZE 128
+#define USART0_TX_SLOTS     16
+#define USART0_LINE_SIZE    64
+#define HOST_UART_ENV "NOT365_HOST_UART"
+
+namespace {
+
+bool Activity;
+uint8_t USART0_BAUD;
+
+uint8_t USART0_RX_BUFFER[USART0_RX_BUFFER_SIZE];
+uint8_t USART0_RX_BUFFER_HEAD;
+uint8_t USART0_RX_BUFFER_TAIL;
+
+typedef mcu::TxQueue<USART_TX_RING_SIZE, USART0_TX_SLOTS> Usart0Tx;
+Usart0Tx USART0_TX;
+uint8_t USART0_TX_HIGH_WATER;
+uint32_t tx_byte_ns;                // start, 8 data, stop at the programmed rate
+uint64_t tx_wire_ns;                // virtual time the shift register is free
+
+mcu::LineEditor<USART0_LINE_SIZE> USART0_LINE;
+bool USART0_LINES;
+uint8_t USART0_ZEROS;
+bool USART0_BINARY;
+uint16_t USART0_GAP_US;             // silence that ends a frame, 0 off
+uint64_t rx_last_us;                // virtual time of the last raw byte
+bool rx_framing;                    // raw bytes since the last frame end
+
+int uart_in = -1;
+int uart_out = -1;
+#define UART_LF2CR  0x01            // translate piped LF line ends to CR
+#define UART_PTY    0x02            // drop output nobody reads
+int uart_flags = 0;
+bool uart_eof = false;
+char *uart_capture = nullptr;
+size_t uart_capture_size;
+size_t uart_capture_len;
+
+bool tx_push(const uint8_t c);
+
+// room for one more received byte: the AVR would lose it, the host leaves
+// it with the sender. Its echo too, a typist waits for output to pass.
+bool rx_room() {
+    if (USART0_LINES) return !USART0_LINE.full() && USART0_TX.room() >= 3;
+    const uint8_t i = (USART0_RX_BUFFER_HEAD + 1 >= USART0_RX_BUFFER_SIZE) ? 0 : USART0_RX_BUFFER_HEAD + 1;
+    return i != USART0_RX_BUFFER_TAIL;
+}
+
+// stand-in for the RX interrupt
+void rx_byte(const uint8_t c) {
+    Activity = true;
+    if (USART0_LINES) {
+        if (!c) {
+            if (++USART0_ZEROS >= USART_BINARY_ZEROS) {
+                USART0_LINES = false;
+                USART0_BINARY = true;
+            }
+            return;
+        }
+        USART0_ZEROS = 0;
+        uint8_t echo[3];
+        const uint8_t n = USART0_LINE.input(c, echo);
+        for (uint8_t e = 0; e < n && tx_push(echo[e]); e++) {}
+        return;
+    }
+    USART0_RX_BUFFER[USART0_RX_BUFFER_HEAD] = c;
+    USART0_RX_BUFFER_HEAD = (USART0_RX_BUFFER_HEAD + 1 >= USART0_RX_BUFFER_SIZE) ? 0 : USART0_RX_BUFFER_HEAD + 1;
+    if (USART0_GAP_US) {
+        rx_last_us = host::micros();
+        rx_framing = true;
+    }
+}
+
+// a frame is open and its silence has not passed yet: the pty hands over
+// whole frames at once, the gap is the virtual time since
+bool rx_gap_waiting() { return rx_framing && host::micros() - rx_last_us < USART0_GAP_US; }
+
+// what the host has, until the console has no room for more
+void uart_poll() {
+    if (uart_in < 0 || uart_eof || !(UCSR0B & _BV(RXEN0))) return;
+    while (rx_room()) {
+        uint8_t c;
+        const ssize_t n = ::read(uart_in, &c, 1);
+        if (n == 0) { uart_eof = true; return; }
+        if (n < 0) return;              // EAGAIN, or EIO with no terminal attached
+        if ((uart_flags & UART_LF2CR) && USART0_LINES && c == '\n') c = '\r';
+        rx_byte(c);
+    }
+}
+
+// nothing received is waiting for the firmware
+bool rx_idle() {
+    if (USART0_LINES) return !USART0_LINE.line();
+    return USART0_RX_BUFFER_HEAD == USART0_RX_BUFFER_TAIL;
+}
+
+// one byte on the wire. Bytes a full pty would block on are dropped, as
+// nobody is listening.
+void uart_emit(const uint8_t data) {
+    if (uart_capture) {
+        if (uart_capture_len + 1 < uart_capture_size) {
+            uart_capture[uart_capture_len++] = data;
+            uart_capture[uart_capture_len] = 0;
+        }
+        return;
+    }
+    if (uart_out < 0) return;
+    while (::write(uart_out, &data, 1) < 0) {
+        if (errno == EAGAIN && !(uart_flags & UART_PTY)) {
+            struct pollfd p = { uart_out, POLLOUT, 0 };
+            poll(&p, 1, -1);
+        } else if (errno != EINTR) {
+            return;
+        }
+    }
+}
+
+// stand-in for the UDRE interrupt: what the wire took since the last call
+void tx_drain() {
+    const uint64_t now = host::micros() * 1000;
+    while (!USART0_TX.empty() && tx_wire_ns + tx_byte_ns <= now) {
+        tx_wire_ns += tx_byte_ns;
+        const int16_t c = USART0_TX.get();
+        if (c >= 0) uart_emit(c);
+    }
+}
+
+// the firmware spinning on UDRE: the virtual clock runs until a byte is out
+void tx_wait() {
+    host::advanceTo((tx_wire_ns + tx_byte_ns + 999) / 1000);
+    tx_drain();
+}
+
+// an idle wire starts with the first byte queued
+void tx_start() {
+    if (USART0_TX.empty() && tx_wire_ns < host::micros() * 1000) tx_wire_ns = host::micros() * 1000;
+}
+
+bool tx_push(const uint8_t c) {
+    if (!(UCSR0B & _BV(TXEN0))) return true;        // port off (sleep), nobody listens
+    tx_drain();
+    tx_start();
+    if (!USART0_TX.put(c)) return false;
+    if (USART0_TX.ring_used() > USART0_TX_HIGH_WATER) USART0_TX_HIGH_WATER = USART0_TX.ring_used();
+    return true;
+}
+
+bool tx_block(const Usart0Tx::Kind kind, const void *p, const uint16_t len) {
+    if (!(UCSR0B & _BV(TXEN0))) return true;
+    tx_drain();
+    tx_start();
+    return USART0_TX.put(kind, p, len);
+}
+
+void uart_raw(const int fd) {
+    struct termios tio;
+    if (tcgetattr(fd, &tio) < 0) return;
+    cfmakeraw(&tio);
+    tcsetattr(fd, TCSANOW, &tio);
+}
+
+struct termios stdin_saved;
+
+void stdin_restore() { tcsetattr(STDIN_FILENO, TCSANOW, &stdin_saved); }
+
+// descriptors survive host::reset() through the environment
+bool uart_inherit() {
+    const char *env = getenv(HOST_UART_ENV);
+    return env && sscanf(env, "%d,%d,%d", &uart_in, &uart_out, &uart_flags) == 3;
+}
+
+void uart_export() {
+    char env[32];
+    snprintf(env, sizeof(env), "%d,%d,%d", uart_in, uart_out, uart_flags);
+    setenv(HOST_UART_ENV, env, 1);
+}
+
+}  // namespace
+
+namespace host {
+
+bool uartOpenPty() {
+    if (uart_inherit()) return true;
+    const int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) return false;
+    const char *name = ptsname(master);
+    // keep the slave side open: output is never lost on EIO and the raw
+    // line settings stay while terminals come and go
+    const int slave = open(name, O_RDWR | O_NOCTTY);
+    if (slave < 0) return false;
+    uart_raw(slave);
+    fcntl(master, F_SETFL, O_NONBLOCK);
+    uart_in = uart_out = master;
+    uart_flags = UART_PTY;
+    uart_export();
+    fprintf(stderr, "host: console on %s\n", name);
+    return true;
+}
+
+bool uartOpenStdio() {
+    if (!uart_inherit()) {
+        uart_in = STDIN_FILENO;
+        uart_out = STDOUT_FILENO;
+        uart_flags = isatty(STDIN_FILENO) ? 0 : UART_LF2CR;
+        uart_export();
+    }
+    if (isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &stdin_saved) == 0) {
+        uart_raw(STDIN_FILENO);
+        atexit(stdin_restore);
+    }
+    fcntl(uart_in, F_SETFL, fcntl(uart_in, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+void uartOpenOutput(const int fd) {
+    uart_in = -1;
+    uart_out = fd;
+}
+
+void uartInject(const char *s) {
+    // at once, as the RX interrupt takes it: echo a full TX queue has no
+    // room for is lost
+    for (; *s; s++) {
+        if (USART0_LINES ? USART0_LINE.full() : !rx_room()) return;
+        rx_byte(*s == '\n' ? '\r' : *s);
+    }
+}
+
+bool uartWait(const int timeout_ms) {
+    if (uart_eof) return false;
+    tx_drain();
+    if (rx_idle() || rx_gap_waiting()) {
+        struct pollfd p = { uart_in, POLLIN, 0 };
+        poll(&p, 1, rx_gap_waiting() ? 1 : timeout_ms);
+    }
+    uart_poll();
+    return true;
+}
+
+bool uartEof() { return uart_eof && rx_idle(); }
+
+void uartCapture(char *buf, const size_t size) {
+    uart_capture = size ? buf : nullptr;
+    uart_capture_size = size;
+    uart_capture_len = 0;
+    if (uart_capture) *uart_capture = 0;
+}
+
+}  // namespace host
+
+namespace mcu {
+
+Usart &Usart::get() {
+    static Usart usart(USART_BAUD_DEFAULT, (1<<UCSZ01) | (1<<UCSZ00));
+    return usart;
+}
+
+// the pty or pipe takes any rate, only the drain timing follows it
+static void set_ubrr(const uint8_t i) {
+    USART0_BAUD = i;
+    const uint16_t ubrr = baud_ubrr(Usart::baud_rate(i));
+    tx_byte_ns = (uint32_t)(10ULL * 8 * (ubrr + 1) * 1000000000ULL / F_CPU);
+    UBRR0H = ubrr >> 8;
+    UBRR0L = ubrr;
+}
+
+Usart::Usart(const uint8_t baud, const uint8_t config) {
+    USART0_RX_BUFFER_HEAD = 0;
+    USART0_RX_BUFFER_TAIL = 0;
+    USART0_TX_HIGH_WATER = 0;
+    USART0_LINES = true;
+    tx_wire_ns = 0;
+    UCSR0A = 1 << U2X0;
+    set_ubrr(baud);
+    UCSR0B = (1<<RXCIE0);
+    enable_TxRx();
+    UCSR0C = config;
+    Activity = false;
+}
+
+void Usart::set_baud(const uint8_t i) {
+    if (i >= BAUD_COUNT || i == USART0_BAUD) return;
+    flush();
+    set_ubrr(i);
+}
+
+uint8_t Usart::baud() { return USART0_BAUD; }
+
+uint32_t Usart::baud_rate(const uint8_t i) { return pgm_read_dword(&BAUD_RATES[i]); }
+
+bool Usart::isActivity() {
+    tx_drain();
+    uart_poll();
+    if (Activity) {
+        Activity = false;
+        return true;
+    }
+    return false;
+}
+
+uint8_t Usart::read() {
+    uart_poll();
+    if (USART0_RX_BUFFER_HEAD == USART0_RX_BUFFER_TAIL) return -1;
+    uint8_t c = USART0_RX_BUFFER[USART0_RX_BUFFER_TAIL];
+    if (++USART0_RX_BUFFER_TAIL >= USART0_RX_BUFFER_SIZE) USART0_RX_BUFFER_TAIL = 0;
+    return c;
+}
+
+uint16_t Usart::avail() {
+    tx_drain();
+    uart_poll();
+    return ((uint16_t)(USART0_RX_BUFFER_SIZE + USART0_RX_BUFFER_HEAD - USART0_RX_BUFFER_TAIL)) % USART0_RX_BUFFER_SIZE;
+}
+
+void Usart::rx_lines(const bool on) {
+    if (on == USART0_LINES) return;
+    USART0_LINES = on;
+    USART0_ZEROS = 0;
+    USART0_RX_BUFFER_TAIL = USART0_RX_BUFFER_HEAD;
+}
+
+bool Usart::binary_request() {
+    uart_poll();
+    if (!USART0_BINARY) return false;
+    USART0_BINARY = false;
+    return true;
+}
+
+const char *Usart::line() {
+    tx_drain();
+    uart_poll();
+    return USART0_LINE.line();
+}
+
+void Usart::line_done() {
+    USART0_LINE.release();
+    uart_poll();
+}
+
+void Usart::rx_gap_us(const uint16_t gap_us) {
+    USART0_GAP_US = gap_us;
+    rx_framing = false;
+}
+
+uint8_t Usart::rx_frame() {
+    uart_poll();
+    if (!rx_framing || rx_gap_waiting()) return 0;
+    rx_framing = false;
+    return ((uint16_t)(USART0_RX_BUFFER_SIZE + USART0_RX_BUFFER_HEAD - USART0_RX_BUFFER_TAIL)) % USART0_RX_BUFFER_SIZE;
+}
+
+// The TX queue drains at the baud rate of the virtual clock, a full queue
+// costs the writer the time the AVR would spin on it.
+void Usart::write(const uint8_t data) {
+    while (!tx_push(data)) tx_wait();
+}
+
+bool Usart::try_write(const uint8_t data) { return tx_push(data); }
+
+void Usart::write(const void *data, const uint16_t len) {
+    while (!tx_block(Usart0Tx::RAM, data, len)) tx_wait();
+}
+
+void Usart::write_P(const char *str) {
+    while (!tx_block(Usart0Tx::FLASH_STR, str, 0)) tx_wait();
+}
+
+void Usart::write_P(const void *data, const uint16_t len) {
+    while (!tx_block(Usart0Tx::FLASH, data, len)) tx_wait();
+}
+
+uint8_t Usart::tx_free() {
+    tx_drain();
+    return USART0_TX.room();
+}
+
+uint8_t Usart::tx_slots() {
+    tx_drain();
+    return USART0_TX.slots_free();
+}
+
+uint8_t Usart::tx_high_water() {
+    tx_drain();
+    const uint8_t hw = USART0_TX_HIGH_WATER;
+    USART0_TX_HIGH_WATER = USART0_TX.ring_used();
+    return hw;
+}
+
+void Usart::flush() {
+    while (!USART0_TX.empty()) tx_wait();
+}
+
+}  // namespace mcu
@@ -0,0 +1,51 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <avr/io.h>
+#include <avr/wdt.h>
+
+#include "mcu/watchdog.h"
+#include "host/hal.h"
+
+namespace {
+
+char **host_argv = nullptr;
+bool wdt_on = false;
+uint32_t wdt_timeout_us = 0;
+uint64_t wdt_last = 0;
+
+}  // namespace
+
+namespace host {
+
+void begin(const int, char **argv) { host_argv = argv; }
+
+void reset(const char *cause) {
+    fprintf(stderr, "host: %s reset\n", cause);
+    fflush(stdout);
+    // the UART descriptors stay open across exec (usart.cc), the EEPROM
+    // file is opened again from the same command line
+    execv("/proc/self/exe", host_argv);
+    perror("host: execv");
+    exit(1);
+}
+
+void watchdogCheck(const uint64_t now) {
+    if (wdt_on && now - wdt_last > wdt_timeout_us) {
+        MCUSR |= _BV(WDRF);
+        reset("watchdog");
+    }
+}
+
+}  // namespace host
+
+namespace mcu {
+    void Watchdog::enable(const uint8_t value) {
+        wdt_timeout_us = 16000UL << value;     // WDTO_15MS .. WDTO_8S, nominal oscillator
+        wdt_last = host::micros();
+        wdt_on = true;
+    }
+    void Watchdog::disable() { wdt_on = false; }
+    void Watchdog::reset() { wdt_last = host::micros(); }
+    void Watchdog::forceRestart() { host::reset("forced"); }
+}
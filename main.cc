@@ -27,6 +27,7 @@
 #include "stream/uartstream.h"
 #include <avr/sleep.h>
 #include "protocol/console.h"
+#include "utils/atomic.h"
 
 #define PIN_LED_SCK MAKEPIN(B, 5, OUT)
 
@@ -63,11 +64,20 @@ int main() {
     uint32_t last_Activity = 0;
 
     while (1) {
-        if (ser.isActivity() || proto.update(led, isrWU) || proto.Recv()) {
+        bool alert;
+        {
+            utils::Atomic _atomic; // consume the ALERT edge, a new one may come any time
+            alert = isrWU;
+            isrWU = false;
+        }
+        // every pass, a consumed edge has to reach serviceAlert()
+        const bool sampled = proto.update(led, alert);
+        if (ser.isActivity() || sampled || proto.Recv()) {
             last_Activity = mcu::Timer::millis();
         }
 
         if((uint32_t)(mcu::Timer::millis() - last_Activity) >= 60000) { // 1 mim
+            ser.flush(); // TX ring drains on UDRE, finish it before the port goes off
             ser.disable_TXRx();
             cli();
             set_sleep_mode(SLEEP_MODE_PWR_SAVE);
@@ -93,6 +103,7 @@ int main() {
             TIMSK2 = 0;
             float elapsed_time = timer2ovf * 21.76 + TCNT2 * 21.76 / 255.0;
             mcu::Timer::setmillis(mcu::Timer::millis() + (uint32_t)elapsed_time);
+            proto.woke();
             timer2ovf = 0;
             if(isrRX) last_Activity = mcu::Timer::millis();
             isrRX = false;
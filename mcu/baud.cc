@@ -0,0 +1,14 @@
+#include "baud.h"
+
+namespace mcu {
+
+const uint32_t BAUD_RATES[BAUD_COUNT] PROGMEM = { USART_BAUD_RATES };
+
+// (F_CPU - d) * 10^6 / d with d = 8 * (UBRR + 1) * baud, as 1000 / (d / 1000):
+// the table keeps F_CPU - d within 1 %, the product within 32 bit
+int32_t baud_error_ppm(const uint32_t baud) {
+    const uint32_t d = 8UL * (baud_ubrr(baud) + 1) * baud;
+    return ((int32_t)(F_CPU - d) * 1000L) / (int32_t)(d / 1000);
+}
+
+}  // namespace mcu
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+// Console baud rates, U2X mode. The divisors are rounded for F_CPU and
+// every rate is checked here at compile time: at 12 MHz the classic rates
+// are 0.16 % fast, 250k, 500k and 750k are exact, 230400 (-7 %) and 1M
+// have no usable divisor. Another F_CPU may need another list.
+#define USART_BAUD_DEFAULT      4       // 115200
+#define USART_BAUD_MAX_PPM      10000   // 1 %, half the 8N1 receiver margin
+
+#define USART_BAUD_RATES        9600, 19200, 38400, 57600, 115200, 250000, 500000, 750000
+
+namespace mcu {
+
+extern const uint32_t BAUD_RATES[] PROGMEM;     // USART_BAUD_RATES, the one copy in flash (baud.cc)
+
+// The compile time copy for the checks below, never odr-used: it takes no memory
+constexpr uint32_t BAUD_LIST[] = { USART_BAUD_RATES };
+constexpr uint8_t BAUD_COUNT = sizeof(BAUD_LIST) / sizeof(BAUD_LIST[0]);
+
+constexpr uint16_t baud_ubrr(const uint32_t baud) { return (F_CPU + 4 * baud) / (8 * baud) - 1; }
+
+// rate the divisor gives against the nominal one, parts per million; 64 bit,
+// for the static_assert only
+constexpr int32_t baud_check_ppm(const uint32_t baud) {
+    return (int32_t)((uint64_t)F_CPU * 1000000ULL / (8ULL * (baud_ubrr(baud) + 1) * baud)) - 1000000L;
+}
+
+// the same in 32 bit at run time, for the rates of the table
+int32_t baud_error_ppm(const uint32_t baud);
+
+constexpr bool baud_usable(const uint32_t baud) {
+    return baud_ubrr(baud) <= 4095
+        && baud_check_ppm(baud) <= USART_BAUD_MAX_PPM
+        && baud_check_ppm(baud) >= -USART_BAUD_MAX_PPM;
+}
+
+constexpr bool baud_table_usable() {
+    for (uint8_t i = 0; i < BAUD_COUNT; i++) {
+        if (!baud_usable(BAUD_LIST[i])) return false;
+    }
+    return true;
+}
+
+static_assert(baud_table_usable(), "a console baud rate is off by more than 1 % at this F_CPU");
+static_assert(USART_BAUD_DEFAULT < BAUD_COUNT, "default baud rate is not in the table");
+
+}  // namespace mcu
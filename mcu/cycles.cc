@@ -0,0 +1,44 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/power.h>
+
+#include "mcu/cycles.h"
+#include "utils/atomic.h"
+
+namespace {
+
+volatile uint16_t timer1_ovf = 0;
+
+ISR(TIMER1_OVF_vect) { timer1_ovf++; }
+
+}  // namespace
+
+namespace mcu {
+
+    void Cycles::start() {
+        power_timer1_enable();
+        TCCR1A = 0;
+        TCCR1B = 0;
+        TCNT1 = 0;
+        timer1_ovf = 0;
+        TIFR1 = _BV(TOV1);
+        TIMSK1 = _BV(TOIE1);
+        TCCR1B = _BV(CS10);
+    }
+
+    uint32_t Cycles::stop() {
+        TCCR1B = 0;
+        uint32_t cycles;
+        {
+            utils::Atomic _atomic;
+            uint16_t ovf = timer1_ovf;
+            if (TIFR1 & _BV(TOV1)) ovf++;   // overflow not yet serviced
+            cycles = ((uint32_t)ovf << 16) | TCNT1;
+            TIMSK1 = 0;
+            TIFR1 = _BV(TOV1);
+        }
+        power_timer1_disable();
+        return cycles;
+    }
+
+}  // namespace mcu
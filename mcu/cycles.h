@@ -0,0 +1,16 @@
+#pragma once
+#include <stdint.h>
+#include "utils/cpp.h"
+
+namespace mcu {
+    // CPU cycle stopwatch on Timer1 (no prescaler) for on-target
+    // benchmarks. Timer1 is powered only between start() and stop().
+    class Cycles {
+        Cycles();
+    public:
+        static void start();
+        static uint32_t stop();
+    private:
+        DISALLOW_COPY_AND_ASSIGN(Cycles);
+    };
+}  // namespace mcu
@@ -1,96 +1,122 @@
 #include "i2c_master.h"
+#include "utils/atomic.h"
 
 #define I2C_FREQ 100000UL
 
 //                      TWINT          TWEA          TWSTA          TWSTO          TWEN          TWIE
 #define I2C_START (1 << TWINT) | (1 << TWEA) | (1 << TWSTA) |                (1 << TWEN) | (1 << TWIE)
 #define I2C_STOP  (1 << TWINT) |                              (1 << TWSTO) | (1 << TWEN)
+#define I2C_STOP_START (1 << TWINT) | (1 << TWEA) | (1 << TWSTA) | (1 << TWSTO) | (1 << TWEN) | (1 << TWIE)
 #define I2C_SEND  (1 << TWINT) | (1 << TWEA) |                               (1 << TWEN) | (1 << TWIE)
 #define I2C_ACK   (1 << TWINT) | (1 << TWEA) |                               (1 << TWEN) | (1 << TWIE)
 #define I2C_NACK  (1 << TWINT) |                                             (1 << TWEN) | (1 << TWIE)
 #define I2C_RESET                                                            (1 << TWEN)
 
 namespace {
-    
-volatile uint8_t *i2c_data = 0;
-volatile uint8_t i2c_len = 0;
-uint8_t i2c_addr = 0;
+
+typedef mcu::I2CMaster::Transaction Transaction;
+
+Transaction * volatile i2c_head = nullptr;   // transaction on the bus
+Transaction * volatile i2c_tail = nullptr;
+uint8_t i2c_idx = 0;
+bool i2c_reading = false;
+
+void i2c_begin(Transaction *t) {
+    t->status = mcu::I2CMaster::I2C_BUSY;
+    i2c_idx = 0;
+    i2c_reading = (t->wlen == 0 && t->rlen != 0);
+}
+
+// Completes the head transaction and chains the next one with STOP+START,
+// so the ISR never has to wait for the STOP to go out on the bus.
+void i2c_finish(const mcu::I2CMaster::Status status, const bool bus_ok) {
+    Transaction *t = i2c_head;
+    Transaction *n = t->next;
+    i2c_head = n;
+    if (!n) i2c_tail = nullptr;
+    t->status = status;
+    if (t->callback) t->callback(*t);
+    if (n) {
+        i2c_begin(n);
+        TWCR = bus_ok ? (I2C_STOP_START) : (I2C_START);
+    } else if (bus_ok) {
+        TWCR = I2C_STOP;
+    }
+}
 
 ISR(TWI_vect) {
+    Transaction *t = i2c_head;
+    if (!t) {
+        TWCR = I2C_RESET;
+        return;
+    }
     switch (TW_STATUS) {
         // Master read/write --------------------------------------
-        
+
         case TW_START:
         case TW_REP_START:
-            TWDR = i2c_addr;
+            TWDR = (t->addr << 1) | (i2c_reading ? TW_READ : TW_WRITE);
             TWCR = I2C_SEND;
             break;
-            
+
         case TW_MT_ARB_LOST:  // Same as TW_MR_ARB_LOST
+            i2c_begin(t);       // the whole transaction again, from its first byte
             TWCR = I2C_START;
             break;
-            
+
             // Master write -------------------------------------------
-            
+
         case TW_MT_SLA_ACK:
         case TW_MT_DATA_ACK:
-            if (i2c_len) {
-                --i2c_len;
-                TWDR = *i2c_data++;
+            if (i2c_idx < t->wlen) {
+                TWDR = t->wdata[i2c_idx++];
                 TWCR = I2C_SEND;
+            } else if (t->rlen) {
+                i2c_idx = 0;
+                i2c_reading = true;
+                TWCR = I2C_START; // repeated START
             } else {
-                TWCR = I2C_STOP;
-                while (TWCR & (1 << TWSTO)) {} // TODO Blocking
+                i2c_finish(mcu::I2CMaster::I2C_DONE, true);
             }
             break;
-            
+
         case TW_MT_SLA_NACK:
         case TW_MT_DATA_NACK:
-            TWCR = I2C_STOP;
-            while (TWCR & (1 << TWSTO)) {} // // TODO Blocking
+        case TW_MR_SLA_NACK:
+            i2c_finish(mcu::I2CMaster::I2C_NOACK, true);
             break;
-            
+
             // Master read --------------------------------------------
-            
+
         case TW_MR_DATA_ACK:
-            *i2c_data++ = TWDR;
-            --i2c_len;
+            t->rdata[i2c_idx++] = TWDR;
             [[fallthrough]];
         case TW_MR_SLA_ACK:
-            TWCR = (i2c_len > 1) ? I2C_ACK : I2C_NACK;
+            TWCR = (t->rlen - i2c_idx > 1) ? I2C_ACK : I2C_NACK;
             break;
-            
+
         case TW_MR_DATA_NACK:
-            *i2c_data = TWDR;
-            --i2c_len;
-            [[fallthrough]];
-        case TW_MR_SLA_NACK:
-            TWCR = I2C_STOP;
+            t->rdata[i2c_idx++] = TWDR;
+            i2c_finish(mcu::I2CMaster::I2C_DONE, true);
             break;
-            
-            // Anything else, just disable interrupts ...
+
+            // Anything else, release the bus and fail the transaction
         default:
             TWCR = I2C_RESET;
+            i2c_finish(mcu::I2CMaster::I2C_ERROR, false);
             break;
     }
 }
 
-void i2c_rw(const uint8_t addr, uint8_t *data, const uint8_t len) {
-    i2c_addr = addr;
-    i2c_data = data;
-    i2c_len = len;
-    
-    // Start send/receive
-    TWCR = I2C_START;
-    
-    // Busy wait
-    while (TWCR & (1 << TWIE)) {}; // TODO Blocking
-}
-    
 }  // namespace
 
 namespace mcu {
 
+I2CMaster &I2CMaster::get() {
+    static I2CMaster i2c;
+    return i2c;
+}
+
 I2CMaster::I2CMaster() {
     power_twi_enable();
 
@@ -104,16 +130,52 @@ I2CMaster::I2CMaster() {
     sei();
 }
 
-I2CMaster::~I2CMaster() {
-    power_twi_disable();
+bool I2CMaster::submit(Transaction &t) {
+    if (t.wlen == 0 && t.rlen == 0) {
+        t.status = I2C_DONE;
+        return false;
+    }
+    t.next = nullptr;
+    t.status = I2C_QUEUED;
+    utils::Atomic _atomic;
+    if (i2c_tail) {
+        i2c_tail->next = &t;
+        i2c_tail = &t;
+    } else {
+        i2c_head = i2c_tail = &t;
+        // An idle bus may still be sending the last STOP (a few us)
+        while (TWCR & (1 << TWSTO)) {}
+        i2c_begin(&t);
+        TWCR = I2C_START;
+    }
+    return true;
+}
+
+bool I2CMaster::busy() { return i2c_head != nullptr; }
+
+I2CMaster::Status I2CMaster::wait(Transaction &t) {
+    while (pending(t)) {}
+    return t.status;
+}
+
+I2CMaster::Status I2CMaster::write_read(const uint8_t addr, const uint8_t *wdata, const uint8_t wlen, uint8_t *rdata, const uint8_t rlen) {
+    Transaction t;
+    t.addr = addr;
+    t.wdata = wdata;
+    t.wlen = wlen;
+    t.rdata = rdata;
+    t.rlen = rlen;
+    t.callback = nullptr;
+    submit(t);
+    return wait(t);
 }
 
-void I2CMaster::write(const uint8_t addr, uint8_t *data, const uint8_t len) {
-    i2c_rw(TW_WRITE | (addr << 1), data, len);
+I2CMaster::Status I2CMaster::write(const uint8_t addr, const uint8_t *data, const uint8_t len) {
+    return write_read(addr, data, len, nullptr, 0);
 }
 
-void I2CMaster::read(const uint8_t addr, uint8_t *data, const uint8_t len) {
-    i2c_rw(TW_READ | (addr << 1), data, len);
+I2CMaster::Status I2CMaster::read(const uint8_t addr, uint8_t *data, const uint8_t len) {
+    return write_read(addr, nullptr, 0, data, len);
 }
 
 }
@@ -11,14 +11,38 @@
 namespace mcu {
 
 class I2CMaster {
-    
+
 public:
-    I2CMaster();
-    ~I2CMaster();
-    void write(const uint8_t addr, uint8_t *data, const uint8_t len);
-    void  read(const uint8_t addr, uint8_t *data, const uint8_t len);
+    enum Status : uint8_t { I2C_DONE, I2C_QUEUED, I2C_BUSY, I2C_NOACK, I2C_ERROR };
+
+    // One bus transaction: optional write phase, then optional read phase
+    // joined by a repeated START. The descriptor (and its buffers) must stay
+    // alive until status leaves I2C_QUEUED/I2C_BUSY. The callback, if set,
+    // runs from the TWI interrupt.
+    struct Transaction {
+        uint8_t         addr;       // 7-bit slave address
+        const uint8_t   *wdata;
+        uint8_t         wlen;
+        uint8_t         *rdata;
+        uint8_t         rlen;
+        void            (*callback)(Transaction &t);
+        volatile Status status;
+        Transaction     *next;
+    };
+
+    static I2CMaster &get();
+    // Queue a transaction, the ISR runs the queue to completion
+    bool submit(Transaction &t);
+    bool busy();
+    static bool pending(const Transaction &t) { return t.status == I2C_QUEUED || t.status == I2C_BUSY; }
+    Status wait(Transaction &t);
+    // Blocking helpers
+    Status write(const uint8_t addr, const uint8_t *data, const uint8_t len);
+    Status read(const uint8_t addr, uint8_t *data, const uint8_t len);
+    Status write_read(const uint8_t addr, const uint8_t *wdata, const uint8_t wlen, uint8_t *rdata, const uint8_t rlen);
 private:
-    //DISALLOW_COPY_AND_ASSIGN(I2CMaster);
+    I2CMaster();
+    DISALLOW_COPY_AND_ASSIGN(I2CMaster);
 };
 
 }
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+
+#define LINE_BS     0x08
+#define LINE_DEL    0x7F
+#define LINE_BEL    0x07
+
+namespace mcu {
+
+// Console line discipline, run by the RX interrupt on every byte: echo,
+// backspace, CR ends the line. Two slots: the ISR edits one while the
+// main loop works on the other, a line finished before the main loop is
+// done waits for it (further typing rings the bell).
+//
+// input() runs in the RX interrupt, line() and release() in the main loop.
+template <uint8_t SIZE>
+class LineEditor {
+public:
+    LineEditor() : ready_(NONE), edit_(0), len_(0), pending_(false) {}
+
+    // one received byte, returns how many bytes of echo[3] to send back
+    uint8_t input(const uint8_t c, uint8_t *echo) {
+        if (c == '\r') {
+            if (pending_) return 0;
+            slot_[edit_][len_] = 0;
+            echo[0] = '\r';
+            echo[1] = '\n';
+            if (ready_ == NONE) next();
+            else pending_ = true;
+            return 2;
+        }
+        if (c == LINE_BS || c == LINE_DEL) {
+            if (pending_ || !len_) return 0;
+            len_--;
+            echo[0] = LINE_BS;
+            echo[1] = ' ';
+            echo[2] = LINE_BS;
+            return 3;
+        }
+        if (c < ' ') return 0;      // LF of CR LF terminals, escape sequences
+        if (pending_ || len_ >= SIZE - 1) {
+            echo[0] = LINE_BEL;
+            return 1;
+        }
+        slot_[edit_][len_++] = c;
+        echo[0] = c;
+        return 1;
+    }
+
+    // the finished line, NUL terminated, nullptr while there is none
+    const char *line() const { return ready_ != NONE ? slot_[ready_] : nullptr; }
+
+    // both slots hold a line, input is lost until release()
+    bool full() const { return pending_; }
+
+    // the line's slot is free again; with interrupts off
+    void release() {
+        ready_ = NONE;
+        if (pending_) {
+            pending_ = false;
+            next();
+        }
+    }
+
+private:
+    enum { NONE = 0xFF };
+    char slot_[2][SIZE];
+    volatile uint8_t ready_;
+    uint8_t edit_;
+    uint8_t len_;
+    bool pending_;
+
+    void next() {
+        ready_ = edit_;
+        edit_ ^= 1;
+        len_ = 0;
+    }
+};
+
+}  // namespace mcu
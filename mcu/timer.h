@@ -7,7 +7,8 @@
 namespace mcu {
     // Simple tick counter for various timing tasks.
     // Using this will enable global interrupts and use
-    // timer0.
+    // timer0. The host build links host/timer.cc instead,
+    // a virtual clock the simulation advances.
     class Timer {
         Timer();        
     public:
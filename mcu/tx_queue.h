@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+namespace mcu {
+
+// What the UART transmitter sends, in order: single bytes copied into a
+// small ring, and flash or RAM blocks sent from where they are. A block is
+// one slot however long it is, so a help screen takes a few slots instead
+// of waiting on the ring byte by byte. RAM blocks must stay unchanged
+// until sent.
+//
+// get() runs in the UDRE interrupt, the put()s with interrupts off.
+template <uint8_t RING, uint8_t SLOTS>
+class TxQueue {
+public:
+    enum Kind : uint8_t { BYTES, FLASH, FLASH_STR, RAM };
+
+    TxQueue() : head_(0), tail_(0), rhead_(0), rtail_(0) {}
+
+    // false if the ring or the slots are full
+    bool put(const uint8_t c) {
+        const uint8_t r = next(rhead_, RING);
+        if (r == rtail_) return false;
+        if (head_ != tail_) {
+            Slot &s = slot_[prev(head_)];
+            if (s.kind == BYTES && s.len != 0xFFFF) {
+                ring_[rhead_] = c;
+                rhead_ = r;
+                s.len++;
+                return true;
+            }
+        }
+        if (next(head_, SLOTS) == tail_) return false;
+        ring_[rhead_] = c;
+        rhead_ = r;
+        push(BYTES, nullptr, 1);
+        return true;
+    }
+
+    // len is ignored for FLASH_STR, sent up to the NUL
+    bool put(const Kind kind, const void *p, const uint16_t len) {
+        if (kind != FLASH_STR && !len) return true;
+        if (next(head_, SLOTS) == tail_) return false;
+        push(kind, (const uint8_t *)p, len);
+        return true;
+    }
+
+    // next byte on the wire, -1 when empty
+    int16_t get() {
+        while (head_ != tail_) {
+            Slot &s = slot_[tail_];
+            uint8_t c;
+            switch (s.kind) {
+                case BYTES:
+                    c = ring_[rtail_];
+                    rtail_ = next(rtail_, RING);
+                    if (!--s.len) pop();
+                    return c;
+                case FLASH_STR:
+                    c = pgm_read_byte(s.ptr);
+                    if (!c) {
+                        pop();
+                        continue;
+                    }
+                    s.ptr++;
+                    return c;
+                case FLASH:
+                    c = pgm_read_byte(s.ptr++);
+                    if (!--s.len) pop();
+                    return c;
+                default:
+                    c = *s.ptr++;
+                    if (!--s.len) pop();
+                    return c;
+            }
+        }
+        return -1;
+    }
+
+    bool empty() const { return head_ == tail_; }
+    uint8_t ring_used() const { return (uint8_t)(RING + rhead_ - rtail_) % RING; }
+    // bytes put(c) takes now: the ring if the last slot collects bytes or
+    // a new one is free
+    uint8_t room() const {
+        const bool slot = (head_ != tail_ && slot_[prev(head_)].kind == BYTES) || next(head_, SLOTS) != tail_;
+        return slot ? RING - 1 - ring_used() : 0;
+    }
+    uint8_t slots_free() const { return (uint8_t)(SLOTS - 1 + tail_ - head_) % SLOTS; }
+
+private:
+    struct Slot {
+        const uint8_t   *ptr;
+        uint16_t        len;
+        Kind            kind;
+    };
+    Slot slot_[SLOTS];
+    uint8_t ring_[RING];
+    volatile uint8_t head_;     // next slot to fill
+    volatile uint8_t tail_;     // slot on the wire
+    volatile uint8_t rhead_;
+    volatile uint8_t rtail_;
+
+    static uint8_t next(const uint8_t i, const uint8_t n) { return (i + 1 >= n) ? 0 : i + 1; }
+    static uint8_t prev(const uint8_t i) { return i ? i - 1 : SLOTS - 1; }
+    void push(const Kind kind, const uint8_t *p, const uint16_t len) {
+        Slot &s = slot_[head_];
+        s.kind = kind;
+        s.ptr = p;
+        s.len = len;
+        head_ = next(head_, SLOTS);
+    }
+    void pop() { tail_ = next(tail_, SLOTS); }
+};
+
+}  // namespace mcu
@@ -2,44 +2,141 @@
 #include <avr/io.h>
 #include <stdint.h>
 #include "mcu/usart.h"
+#include "mcu/baud.h"
+#include "mcu/line_editor.h"
+#include "mcu/tx_queue.h"
 #include "utils/atomic.h"
 
 
 #define USART0_RX_BUFFER_SIZE 128
-#define USART0_TX_BUFFER_SIZE 128
+#define USART0_TX_SLOTS     16
+#define USART0_LINE_SIZE    64
+#define USART0_GAP_PRESCALE 256     // Timer2, 21.3 us a tick at 12 MHz
 
 namespace {
 
 static volatile bool Activity;
+static uint8_t USART0_BAUD;
     
 static volatile uint8_t USART0_RX_BUFFER[USART0_RX_BUFFER_SIZE];
 static volatile uint8_t USART0_RX_BUFFER_HEAD;
 static volatile uint8_t USART0_RX_BUFFER_TAIL;
 
-static volatile uint8_t USART0_TX_BUFFER[USART0_TX_BUFFER_SIZE];
-static volatile uint8_t USART0_TX_BUFFER_HEAD;
-static volatile uint8_t USART0_TX_BUFFER_TAIL;
+typedef mcu::TxQueue<USART_TX_RING_SIZE, USART0_TX_SLOTS> Usart0Tx;
+static Usart0Tx USART0_TX;
+static volatile uint8_t USART0_TX_HIGH_WATER;
+static volatile bool USART0_TX_WRITTEN;     // TXC means something only after a first byte
+
+static mcu::LineEditor<USART0_LINE_SIZE> USART0_LINE;
+static volatile bool USART0_LINES;          // RX through the line editor, else raw into the ring
+static uint8_t USART0_ZEROS;                // in a row at the line editor
+static volatile bool USART0_BINARY;
+
+static uint8_t USART0_GAP_TICKS;            // Timer2 ticks of silence that end a frame, 0 off
+static volatile bool USART0_GAP;
+static volatile uint8_t USART0_FRAME_END;   // ring head when the silence came
+
+bool tx_put(const uint8_t c);
+
+// Timer2 restarted by every raw byte, its compare match is the silence.
+// The power-save sleep in main.cc reprograms Timer2, it only comes after
+// a minute without traffic.
+inline void gap_restart() {
+    TCCR2B = 0;
+    TCNT2 = 0;
+    OCR2A = USART0_GAP_TICKS - 1;
+    TCCR2A = 1 << WGM21;                    // CTC
+    TIFR2 = 1 << OCF2A;
+    TIMSK2 = 1 << OCIE2A;
+    TCCR2B = (1 << CS22) | (1 << CS21);     // /256
+}
+
+ISR(TIMER2_COMPA_vect) {
+    TCCR2B = 0;
+    TIMSK2 = 0;
+    USART0_FRAME_END = USART0_RX_BUFFER_HEAD;
+    USART0_GAP = true;
+}
 
 ISR(USART_RX_vect) {
-    if (bit_is_set(UCSR0A, UPE0)) {
-        UDR0;
+    if (UCSR0A & ((1 << UPE0) | (1 << FE0))) {
+        UDR0;                               // noise, or the other side at another rate
     } else {
         Activity = true;
         uint8_t c = UDR0;
+        if (USART0_LINES) {
+            // never typed: a binary client asking for the raw ring
+            if (!c) {
+                if (++USART0_ZEROS >= USART_BINARY_ZEROS) {
+                    USART0_LINES = false;
+                    USART0_BINARY = true;
+                }
+                return;
+            }
+            USART0_ZEROS = 0;
+            // echo goes with the line, a full TX queue drops it
+            uint8_t echo[3];
+            const uint8_t n = USART0_LINE.input(c, echo);
+            for (uint8_t e = 0; e < n && tx_put(echo[e]); e++) {}
+            return;
+        }
         uint8_t i = (USART0_RX_BUFFER_HEAD + 1 >= USART0_RX_BUFFER_SIZE) ? 0 : USART0_RX_BUFFER_HEAD + 1;
         if (i != USART0_RX_BUFFER_TAIL) {
             USART0_RX_BUFFER[USART0_RX_BUFFER_HEAD] = c;
             USART0_RX_BUFFER_HEAD = i;
         }
+        if (USART0_GAP_TICKS) gap_restart();
     }
 }
 
-ISR(USART_TX_vect) {
-    if (USART0_TX_BUFFER_HEAD != USART0_TX_BUFFER_TAIL) {
-        uint8_t c = USART0_TX_BUFFER[USART0_TX_BUFFER_TAIL];
-        if (++USART0_TX_BUFFER_TAIL >= USART0_TX_BUFFER_SIZE) USART0_TX_BUFFER_TAIL = 0;  // хвост двигаем
+// data register empty: next byte out, interrupt off once the queue is drained
+inline void tx_udre() {
+    const int16_t c = USART0_TX.get();
+    if (c >= 0) {
+        UDR0 = c;
+        // clear TXC (write one), keep U2X
+        UCSR0A = (UCSR0A & ((1 << U2X0) | (1 << MPCM0))) | (1 << TXC0);
+    }
+    if (USART0_TX.empty()) UCSR0B &= ~(1 << UDRIE0);
+}
+
+ISR(USART_UDRE_vect) { tx_udre(); }
+
+// with interrupts off (ISR, Atomic block) nobody else drains the queue
+inline void tx_poll() {
+    if (!(SREG & (1 << SREG_I)) && (UCSR0B & (1 << UDRIE0)) && (UCSR0A & (1 << UDRE0))) tx_udre();
+}
+
+// queues one byte with interrupts off, false on a full ring
+bool tx_put(const uint8_t c) {
+    if (!(UCSR0B & (1 << TXEN0))) return true;     // port off (sleep), nobody listens
+    USART0_TX_WRITTEN = true;
+    // idle transmitter: straight into the data register
+    if (USART0_TX.empty() && (UCSR0A & (1 << UDRE0))) {
         UDR0 = c;
+        UCSR0A = (UCSR0A & ((1 << U2X0) | (1 << MPCM0))) | (1 << TXC0);
+        return true;
     }
+    if (!USART0_TX.put(c)) return false;
+    const uint8_t used = USART0_TX.ring_used();
+    if (used > USART0_TX_HIGH_WATER) USART0_TX_HIGH_WATER = used;
+    UCSR0B |= (1 << UDRIE0);
+    return true;
+}
+
+bool tx_push(const uint8_t c) {
+    utils::Atomic _atomic;
+    return tx_put(c);
+}
+
+// queues a block sent from where it is, false with no free slot
+bool tx_block(const Usart0Tx::Kind kind, const void *p, const uint16_t len) {
+    if (!(UCSR0B & (1 << TXEN0))) return true;
+    USART0_TX_WRITTEN = true;
+    utils::Atomic _atomic;
+    if (!USART0_TX.put(kind, p, len)) return false;
+    UCSR0B |= (1 << UDRIE0);
+    return true;
 }
     
 }
@@ -51,38 +148,40 @@ namespace mcu {
     
     
 Usart &Usart::get() {
-    static Usart usart(115200, (1<<UCSZ01) | (1<<UCSZ00));
+    static Usart usart(USART_BAUD_DEFAULT, (1<<UCSZ01) | (1<<UCSZ00));
     return usart;
 }
 
-Usart::Usart(uint32_t baud, uint8_t config) {
+Usart::Usart(const uint8_t baud, const uint8_t config) {
     USART0_RX_BUFFER_HEAD = 0;
     USART0_RX_BUFFER_TAIL = 0;
-    USART0_TX_BUFFER_HEAD = 0;
-    USART0_TX_BUFFER_TAIL = 0;
-    // Try u2x mode first
-    uint16_t baud_setting = (F_CPU / 4 / baud - 1) / 2;
+    USART0_TX_HIGH_WATER = 0;
+    USART0_TX_WRITTEN = false;
+    USART0_LINES = true;
     UCSR0A = 1 << U2X0;
-    // hardcoded exception for 57600 for compatibility with the bootloader
-    // shipped with the Duemilanove and previous boards and the firmware
-    // on the 8U2 on the Uno and Mega 2560. Also, The baud_setting cannot
-    // be > 4095, so switch back to non-u2x mode if the baud rate is too
-    // low.
-    //         if (((F_CPU == 16000000UL) && (baud == 57600)) || (baud_setting >4095))
-    //         {
-    //             UCSR0A = 0;
-    //             baud_setting = (F_CPU / 8 / baud - 1) / 2;
-    //         }
-    
-    // assign the baud_setting, a.k.a. ubrr (USART Baud Rate Register)
-    UBRR0H = baud_setting >> 8;
-    UBRR0L = baud_setting;
-    UCSR0B = ((1<<RXCIE0) | (1<<TXCIE0)); // (1<<TXEN0) | (1<<RXEN0) | 
+    USART0_BAUD = baud;
+    const uint16_t ubrr = baud_ubrr(baud_rate(baud));
+    UBRR0H = ubrr >> 8;
+    UBRR0L = ubrr;
+    UCSR0B = (1<<RXCIE0); // TX runs on UDRIE0, set while the queue holds data
     enable_TxRx();
     UCSR0C = config; //((1<<UCSZ01) | (1<<UCSZ00));
     Activity = false;
 }
 
+void Usart::set_baud(const uint8_t i) {
+    if (i >= BAUD_COUNT || i == USART0_BAUD) return;
+    flush();
+    USART0_BAUD = i;
+    const uint16_t ubrr = baud_ubrr(baud_rate(i));
+    UBRR0H = ubrr >> 8;
+    UBRR0L = ubrr;
+}
+
+uint8_t Usart::baud() { return USART0_BAUD; }
+
+uint32_t Usart::baud_rate(const uint8_t i) { return pgm_read_dword(&BAUD_RATES[i]); }
+
 bool Usart::isActivity() {
     if (Activity) {
         Activity = false;
@@ -103,23 +202,86 @@ uint16_t Usart::avail() {
     return ((uint16_t)(USART0_RX_BUFFER_SIZE + USART0_RX_BUFFER_HEAD - USART0_RX_BUFFER_TAIL)) % USART0_RX_BUFFER_SIZE;
 }
 
+void Usart::rx_lines(const bool on) {
+    utils::Atomic _atomic;
+    if (on == USART0_LINES) return;     // the magic switched already, keep what came after it
+    USART0_LINES = on;
+    USART0_ZEROS = 0;
+    USART0_RX_BUFFER_TAIL = USART0_RX_BUFFER_HEAD;
+}
 
-void Usart::write(const uint8_t data) {
-    uint8_t i = (USART0_TX_BUFFER_HEAD + 1 >= USART0_TX_BUFFER_SIZE) ? 0 : USART0_TX_BUFFER_HEAD + 1;
-    // ждать освобождения места в буфере
-    while ( (i + 1) == USART0_TX_BUFFER_TAIL);
-    
-    // Не сохранять новые данные если нет места
-    if (i != USART0_TX_BUFFER_TAIL) {
-        USART0_TX_BUFFER[USART0_TX_BUFFER_HEAD] = data;
-        USART0_TX_BUFFER_HEAD = i;
-    }
-    while (!(UCSR0A & (1<<UDRE0)));
-    if (USART0_TX_BUFFER_HEAD != USART0_TX_BUFFER_TAIL) {
-        uint8_t c = USART0_TX_BUFFER[USART0_TX_BUFFER_TAIL];
-        if (++USART0_TX_BUFFER_TAIL >= USART0_TX_BUFFER_SIZE) USART0_TX_BUFFER_TAIL = 0;  // хвост двигаем
-        UDR0 = c;
+bool Usart::binary_request() {
+    if (!USART0_BINARY) return false;
+    USART0_BINARY = false;
+    return true;
+}
+
+const char *Usart::line() { return USART0_LINE.line(); }
+
+void Usart::rx_gap_us(const uint16_t gap_us) {
+    const uint32_t ticks = ((uint32_t)gap_us * (F_CPU / 1000000UL) + USART0_GAP_PRESCALE - 1) / USART0_GAP_PRESCALE;
+    utils::Atomic _atomic;
+    USART0_GAP_TICKS = !gap_us ? 0 : ticks > 255 ? 255 : ticks < 2 ? 2 : ticks;
+    USART0_GAP = false;
+    if (!USART0_GAP_TICKS) {
+        TCCR2B = 0;
+        TIMSK2 = 0;
     }
 }
+
+uint8_t Usart::rx_frame() {
+    utils::Atomic _atomic;
+    if (!USART0_GAP) return 0;
+    USART0_GAP = false;
+    return ((uint16_t)(USART0_RX_BUFFER_SIZE + USART0_FRAME_END - USART0_RX_BUFFER_TAIL)) % USART0_RX_BUFFER_SIZE;
+}
+
+void Usart::line_done() {
+    utils::Atomic _atomic;
+    USART0_LINE.release();
+}
+
+
+// Returns as soon as the byte is queued, the UDRE interrupt sends it.
+// Only a full queue waits, for the ISR to make room.
+void Usart::write(const uint8_t data) {
+    while (!tx_push(data)) tx_poll();
+}
+
+bool Usart::try_write(const uint8_t data) { return tx_push(data); }
+
+void Usart::write(const void *data, const uint16_t len) {
+    while (!tx_block(Usart0Tx::RAM, data, len)) tx_poll();
+}
+
+void Usart::write_P(const char *str) {
+    while (!tx_block(Usart0Tx::FLASH_STR, str, 0)) tx_poll();
+}
+
+void Usart::write_P(const void *data, const uint16_t len) {
+    while (!tx_block(Usart0Tx::FLASH, data, len)) tx_poll();
+}
+
+uint8_t Usart::tx_free() {
+    utils::Atomic _atomic;
+    return USART0_TX.room();
+}
+
+uint8_t Usart::tx_slots() {
+    utils::Atomic _atomic;
+    return USART0_TX.slots_free();
+}
+
+uint8_t Usart::tx_high_water() {
+    utils::Atomic _atomic;
+    const uint8_t hw = USART0_TX_HIGH_WATER;
+    USART0_TX_HIGH_WATER = USART0_TX.ring_used();
+    return hw;
+}
+
+void Usart::flush() {
+    if (!USART0_TX_WRITTEN || !(UCSR0B & (1 << TXEN0))) return;
+    while ((UCSR0B & (1 << UDRIE0)) || !(UCSR0A & (1 << TXC0))) tx_poll();
+}
     
 }  // namespace mcu
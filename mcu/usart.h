@@ -9,19 +9,49 @@
 
 #include "utils/cpp.h"
 
+#define USART_BINARY_ZEROS  3
+#define USART_TX_RING_SIZE  64      // numbers, echo: strings go as flash slots
+
 namespace mcu {
     
 class Usart {
 public:
     static Usart &get();
     uint8_t read();
-    void write(const uint8_t b);
+    void write(const uint8_t b);        // waits only while the TX ring is full
+    bool try_write(const uint8_t b);    // false instead of waiting
+    // blocks sent from where they are, one queue slot each: RAM must stay
+    // unchanged until sent, strings are NUL terminated
+    void write(const void *data, const uint16_t len);
+    void write_P(const char *str);
+    void write_P(const void *data, const uint16_t len);
     uint16_t avail();
+    // Line mode (the default): the RX interrupt echoes and edits, line()
+    // is the next finished line, nullptr while there is none, line_done()
+    // hands its buffer back. Raw mode puts bytes into the ring for read().
+    void rx_lines(const bool on);
+    // USART_BINARY_ZEROS 0x00 bytes at the line editor switched to raw mode
+    bool binary_request();
+    const char *line();
+    void line_done();
+    // Raw mode frames told apart by silence (Modbus t3.5): rx_frame() is
+    // the length of the frame that ended gap_us ago, once, 0 while there
+    // is none; read() takes its bytes. 0 turns it off.
+    void rx_gap_us(const uint16_t gap_us);
+    uint8_t rx_frame();
+    uint8_t tx_free();                  // bytes write() takes without waiting
+    uint8_t tx_slots();                 // queue slots free, a flash string or a run of bytes takes one
+    uint8_t tx_high_water();            // most ring bytes queued at once since the last call
+    void flush();                       // until the last byte left the shift register
+    // index into mcu::BAUD_RATES, the new rate starts after flush()
+    void set_baud(const uint8_t i);
+    uint8_t baud();
+    static uint32_t baud_rate(const uint8_t i);
     bool isActivity();
     void enable_TxRx()  { UCSR0B |=  ((1 << RXEN0) | (1 << TXEN0)); }
     void disable_TXRx() { UCSR0B &= ~((1 << RXEN0) | (1 << TXEN0)); }
 private:
-    Usart(uint32_t baud, uint8_t config);
+    Usart(const uint8_t baud, const uint8_t config);
     DISALLOW_COPY_AND_ASSIGN(Usart);
 };
 
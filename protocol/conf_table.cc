@@ -0,0 +1,105 @@
+/* Shell console for battery management based on bq769x Ic
+ * Copyright (c) 2022 Sergey Kostanoy (https://arduino.uno)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <avr/pgmspace.h>
+#include <string.h>
+#include "conf_table.h"
+#include "mcu/baud.h"
+#include "protocol/modbus.h"
+
+namespace protocol {
+
+namespace {
+
+static_assert(sizeof(Conf) <= 0xFF, "conf offsets are one byte");
+
+// what a binary write may store, per element; the console commands
+// check the same and a few relations between fields on top
+struct ConfEntry {
+    ConfField field;
+    int32_t min, max;
+};
+
+// in PrintParam order
+const ConfEntry confFields[] PROGMEM = {
+    { CONF_FIELD(Conf, Allow_Charging,            0),           0,     1 },
+    { CONF_FIELD(Conf, Allow_Discharging,         0),           0,     1 },
+    { CONF_FIELD(Conf, BQ_dbg,                    0),           0,     1 },
+    { CONF_FIELD(Conf, AlertDriven,               0),           0,     1 },
+    { CONF_FIELD(Conf, OCV_Curve,                 0),           0,     devices::NUM_OCV_CURVES - 1 },
+    { CONF_FIELD(Conf, SOC_Mode,                  0),           0,     devices::SOC_EKF },
+    { CONF_FIELD(Conf, Cells_Parallel,            0),           1,     UINT8_MAX },
+    { CONF_FIELD(Conf, Baud,                      0),           0,     mcu::BAUD_COUNT - 1 },
+    { CONF_FIELD(Conf, Modbus,                    0),           0,     MB_ADDRESS_MAX },
+    { CONF_FIELD(Conf, RT_bits,                   0),           0,     BQ::thermistorBits },
+    { CONF_FIELD(Conf, RS_uOhm,                   0),           1,     INT32_MAX },
+    { CONF_ARRAY(Conf, RT_Beta,                   0),           1,     UINT16_MAX },
+    { CONF_FIELD(Conf, Cell_CapaNom_mV,           0),           1000,  9999 },
+    { CONF_FIELD(Conf, Cell_CapaFull_mV,          0),           1000,  9999 },
+    { CONF_FIELD(Conf, Batt_CapaNom_mAsec,        CONF_SIGNED), 3600,  INT32_MAX },
+    { CONF_FIELD(Conf, CurrentThresholdIdle_mA,   0),           1,     INT32_MAX },
+    { CONF_FIELD(Conf, Cell_TempCharge_min,       CONF_SIGNED), -400,  1000 },
+    { CONF_FIELD(Conf, Cell_TempCharge_max,       CONF_SIGNED), -400,  1000 },
+    { CONF_FIELD(Conf, Cell_TempDischarge_min,    CONF_SIGNED), -400,  1000 },
+    { CONF_FIELD(Conf, Cell_TempDischarge_max,    CONF_SIGNED), -400,  1000 },
+    { CONF_FIELD(Conf, BalancingInCharge,         0),           0,     1 },
+    { CONF_FIELD(Conf, BalancingEnable,           0),           0,     1 },
+    { CONF_FIELD(Conf, BalancingCellMin_mV,       0),           1,     UINT16_MAX },
+    { CONF_FIELD(Conf, BalancingCellMaxDifference_mV, 0),       1,     UINT8_MAX },
+    { CONF_FIELD(Conf, BalancingIdleTimeMin_s,    0),           1,     UINT16_MAX },
+    { CONF_FIELD(Conf, Cell_OCD_mA,               0),           1,     INT32_MAX },
+    { CONF_FIELD(Conf, Cell_OCD_ms,               0),           1,     UINT16_MAX },
+    { CONF_FIELD(Conf, Cell_SCD_mA,               0),           1,     INT32_MAX },
+    { CONF_FIELD(Conf, Cell_SCD_us,               0),           1,     UINT16_MAX },
+    { CONF_FIELD(Conf, Cell_ODP_mA,               0),           1,     INT32_MAX },
+    { CONF_FIELD(Conf, Cell_ODP_ms,               0),           1,     UINT16_MAX },
+    { CONF_FIELD(Conf, Cell_OVP_mV,               0),           1000,  5000 },
+    { CONF_FIELD(Conf, Cell_OVP_sec,              0),           0,     UINT16_MAX },
+    { CONF_FIELD(Conf, Cell_UVP_mV,               0),           1000,  5000 },
+    { CONF_FIELD(Conf, Cell_UVP_sec,              0),           0,     UINT16_MAX },
+    { CONF_ARRAY(Conf, adcCellsOffset_,           CONF_SIGNED), -1000, 1000 },
+    { CONF_FIELD(Conf, ts,                        CONF_READONLY), 0,    INT32_MAX },
+    { CONF_FIELD(Conf, crc8,                      CONF_READONLY), 0,    UINT8_MAX },
+};
+
+static_assert(sizeof(confFields) / sizeof(confFields[0]) == LAST + 1, "one conf field per PrintParam");
+
+}  // namespace
+
+ConfField conf_field(const PrintParam id) {
+    ConfField f;
+    memcpy_P(&f, &confFields[id].field, sizeof(f));
+    return f;
+}
+
+bool conf_valid(const PrintParam id, const uint8_t *value, const uint8_t count) {
+    ConfEntry e;
+    memcpy_P(&e, &confFields[id], sizeof(e));
+    for (uint8_t i = 0; i < count; i++, value += e.field.size) {
+        int32_t v = 0;
+        memcpy(&v, value, e.field.size);    // little endian, as the conf
+        if (e.field.flags & CONF_SIGNED) {
+            if (e.field.size == 1) v = (int8_t)v;
+            else if (e.field.size == 2) v = (int16_t)v;
+        } else if (e.field.size == 4 && v < 0) {
+            return false;                   // above INT32_MAX
+        }
+        if (v < e.min || v > e.max) return false;
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,95 @@
+/* Shell console for battery management based on bq769x Ic
+ * Copyright (c) 2022 Sergey Kostanoy (https://arduino.uno)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "devices/bq769x0.h"
+
+namespace protocol {
+
+typedef devices::BQ769X0_VARIANT BQ;   // chip this image is built for
+
+enum PrintParam {
+    Conf_Allow_Charging,
+    Conf_Allow_Discharging,
+    Conf_BQ_dbg,
+    Conf_AlertDriven,
+    Conf_OCV_Curve,
+    Conf_SOC_Mode,
+    Conf_Cells_Parallel,
+    Conf_Baud,
+    Conf_Modbus,
+    Conf_RT_bits,
+    Conf_RS_uOhm,
+    Conf_RT_Beta,
+    Conf_Cell_CapaNom_mV,
+    Conf_Cell_CapaFull_mV,
+    Conf_Batt_CapaNom_mAsec,
+    Conf_CurrentThresholdIdle_mA,
+    Conf_Cell_TempCharge_min,
+    Conf_Cell_TempCharge_max,
+    Conf_Cell_TempDischarge_min,
+    Conf_Cell_TempDischarge_max,
+    Conf_BalancingInCharge,
+    Conf_BalancingEnable,
+    Conf_BalancingCellMin_mV,
+    Conf_BalancingCellMaxDifference_mV,
+    Conf_BalancingIdleTimeMin_s,
+    Conf_Cell_OCD_mA,
+    Conf_Cell_OCD_ms,
+    Conf_Cell_SCD_mA,
+    Conf_Cell_SCD_us,
+    Conf_Cell_ODP_mA,
+    Conf_Cell_ODP_ms,
+    Conf_Cell_OVP_mV,
+    Conf_Cell_OVP_sec,
+    Conf_Cell_UVP_mV,
+    Conf_Cell_UVP_sec,
+    Conf_adcCellsOffset,
+    Conf_ts,
+    Conf_CRC8,
+    FIRST = Conf_Allow_Charging,
+    LAST = Conf_CRC8
+};
+
+typedef devices::bq769_conf<BQ> Conf;
+
+// Where each PrintParam lives in the conf, for the binary protocols: they
+// get and set fields by id, little endian, size * count bytes. The same
+// descriptors map bq769_data and bq769_stats for Modbus.
+enum ConfFlags : uint8_t {
+    CONF_SIGNED     = 0x01,
+    CONF_READONLY   = 0x02,     // set by conf_save()
+};
+
+struct ConfField {
+    uint8_t offset;
+    uint8_t size;               // of one element
+    uint8_t count;              // 1 unless an array
+    uint8_t flags;
+};
+
+#define CONF_FIELD(T, name, flags) { offsetof(T, name), sizeof(((T *)0)->name), 1, flags }
+#define CONF_ARRAY(T, name, flags) \
+    { offsetof(T, name), sizeof(((T *)0)->name[0]), sizeof(((T *)0)->name) / sizeof(((T *)0)->name[0]), flags }
+
+ConfField conf_field(const PrintParam id);
+// count elements of the field at value, in the conf's layout, within its limits
+bool conf_valid(const PrintParam id, const uint8_t *value, const uint8_t count);
+
+}
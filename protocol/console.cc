@@ -18,6 +18,10 @@
 #include "console_strings.h"
 #include <stdlib.h>
 #include "mcu/watchdog.h"
+#include "utils/crc.h"
+#include "mcu/cycles.h"
+#include "devices/ntc.h"
+#include <math.h>
 #include <avr/interrupt.h>
 #include <avr/eeprom.h>
 #include <avr/pgmspace.h>
@@ -26,12 +30,16 @@ using stream::Flags::PGM;
 
 namespace {
 
+#ifdef __AVR__
 extern "C" uint16_t get_free_mem() {
     extern int16_t __heap_start, *__brkval;
     int16_t v;
     int16_t Free__Ram = (int16_t) &v - (__brkval == 0 ? (int16_t) &__heap_start : (int16_t) __brkval);
     return (uint16_t)abs(Free__Ram);
 }
+#else
+extern "C" uint16_t get_free_mem(); // host/avrlibc.cc
+#endif
 
 }
 
@@ -41,22 +49,32 @@ Console::Console():
     ser(mcu::Usart::get()),
     cout(ser),
     bq(bq769x_conf, bq769x_data, bq769x_stats),
+    tel(ser, bq769x_conf, bq769x_data, bq769x_stats, bq),
+    modbus(ser, bq769x_conf, bq769x_data, bq769x_stats, bq),
     handle_result(false),
     param_len(0),
     handle_len(0),
     m_lastUpdate(0),
     m_oldMillis(0),
     m_millisOverflows(0),
-    len(0),
-    state(CONSOLE_STARTUP)
+    m_baudSince(0),
+    m_baudPrev(USART_BAUD_DEFAULT),
+    m_baudTrial(false),
+    m_printCount(0),
+    m_printPart(0),
+    m_lineHeld(false),
+    m_updateMisses(0),
+    m_updateLateMax(0)
 {
     cout << PGM << STR_msg_coy << EOL;
     cout << PGM << STR_msg_warn << EOL;
     cout << PGM << STR_msg_ver << EOL;
     conf_load();
+    ser.set_baud(bq769x_conf.Baud);   // what came before went at the default rate
     stats_load();
     m_BatCycles_prev    = bq769x_stats.batCycles_;
     m_ChargedTimes_prev = bq769x_stats.chargedTimes_;
+    m_Throughput_Ah_prev = (bq769x_stats.chargeIn_mAh_ + bq769x_stats.chargeOut_mAh_) / 1000;
     shd = 255;
 }
 
@@ -71,7 +89,7 @@ void Console::conf_begin_protect() {
 void Console::begin() {
     bq.begin();
     bq.update();
-    bq.resetSOC(100);
+    bq.resetSOC(); // FETs still off, cell voltages are at rest
     bq.enableCharging();
     conf_begin_protect();
     
@@ -80,26 +98,29 @@ void Console::begin() {
     } else {
         bq.disableDischarging();
     }
-    bq.printRegisters();
-    debug_print();
-    print_all_conf();
-    print_all_stats();
+    // the boot dump goes out between the first samples
+    print(&Console::regs_part);
+    print(&Console::debug_part);
+    print(&Console::conf_part);
+    print(&Console::stats_part);
+    if (bq769x_conf.Modbus) print(&Console::modbus_part);
 }
 
 void Console::conf_default() {
     bq769x_conf.BQ_dbg            = false;
+    bq769x_conf.AlertDriven       = true;
+    bq769x_conf.OCV_Curve         = devices::OCV_NMC;
+    bq769x_conf.SOC_Mode          = devices::SOC_COULOMB;
+    bq769x_conf.Cells_Parallel    = 1;
+    bq769x_conf.Baud              = USART_BAUD_DEFAULT;
+    bq769x_conf.Modbus            = 0;
     bq769x_conf.Allow_Charging    = true;
     bq769x_conf.Allow_Discharging = true;
-    bq769x_conf.RT_bits    = BQ769X0_THERMISTORS;
+    bq769x_conf.RT_bits    = BQ::thermistorBits;
     bq769x_conf.RS_uOhm    = 1000; // Shunt, 1mOhm
-    bq769x_conf.RT_Beta[0] = 3435; // for Semitec 103AT-5 thermistor
-#ifdef IC_BQ76930
-    bq76940_conf.RT_Beta[1] = 3435;
-#endif
-#ifdef IC_BQ76940
-    bq769x_conf.RT_Beta[1] = 3435;
-    bq769x_conf.RT_Beta[2] = 3435;
-#endif
+    for (uint8_t i = 0; i < BQ::thermistors; i++) {
+        bq769x_conf.RT_Beta[i] = 3435; // for Semitec 103AT-5 thermistor
+    }
     // Capacity calc
     bq769x_conf.Cell_CapaNom_mV         = 3600;     // mV, nominal voltage for single cell
     bq769x_conf.Cell_CapaFull_mV        = 4180;     // mV, full voltage for single cell
@@ -143,9 +164,9 @@ void Console::conf_default() {
     
 }
 
-void Console::cmd_conf_print() { print_all_conf(); }
+void Console::cmd_conf_print() { print(&Console::conf_part); }
 
-void Console::cmd_stats_print() { print_all_stats(); }
+void Console::cmd_stats_print() { print(&Console::stats_part); }
 
 void Console::cmd_stats_save() {
     stats_save();
@@ -183,16 +204,89 @@ void Console::cmd_BQ_dbg() {
     print_conf(PrintParam::Conf_BQ_dbg);    
 }
 
+void Console::cmd_AlertDriven() {
+    if (param_len) {
+        bq769x_conf.AlertDriven = (bool)atoi(param);
+    }
+    print_conf(PrintParam::Conf_AlertDriven);
+}
+
+void Console::cmd_OCV_Curve() {
+    if (param_len) {
+        uint8_t c = atoi(param);
+        if (c < devices::NUM_OCV_CURVES) bq769x_conf.OCV_Curve = c;
+        else write_help(cout, STR_cmd_OCV_Curve, STR_cmd_OCV_Curve_HELP);
+    }
+    bq.resetSOC();
+    print_conf(PrintParam::Conf_OCV_Curve);
+    PRINT_P(cout, ", SOC {}%", bq.getSOC());
+}
+
+void Console::cmd_SOC_Mode() {
+    if (param_len) {
+        uint8_t m = atoi(param);
+        if (m <= devices::SOC_EKF) {
+            if (m != bq769x_conf.SOC_Mode) {
+                bq769x_conf.SOC_Mode = m;
+                bq.resetSOC(); // both estimators restart from OCV
+            }
+        } else write_help(cout, STR_cmd_SOC_Mode, STR_cmd_SOC_Mode_HELP);
+    }
+    print_conf(PrintParam::Conf_SOC_Mode);
+}
+
+void Console::cmd_Cells_Parallel() {
+    if (param_len) {
+        const uint8_t n = atoi(param);
+        if (n) bq769x_conf.Cells_Parallel = n;
+        else write_help(cout, STR_cmd_Cells_Parallel, STR_cmd_Cells_Parallel_HELP);
+    }
+    print_conf(PrintParam::Conf_Cells_Parallel);
+}
+
+void Console::cmd_Baud() {
+    if (param_len) {
+        const uint8_t b = atoi(param);
+        if (b < mcu::BAUD_COUNT) {
+            if (b != ser.baud()) {
+                baud_try(b);
+                return;
+            }
+        } else write_help(cout, STR_cmd_Baud, STR_cmd_Baud_HELP);
+    } else {
+        for (uint8_t i = 0; i < mcu::BAUD_COUNT; i++) {
+            const uint32_t rate = mcu::Usart::baud_rate(i);
+            PRINT_P(cout, " {} {} error {} ppm\r\n", i, rate, mcu::baud_error_ppm(rate));
+        }
+    }
+    print_conf(PrintParam::Conf_Baud);
+}
+
+void Console::cmd_Modbus() {
+    if (param_len) {
+        const uint8_t a = atoi(param);
+        if (a <= MB_ADDRESS_MAX) bq769x_conf.Modbus = a;
+        else write_help(cout, STR_cmd_Modbus, STR_cmd_Modbus_HELP);
+    }
+    print_conf(PrintParam::Conf_Modbus);
+}
+
+// The conf takes the rate once a command came in at it. The rate that
+// worked before comes back after BAUD_TRIAL_MS of silence or garbage.
+void Console::baud_try(const uint8_t i) {
+    PRINT_P(cout, "baud {}, send a command within 10 s\r\n", mcu::Usart::baud_rate(i));
+    if (!m_baudTrial) m_baudPrev = ser.baud();
+    ser.set_baud(i);
+    m_baudTrial = true;
+    m_baudSince = mcu::Timer::millis();
+}
+
 void Console::cmd_RT_bits() {
     if (param_len) {
-        if (param_len == 5) {
-            uint8_t a,b,c;
-            a = atoi(param);
-            b = atoi(param+2);
-            c = atoi(param+4);
-            if (a) bq769x_conf.RT_bits |= (1 << 0); else bq769x_conf.RT_bits &= ~(1 << 0);
-            if (b) bq769x_conf.RT_bits |= (1 << 1); else bq769x_conf.RT_bits &= ~(1 << 1);
-            if (c) bq769x_conf.RT_bits |= (1 << 2); else bq769x_conf.RT_bits &= ~(1 << 2);
+        if (param_len == 2 * BQ::thermistors - 1) {
+            for (uint8_t i = 0; i < BQ::thermistors; i++) {
+                if (atoi(param + 2 * i)) bq769x_conf.RT_bits |= (1 << i); else bq769x_conf.RT_bits &= ~(1 << i);
+            }
         } else write_help(cout, STR_cmd_RT_bits, STR_cmd_RT_bits_HELP);
     }
     print_conf(PrintParam::Conf_RT_bits);
@@ -210,10 +304,10 @@ void Console::cmd_RS_uOhm() {
 
 void Console::cmd_RT_Beta() {
     if (param_len) {
-        if (param_len == 14) {
-            bq769x_conf.RT_Beta[0] = atoi(param);
-            bq769x_conf.RT_Beta[1] = atoi(param+5);
-            bq769x_conf.RT_Beta[2] = atoi(param+10);
+        if (param_len == 5 * BQ::thermistors - 1) {
+            for (uint8_t i = 0; i < BQ::thermistors; i++) {
+                bq769x_conf.RT_Beta[i] = atoi(param + 5 * i);
+            }
         } else write_help(cout, STR_cmd_RT_Beta, STR_cmd_RT_Beta_HELP);
     }
     print_conf(PrintParam::Conf_RT_Beta);
@@ -464,11 +558,39 @@ void Console::print_conf(const PrintParam c) {
             bq769x_conf.BQ_dbg;
             cout << PGM << STR_cmd_BQ_dbg_HELP;
             break;
+        case Conf_AlertDriven:
+            cout << PGM << STR_cmd_AlertDriven << '=' <<
+            bq769x_conf.AlertDriven;
+            cout << PGM << STR_cmd_AlertDriven_HELP;
+            break;
+        case Conf_OCV_Curve:
+            cout << PGM << STR_cmd_OCV_Curve << '=' << bq769x_conf.OCV_Curve
+                 << ' ' << PGM << devices::ocv_name(bq769x_conf.OCV_Curve);
+            cout << PGM << STR_cmd_OCV_Curve_HELP;
+            break;
+        case Conf_SOC_Mode:
+            cout << PGM << STR_cmd_SOC_Mode << '=' << bq769x_conf.SOC_Mode;
+            cout << PGM << STR_cmd_SOC_Mode_HELP;
+            break;
+        case Conf_Cells_Parallel:
+            cout << PGM << STR_cmd_Cells_Parallel << '=' << bq769x_conf.Cells_Parallel;
+            cout << PGM << STR_cmd_Cells_Parallel_HELP;
+            break;
+        case Conf_Baud:
+            cout << PGM << STR_cmd_Baud;
+            PRINT_P(cout, "={} {}", bq769x_conf.Baud, mcu::Usart::baud_rate(bq769x_conf.Baud));
+            cout << PGM << STR_cmd_Baud_HELP;
+            break;
+        case Conf_Modbus:
+            cout << PGM << STR_cmd_Modbus << '=' << bq769x_conf.Modbus;
+            cout << PGM << STR_cmd_Modbus_HELP;
+            break;
         case Conf_RT_bits:
             cout << PGM << STR_cmd_RT_bits << '=';
-            if (bq769x_conf.RT_bits & (1 << 0)) cout << '1'; else cout << '0'; cout << ' ';
-            if (bq769x_conf.RT_bits & (1 << 1)) cout << '1'; else cout << '0'; cout << ' ';
-            if (bq769x_conf.RT_bits & (1 << 2)) cout << '1'; else cout << '0';
+            for (uint8_t i = 0; i < BQ::thermistors; i++) {
+                if (i) cout << ' ';
+                if (bq769x_conf.RT_bits & (1 << i)) cout << '1'; else cout << '0';
+            }
             cout << PGM << STR_cmd_RT_bits_HELP;
             break;
             
@@ -479,10 +601,11 @@ void Console::print_conf(const PrintParam c) {
             break;
             
         case Conf_RT_Beta:
-            cout << PGM << STR_cmd_RT_Beta << '=' <<
-            bq769x_conf.RT_Beta[0] << ' ' <<
-            bq769x_conf.RT_Beta[1] << ' ' <<
-            bq769x_conf.RT_Beta[2];
+            cout << PGM << STR_cmd_RT_Beta << '=';
+            for (uint8_t i = 0; i < BQ::thermistors; i++) {
+                if (i) cout << ' ';
+                cout << bq769x_conf.RT_Beta[i];
+            }
             cout << PGM << STR_cmd_RT_Beta_HELP;
             break;
             
@@ -625,15 +748,16 @@ void Console::print_conf(const PrintParam c) {
             break;
             
         case Conf_adcCellsOffset:
-            cout << "TODO";
+            cout << PGM << PSTR("Cells offset mV:");
+            for (uint8_t i = 0; i < BQ::cells; i++) PRINT_P(cout, " {}", bq769x_conf.adcCellsOffset_[i]);
             break;
             
         case Conf_ts:
-            cout << "TS: " << bq769x_conf.ts;
+            PRINT_P(cout, "TS: {}", bq769x_conf.ts);
             break;
             
         case Conf_CRC8:
-            cout << "CRC8: " << bq769x_conf.crc8;
+            PRINT_P(cout, "CRC8: {}", bq769x_conf.crc8);
             break;
         default: {
             cout << '?';
@@ -641,92 +765,126 @@ void Console::print_conf(const PrintParam c) {
     }
 }
 
-void Console::print_all_conf() {
-    for (uint8_t i = FIRST ; i <= LAST; i++) {
-        print_conf((PrintParam)i);
-        cout << EOL;
-    }
-}
-char const STR_TS[] PROGMEM = " timestamp = ";
-
-void Console::print_all_stats() {
-    cout
-        << PGM << PSTR("ADC Gain=") << bq769x_stats.adcGain_
-        << PGM << PSTR(" Offset=")  << bq769x_stats.adcOffset_
-        << PGM << PSTR("\r\nBAT Cycles=") << bq769x_stats.batCycles_
-        << PGM << PSTR(" Charged times=")  << bq769x_stats.chargedTimes_
-        << PGM << PSTR("\r\nLook Cell mVmin=") << bq769x_stats.idCellMinVoltage_
-        << PGM << PSTR(" mVmax=")  << bq769x_stats.idCellMaxVoltage_
-        << PGM << PSTR("\r\nTimestamp idle=") << bq769x_stats.idleTimestamp_
-        << PGM << PSTR(" charge=")  << bq769x_stats.chargeTimestamp_
-        << PGM << PSTR(" saved in EEPROM=")  << bq769x_stats.ts;
-        
-    cout
-        << PGM << PSTR("\r\nErrors counter:")
-        << PGM << PSTR("\r\nXREADY = ") << bq769x_stats.errorCounter_[devices::ERROR_XREADY] << PGM << STR_TS << bq769x_stats.errorTimestamps_[devices::ERROR_XREADY]
-        << PGM << PSTR("\r\n ALERT = ") << bq769x_stats.errorCounter_[devices::ERROR_ALERT] << PGM << STR_TS << bq769x_stats.errorTimestamps_[devices::ERROR_ALERT]
-        << PGM << PSTR("\r\n   UVP = ") << bq769x_stats.errorCounter_[devices::ERROR_UVP] << PGM << STR_TS << bq769x_stats.errorTimestamps_[devices::ERROR_UVP]
-        << PGM << PSTR("\r\n   OVP = ") << bq769x_stats.errorCounter_[devices::ERROR_OVP] << PGM << STR_TS << bq769x_stats.errorTimestamps_[devices::ERROR_OVP]
-        << PGM << PSTR("\r\n   SCD = ") << bq769x_stats.errorCounter_[devices::ERROR_SCD] << PGM << STR_TS << bq769x_stats.errorTimestamps_[devices::ERROR_SCD]
-        << PGM << PSTR("\r\n   OCD = ") << bq769x_stats.errorCounter_[devices::ERROR_OCD] << PGM << STR_TS << bq769x_stats.errorTimestamps_[devices::ERROR_OCD]
-        << PGM << PSTR("\r\n     USR_SWITCH = ") << bq769x_stats.errorCounter_[devices::ERROR_USER_SWITCH] << PGM << STR_TS << bq769x_stats.errorTimestamps_[devices::ERROR_USER_SWITCH]
-        << PGM << PSTR("\r\nUSR_DISCHG_TEMP = ") << bq769x_stats.errorCounter_[devices::ERROR_USER_DISCHG_TEMP] << PGM << STR_TS << bq769x_stats.errorTimestamps_[devices::ERROR_USER_DISCHG_TEMP]
-        << PGM << PSTR("\r\n   USR_CHG_TEMP = ") << bq769x_stats.errorCounter_[devices::ERROR_USER_CHG_TEMP] << PGM << STR_TS << bq769x_stats.errorTimestamps_[devices::ERROR_USER_CHG_TEMP]
-        << PGM << PSTR("\r\n    USR_CHG_OCD = ") << bq769x_stats.errorCounter_[devices::ERROR_USER_CHG_OCD] << PGM << STR_TS << bq769x_stats.errorTimestamps_[devices::ERROR_USER_CHG_OCD];
-
-    cout << PGM << PSTR("\r\nCell ID Map:\r\n");
-    for (uint8_t i = 0; i < MAX_NUMBER_OF_CELLS; i++) {
-        cout << i << " = " << bq769x_stats.cellIdMap_[i] << '\t';
+bool Console::conf_part(const uint8_t i) {
+    print_conf((PrintParam)(FIRST + i));
+    cout << EOL;
+    return FIRST + i < LAST;
+}
+
+namespace {
+
+// stats_part() error lines, in BQ769xERR order
+char const STATS_ERRORS[devices::NUM_ERRORS][22] PROGMEM = {
+    "\r\nXREADY = ",
+    "\r\n ALERT = ",
+    "\r\n   UVP = ",
+    "\r\n   OVP = ",
+    "\r\n   SCD = ",
+    "\r\n   OCD = ",
+    "\r\n     USR_SWITCH = ",
+    "\r\nUSR_DISCHG_TEMP = ",
+    "\r\n   USR_CHG_TEMP = ",
+    "\r\n    USR_CHG_OCD = ",
+};
+
+}
+
+bool Console::stats_part(uint8_t i) {
+    switch (i) {
+        case 0:
+            PRINT_P(cout, "ADC Gain={} Offset={}", bq769x_stats.adcGain_, bq769x_stats.adcOffset_);
+            return true;
+        case 1:
+            PRINT_P(cout, "\r\nBAT Cycles={} Charged times={}", bq769x_stats.batCycles_, bq769x_stats.chargedTimes_);
+            return true;
+        case 2:
+            PRINT_P(cout, "\r\nLook Cell mVmin={} mVmax={}",
+                    bq769x_stats.idCellMinVoltage_, bq769x_stats.idCellMaxVoltage_);
+            return true;
+        case 3:
+            PRINT_P(cout, "\r\nTimestamp idle={} charge={} saved in EEPROM={}",
+                    bq769x_stats.idleTimestamp_, bq769x_stats.chargeTimestamp_, bq769x_stats.ts);
+            return true;
+        case 4:
+            PRINT_P(cout, "\r\nLifetime in mAh={} mWh={}", bq769x_stats.chargeIn_mAh_, bq769x_stats.energyIn_mWh_);
+            return true;
+        case 5:
+            PRINT_P(cout, "\r\nLifetime out mAh={} mWh={}\r\nErrors counter:",
+                    bq769x_stats.chargeOut_mAh_, bq769x_stats.energyOut_mWh_);
+            return true;
+    }
+    i -= 6;
+    if (i < devices::NUM_ERRORS) {
+        cout << PGM << STATS_ERRORS[i];
+        PRINT_P(cout, "{} timestamp = {}", bq769x_stats.errorCounter_[i], bq769x_stats.errorTimestamps_[i]);
+        if (i == devices::NUM_ERRORS - 1) cout << PGM << PSTR("\r\nCell ID Map:\r\n");
+        return true;
+    }
+    i -= devices::NUM_ERRORS;
+    if (i < BQ::cells) {
+        PRINT_P(cout, "{} = {}\t", i, bq769x_stats.cellIdMap_[i]);
         if ((i+1) % 3 == 0) cout << EOL;
+        if (i == BQ::cells - 1) cout << PGM << PSTR("Cell Voltages:\r\n");
+        return true;
     }
-    cout << PGM << PSTR("Cell Voltages:\r\n");
-    for (uint8_t i = 0; i < MAX_NUMBER_OF_CELLS; i++) {
-        cout << i << " = " << bq769x_stats.cellVoltages_[i] << " mV\t";
+    i -= BQ::cells;
+    if (i < BQ::cells) {
+        PRINT_P(cout, "{} = {} mV\t", i, bq769x_stats.cellVoltages_[i]);
         if ((i+1) % 3 == 0) cout << EOL;
+        return true;
     }
-    cout << PGM << PSTR("Temperatures x10C: ");
-    for (uint8_t i = 0; i < MAX_NUMBER_OF_THERMISTORS; i++) {
-        cout << i << " = " << bq769x_stats.temperatures_[i] << ' ';
+    cout << PGM << PSTR("Temperatures C: ");
+    for (uint8_t t = 0; t < BQ::thermistors; t++) {
+        PRINT_P(cout, "{} = {.1} ", t, bq769x_stats.temperatures_[t]);
     }
+    return false;
 }
 
+bool Console::regs_part(const uint8_t i) { return bq.printRegisters(i); }
 
-devices::bq769_stats EEMEM In_EEPROM_stats;
+// the boot dump is over, the master may start
+bool Console::modbus_part(const uint8_t) {
+    modbus_begin(bq769x_conf.Modbus);
+    return false;
+}
+
+
+devices::bq769_stats<BQ> EEMEM In_EEPROM_stats;
 
 void Console::stats_load() {
     cout << PGM << PSTR("Stats load ");
     eeprom_read_block(&bq769x_stats, &In_EEPROM_stats, sizeof(bq769x_stats));
-    if (bq769x_stats.crc8 != gencrc8((uint8_t*)&bq769x_stats, sizeof(bq769x_stats)-1)) {
+    if (bq769x_stats.crc8 != utils::crc8((const uint8_t*)&bq769x_stats, sizeof(bq769x_stats)-1)) {
         cout << PGM << PSTR("bad crc, restore zero");
         memset(&bq769x_stats, 0, sizeof(bq769x_stats));
         stats_save();
-    } else cout << "OK";
+    } else cout << PGM << PSTR("OK");
     cout << EOL;
 }
 
 void Console::stats_save() {
     bq769x_stats.ts = mcu::Timer::millis();
-    bq769x_stats.crc8 = gencrc8((uint8_t*)&bq769x_stats, sizeof(bq769x_stats)-1);
+    bq769x_stats.crc8 = utils::crc8((const uint8_t*)&bq769x_stats, sizeof(bq769x_stats)-1);
     eeprom_write_block(&bq769x_stats, &In_EEPROM_stats, sizeof(bq769x_stats));
 }
 
-devices::bq769_conf  EEMEM In_EEPROM_conf;
+devices::bq769_conf<BQ>  EEMEM In_EEPROM_conf;
 
 void Console::conf_load() {
     cout << PGM << PSTR("Conf load ");
     eeprom_read_block(&bq769x_conf, &In_EEPROM_conf, sizeof(bq769x_conf));
-    if (bq769x_conf.crc8 != gencrc8((uint8_t*)&bq769x_conf, sizeof(bq769x_conf)-1)) {
+    if (bq769x_conf.crc8 != utils::crc8((const uint8_t*)&bq769x_conf, sizeof(bq769x_conf)-1)) {
         conf_default();
         cout << PGM << PSTR("bad crc, restore defs");
         conf_save();
-    } else cout << "OK";
+    } else cout << PGM << PSTR("OK");
     cout << EOL;
 }
 
 
 void Console::conf_save() {
     bq769x_conf.ts = mcu::Timer::millis();
-    bq769x_conf.crc8 = gencrc8((uint8_t*)&bq769x_conf, sizeof(bq769x_conf)-1);
+    bq769x_conf.crc8 = utils::crc8((const uint8_t*)&bq769x_conf, sizeof(bq769x_conf)-1);
     eeprom_write_block(&bq769x_conf, &In_EEPROM_conf, sizeof(bq769x_conf));
 }
     
@@ -739,14 +897,28 @@ void Console::write_help(stream::OutputStream &out, const char *cmd, const char
 
 bool Console::update(mcu::Pin job, const bool force) {
     bool result = force;
-    bq769x_data.alertInterruptFlag_ = force;
+    if (force && bq769x_conf.AlertDriven) {
+        // ALERT edge: fresh CC sample or a fault. CC_READY comes every
+        // 250 ms, so only a fault counts as activity
+        result = (bq.serviceAlert() != 0);
+    }
     uint32_t now = mcu::Timer::millis();
-    if(now - m_lastUpdate >= 250) { // 250
-//     if(force || (uint32_t)(now - m_lastUpdate) >= 250) { // 250
+    if(now - m_lastUpdate >= BQ_UPDATE_MS) {
+        // queue the bus reads, the console keeps running until they land
+        if (bq.requestSample()) {
+            // something held the loop: counted, debug_part() shows it
+            const uint32_t late = now - m_lastUpdate - BQ_UPDATE_MS;
+            if (m_lastUpdate && late > UPDATE_SLACK_MS) {
+                m_updateMisses++;
+                if (late > m_updateLateMax) m_updateLateMax = late > 0xFFFF ? 0xFFFF : late;
+            }
+            m_lastUpdate = now;
+        }
+    }
+    if (bq.sampleReady()) {
         result = false;
         job = 1;
         uint8_t error = bq.update(); // should be called at least every 250 ms
-        m_lastUpdate = now;
         if(error & STAT_OV)  { cout << PGM << PSTR("Overvoltage!\r\n"); }
         if(error & STAT_UV)  {
             cout << PGM << PSTR("Undervoltage!\r\n");
@@ -755,6 +927,8 @@ bool Console::update(mcu::Pin job, const bool force) {
         }
         if(error & STAT_SCD) { cout << PGM << PSTR("Short Circuit Protection!\r\n"); }
         if(error & STAT_OCD) { cout << PGM << PSTR("Overcurrent Charge Protection!\r\n"); }
+        tel.converted(error);
+        modbus.converted(error);
         if (bq769x_stats.batCycles_ != m_BatCycles_prev) {
             m_BatCycles_prev    = bq769x_stats.batCycles_;
             stats_save();
@@ -763,6 +937,12 @@ bool Console::update(mcu::Pin job, const bool force) {
             m_ChargedTimes_prev = bq769x_stats.chargedTimes_;
             stats_save();
         }
+        // lifetime counters, once per Ah moved in either direction
+        uint32_t throughput = (bq769x_stats.chargeIn_mAh_ + bq769x_stats.chargeOut_mAh_) / 1000;
+        if (throughput != m_Throughput_Ah_prev) {
+            m_Throughput_Ah_prev = throughput;
+            stats_save();
+        }
         uint16_t bigDelta = bq.getMaxCellVoltage() - bq.getMinCellVoltage();
         if(bigDelta > 100) cout << PGM << PSTR("Difference too big!\r\n");
         if(m_oldMillis > now)
@@ -774,67 +954,223 @@ bool Console::update(mcu::Pin job, const bool force) {
 }
 
 
-void Console::command_restore() { conf_default(); conf_begin_protect(); }
+void Console::command_restore() {
+    conf_default();
+    conf_begin_protect();
+    if (bq769x_conf.Baud != ser.baud()) baud_try(bq769x_conf.Baud);
+}
 void Console::command_save()    { conf_save(); }
-void Console::command_print()   { debug_print(); }
-void Console::command_bqregs()  { bq.printRegisters(); }
+void Console::command_print()   { print(&Console::debug_part); }
+void Console::command_bqregs()  { print(&Console::regs_part); }
 void Console::command_wdreset()  {
     stats_save();
+    ser.flush();
     mcu::Watchdog::forceRestart(); //for (;;) { (void)0; }
 }
-void Console::command_freemem() { cout << PGM << PSTR(" Free RAM:") << get_free_mem() << EOL; }
+void Console::command_freemem() { PRINT_P(cout, " Free RAM:{}\r\n", get_free_mem()); }
+
+void Console::command_ntc() {
+    const uint16_t beta = param_len ? atoi(param) : bq769x_conf.RT_Beta[0];
+    PRINT_P(cout, "NTC beta {}", beta);
+    cout << PGM << (devices::ntc::tabulated(beta) ? PSTR(", table") : PSTR(", ln fallback")) << EOL;
+    int16_t worst = 0;
+    // every 4th code of a segment from about +120 to -40 degC, its worst one
+    uint16_t code = 0;
+    for (uint8_t s = 0; s < NTC_SEGMENTS; s++) {
+        const uint16_t end = pgm_read_word(&devices::ntc::SEGMENTS[s].end);
+        int16_t seg = -1;
+        uint16_t segCode = 0;
+        int16_t segT = 0, segRef = 0;
+        for (; code < end; code += 4) {
+            const int16_t t = devices::ntc_temperature(code, beta);
+            const float v = code * (float)devices::ntc::LSB_MV;
+            const float k = 1.0 / (1.0 / devices::ntc::T0_K + log(v / (devices::ntc::VREF_MV - v)) / beta);
+            if (!(k >= 233.15 && k <= 393.15)) continue;     // NaN past VREF too
+            const int16_t ref = lround((k - 273.15) * 10.0);
+            if (abs(t - ref) > seg) {
+                seg = abs(t - ref);
+                segCode = code;
+                segT = t;
+                segRef = ref;
+            }
+        }
+        mcu::Watchdog::reset();
+        if (seg < 0) continue;
+        if (seg > worst) worst = seg;
+        PRINT_P(cout, " {} {} {} {}\r\n", segCode, segT, segRef, (int16_t)(segT - segRef));
+    }
+    PRINT_P(cout, " max error C/10: {}\r\n", worst);
+}
+
+void Console::command_ekf() {
+    // one filter step on a copy, the live estimate is not touched
+    devices::SocEkf ekf = bq.getEkf();
+    const uint16_t cell = bq.getAvgCellVoltage();
+    const int32_t current = bq769x_data.batCurrent_;
+    mcu::Cycles::start();
+    ekf.predict(current, 250, bq769x_conf.Batt_CapaNom_mAsec);
+    ekf.correct(cell, current, bq769x_conf.OCV_Curve);
+    uint32_t cycles = mcu::Cycles::stop();
+    const devices::SocEkf &live = bq.getEkf();
+    PRINT_P(cout, "EKF SOC {.2} +/- {.2} %, Vrc {} mV, step {} cycles\r\n",
+            live.soc(), live.sigma(), live.vrc(), cycles);
+}
+
+void Console::command_binary() { tel.begin(); }
+
+// the period in whole conversions, the stream rides on update()
+void Console::command_stream() {
+    const uint32_t ms = param_len ? atol(param) : TEL_CONVERSION_MS;
+    uint32_t every = (ms + TEL_CONVERSION_MS / 2) / TEL_CONVERSION_MS;
+    if (!every) every = 1;
+    if (every > 255) every = 255;
+    tel.begin();
+    tel.stream(every);
+}
+
+// the conf's address, 1 if it boots the console
+void Console::command_modbus() {
+    const uint8_t a = param_len ? atoi(param) : bq769x_conf.Modbus ? bq769x_conf.Modbus : 1;
+    if (!a || a > MB_ADDRESS_MAX) {
+        write_help(cout, STR_CMD_MODBUS, STR_CMD_MODBUS_HLP);
+        return;
+    }
+    modbus_begin(a);
+}
+
+void Console::modbus_begin(const uint8_t address) {
+    PRINT_P(cout, "Modbus RTU slave {} at {}\r\n", address, mcu::Usart::baud_rate(ser.baud()));
+    modbus.begin(address);
+}
+
+void Console::command_crcbench() {
+    const uint16_t len = sizeof(bq769x_conf);
+    mcu::Cycles::start();
+    uint8_t crc = utils::crc8((const uint8_t*)&bq769x_conf, len);
+    uint32_t cycles = mcu::Cycles::stop();
+    PRINT_P(cout, "CRC8 impl {}: {} bytes, {} cycles, {} per byte, crc {}\r\n",
+            (uint8_t)CRC8_IMPL, len, cycles, (uint32_t)(cycles / len), crc);
+}
+
+namespace {
+
+// counts what it is given, the formatting is all that costs
+class NullStream : public stream::OutputStream {
+public:
+    uint16_t bytes = 0;
+protected:
+    void write(const char) override { bytes++; }
+    void write(const char *, const uint8_t len) override { bytes += len; }
+};
+
+// cell mV, current, pack mV, timestamp, temperature, counters
+const int32_t FMT_FIELDS[] PROGMEM = { 3650, -12345, 55500, 4294967, -250, 25, 7, 1000000000 };
+constexpr uint8_t FMT_COUNT = sizeof(FMT_FIELDS) / sizeof(FMT_FIELDS[0]);
+
+}
+
+// the same fields the way the stream printed them before, and now
+void Console::command_fmtbench() {
+    NullStream out;
+    char buf[12];
+    mcu::Cycles::start();
+    for (uint8_t i = 0; i < FMT_COUNT; i++) {
+        ltoa(pgm_read_dword(&FMT_FIELDS[i]), buf, 10);
+        out << buf;
+    }
+    const uint32_t before = mcu::Cycles::stop();
+    mcu::Cycles::start();
+    for (uint8_t i = 0; i < FMT_COUNT; i++) out << (int32_t)pgm_read_dword(&FMT_FIELDS[i]);
+    const uint32_t cycles = mcu::Cycles::stop();
+    PRINT_P(cout, "{} fields, {} bytes: ltoa {}, stream {} cycles per field\r\n",
+            FMT_COUNT, (uint16_t)(out.bytes / 2), before / FMT_COUNT, cycles / FMT_COUNT);
+}
 
 void Console::command_shutdown() {
     stats_save();
     cout << PGM << STR_CMD_SHUTDOWN_HLP;
+    ser.flush();    // SHIP mode cuts the supply
     bq.shutdown();
 }
 
-void Console::command_help() {
-    cout << PGM << PSTR("Available commands:\r\n") << EOL;
-    write_help(cout, STR_cmd_conf_print,    STR_cmd_conf_print_HELP);
-    write_help(cout, STR_cmd_stats_print,   STR_cmd_stats_print_HELP);
-    write_help(cout, STR_cmd_stats_save,    STR_cmd_stats_save_HELP);
-    write_help(cout, STR_CMD_RESTORE,       STR_CMD_RESTORE_HLP);
-    write_help(cout, STR_CMD_SAVE,          STR_CMD_SAVE_HLP);
-    write_help(cout, STR_CMD_BQREGS,        STR_CMD_BQREGS_HLP);
-    write_help(cout, STR_CMD_PRINT,         STR_CMD_PRINT_HLP);
-    write_help(cout, STR_CMD_WDRESET,       STR_CMD_WDRESET_HLP);
-    write_help(cout, STR_CMD_BOOTLOADER,    STR_CMD_BOOTLOADER_HLP);
-    write_help(cout, STR_CMD_FREEMEM,       STR_CMD_FREEMEM_HLP);
-    write_help(cout, STR_CMD_EPFORMAT,      STR_CMD_EPFORMAT_HLP);
-    write_help(cout, STR_CMD_HELP,          STR_CMD_HELP_HLP);
-    write_help(cout, STR_CMD_SHUTDOWN,      STR_CMD_SHUTDOWN_HLP);
-    write_help(cout, STR_cmd_Allow_Charging,    STR_cmd_Allow_Charging_HELP);
-    write_help(cout, STR_cmd_Allow_Discharging, STR_cmd_Allow_Discharging_HELP);
-    write_help(cout, STR_cmd_BQ_dbg,            STR_cmd_BQ_dbg_HELP); 
-    write_help(cout, STR_cmd_RT_bits,           STR_cmd_RT_bits_HELP); 
-    write_help(cout, STR_cmd_RS_uOhm,           STR_cmd_RS_uOhm_HELP); 
-    write_help(cout, STR_cmd_RT_Beta,           STR_cmd_RT_Beta_HELP); 
-    write_help(cout, STR_cmd_Cell_CapaNom_mV,   STR_cmd_Cell_CapaNom_mV_HELP); 
-    write_help(cout, STR_cmd_Cell_CapaFull_mV,          STR_cmd_Cell_CapaFull_mV_HELP); 
-    write_help(cout, STR_cmd_Batt_CapaNom_mAsec,        STR_cmd_Batt_CapaNom_mAsec_HELP); 
-    write_help(cout, STR_cmd_CurrentThresholdIdle_mA,   STR_cmd_CurrentThresholdIdle_mA_HELP); 
-    write_help(cout, STR_cmd_Cell_TempCharge_min,       STR_cmd_Cell_TempCharge_min_HELP); 
-    write_help(cout, STR_cmd_Cell_TempCharge_max,       STR_cmd_Cell_TempCharge_max_HELP); 
-    write_help(cout, STR_cmd_Cell_TempDischarge_min,    STR_cmd_Cell_TempDischarge_min_HELP); 
-    write_help(cout, STR_cmd_Cell_TempDischarge_max,    STR_cmd_Cell_TempDischarge_max_HELP); 
-    write_help(cout, STR_cmd_BalancingInCharge,         STR_cmd_BalancingInCharge_HELP); 
-    write_help(cout, STR_cmd_BalancingEnable,           STR_cmd_BalancingEnable_HELP); 
-    write_help(cout, STR_cmd_BalancingCellMin_mV,       STR_cmd_BalancingCellMin_mV_HELP); 
-    write_help(cout, STR_cmd_BalancingCellMaxDifference_mV,  STR_cmd_BalancingCellMaxDifference_mV_HELP); 
-    write_help(cout, STR_cmd_BalancingIdleTimeMin_s,  STR_cmd_BalancingIdleTimeMin_s_HELP); 
-    write_help(cout, STR_cmd_Cell_OCD_mA,   STR_cmd_Cell_OCD_mA_HELP); 
-    write_help(cout, STR_cmd_Cell_OCD_ms,   STR_cmd_Cell_OCD_ms_HELP); 
-    write_help(cout, STR_cmd_Cell_SCD_mA,   STR_cmd_Cell_SCD_mA_HELP); 
-    write_help(cout, STR_cmd_Cell_SCD_us,   STR_cmd_Cell_SCD_us_HELP); 
-    write_help(cout, STR_cmd_Cell_ODP_mA,   STR_cmd_Cell_ODP_mA_HELP); 
-    write_help(cout, STR_cmd_Cell_ODP_ms,   STR_cmd_Cell_ODP_ms_HELP); 
-    write_help(cout, STR_cmd_Cell_OVP_mV,   STR_cmd_Cell_OVP_mV_HELP); 
-    write_help(cout, STR_cmd_Cell_OVP_sec,  STR_cmd_Cell_OVP_sec_HELP); 
-    write_help(cout, STR_cmd_Cell_UVP_mV,   STR_cmd_Cell_UVP_mV_HELP); 
-    write_help(cout, STR_cmd_Cell_UVP_sec,  STR_cmd_Cell_UVP_sec_HELP);    
+namespace {
+
+struct HelpLine { const char *cmd; const char *help; };
+
+const HelpLine HELP_LINES[] PROGMEM = {
+    { STR_cmd_conf_print,                    STR_cmd_conf_print_HELP },
+    { STR_cmd_stats_print,                   STR_cmd_stats_print_HELP },
+    { STR_cmd_stats_save,                    STR_cmd_stats_save_HELP },
+    { STR_CMD_RESTORE,                       STR_CMD_RESTORE_HLP },
+    { STR_CMD_SAVE,                          STR_CMD_SAVE_HLP },
+    { STR_CMD_BQREGS,                        STR_CMD_BQREGS_HLP },
+    { STR_CMD_PRINT,                         STR_CMD_PRINT_HLP },
+    { STR_CMD_WDRESET,                       STR_CMD_WDRESET_HLP },
+    { STR_CMD_BOOTLOADER,                    STR_CMD_BOOTLOADER_HLP },
+    { STR_CMD_FREEMEM,                       STR_CMD_FREEMEM_HLP },
+    { STR_CMD_CRCBENCH,                      STR_CMD_CRCBENCH_HLP },
+    { STR_CMD_FMTBENCH,                      STR_CMD_FMTBENCH_HLP },
+    { STR_CMD_NTC,                           STR_CMD_NTC_HLP },
+    { STR_CMD_EKF,                           STR_CMD_EKF_HLP },
+    { STR_CMD_BINARY,                        STR_CMD_BINARY_HLP },
+    { STR_CMD_STREAM,                        STR_CMD_STREAM_HLP },
+    { STR_CMD_MODBUS,                        STR_CMD_MODBUS_HLP },
+    { STR_CMD_EPFORMAT,                      STR_CMD_EPFORMAT_HLP },
+    { STR_CMD_HELP,                          STR_CMD_HELP_HLP },
+    { STR_CMD_SHUTDOWN,                      STR_CMD_SHUTDOWN_HLP },
+    { STR_cmd_Allow_Charging,                STR_cmd_Allow_Charging_HELP },
+    { STR_cmd_Allow_Discharging,             STR_cmd_Allow_Discharging_HELP },
+    { STR_cmd_BQ_dbg,                        STR_cmd_BQ_dbg_HELP },
+    { STR_cmd_AlertDriven,                   STR_cmd_AlertDriven_HELP },
+    { STR_cmd_OCV_Curve,                     STR_cmd_OCV_Curve_HELP },
+    { STR_cmd_SOC_Mode,                      STR_cmd_SOC_Mode_HELP },
+    { STR_cmd_Cells_Parallel,                STR_cmd_Cells_Parallel_HELP },
+    { STR_cmd_Baud,                          STR_cmd_Baud_HELP },
+    { STR_cmd_Modbus,                        STR_cmd_Modbus_HELP },
+    { STR_cmd_RT_bits,                       STR_cmd_RT_bits_HELP },
+    { STR_cmd_RS_uOhm,                       STR_cmd_RS_uOhm_HELP },
+    { STR_cmd_RT_Beta,                       STR_cmd_RT_Beta_HELP },
+    { STR_cmd_Cell_CapaNom_mV,               STR_cmd_Cell_CapaNom_mV_HELP },
+    { STR_cmd_Cell_CapaFull_mV,              STR_cmd_Cell_CapaFull_mV_HELP },
+    { STR_cmd_Batt_CapaNom_mAsec,            STR_cmd_Batt_CapaNom_mAsec_HELP },
+    { STR_cmd_CurrentThresholdIdle_mA,       STR_cmd_CurrentThresholdIdle_mA_HELP },
+    { STR_cmd_Cell_TempCharge_min,           STR_cmd_Cell_TempCharge_min_HELP },
+    { STR_cmd_Cell_TempCharge_max,           STR_cmd_Cell_TempCharge_max_HELP },
+    { STR_cmd_Cell_TempDischarge_min,        STR_cmd_Cell_TempDischarge_min_HELP },
+    { STR_cmd_Cell_TempDischarge_max,        STR_cmd_Cell_TempDischarge_max_HELP },
+    { STR_cmd_BalancingInCharge,             STR_cmd_BalancingInCharge_HELP },
+    { STR_cmd_BalancingEnable,               STR_cmd_BalancingEnable_HELP },
+    { STR_cmd_BalancingCellMin_mV,           STR_cmd_BalancingCellMin_mV_HELP },
+    { STR_cmd_BalancingCellMaxDifference_mV, STR_cmd_BalancingCellMaxDifference_mV_HELP },
+    { STR_cmd_BalancingIdleTimeMin_s,        STR_cmd_BalancingIdleTimeMin_s_HELP },
+    { STR_cmd_Cell_OCD_mA,                   STR_cmd_Cell_OCD_mA_HELP },
+    { STR_cmd_Cell_OCD_ms,                   STR_cmd_Cell_OCD_ms_HELP },
+    { STR_cmd_Cell_SCD_mA,                   STR_cmd_Cell_SCD_mA_HELP },
+    { STR_cmd_Cell_SCD_us,                   STR_cmd_Cell_SCD_us_HELP },
+    { STR_cmd_Cell_ODP_mA,                   STR_cmd_Cell_ODP_mA_HELP },
+    { STR_cmd_Cell_ODP_ms,                   STR_cmd_Cell_ODP_ms_HELP },
+    { STR_cmd_Cell_OVP_mV,                   STR_cmd_Cell_OVP_mV_HELP },
+    { STR_cmd_Cell_OVP_sec,                  STR_cmd_Cell_OVP_sec_HELP },
+    { STR_cmd_Cell_UVP_mV,                   STR_cmd_Cell_UVP_mV_HELP },
+    { STR_cmd_Cell_UVP_sec,                  STR_cmd_Cell_UVP_sec_HELP },
+};
+
+constexpr uint8_t HELP_COUNT = sizeof(HELP_LINES) / sizeof(HELP_LINES[0]);
+
+}
+
+void Console::command_help() { print(&Console::help_part); }
+
+bool Console::help_part(const uint8_t i) {
+    if (!i) {
+        cout << PGM << PSTR("Available commands:\r\n") << EOL;
+        return true;
+    }
+    const HelpLine *h = &HELP_LINES[i - 1];
+    write_help(cout, (const char *)pgm_read_ptr(&h->cmd), (const char *)pgm_read_ptr(&h->help));
+    if (i < HELP_COUNT) return true;
     cout << EOL;
+    return false;
 }
 
 
@@ -869,12 +1205,25 @@ bool Console::handleCommand(const char *buffer, const uint8_t len) {
     compare_cmd(STR_CMD_WDRESET,                &Console::command_wdreset);
     compare_cmd(STR_CMD_BOOTLOADER,             &Console::command_bootloader);
     compare_cmd(STR_CMD_FREEMEM,                &Console::command_freemem);
+    compare_cmd(STR_CMD_CRCBENCH,               &Console::command_crcbench);
+    compare_cmd(STR_CMD_FMTBENCH,               &Console::command_fmtbench);
+    compare_cmd(STR_CMD_NTC,                    &Console::command_ntc);
+    compare_cmd(STR_CMD_EKF,                    &Console::command_ekf);
+    compare_cmd(STR_CMD_BINARY,                 &Console::command_binary);
+    compare_cmd(STR_CMD_STREAM,                 &Console::command_stream);
+    compare_cmd(STR_CMD_MODBUS,                 &Console::command_modbus);
     compare_cmd(STR_CMD_EPFORMAT,               &Console::command_format_EEMEM);
     compare_cmd(STR_CMD_HELP,                   &Console::command_help);
     compare_cmd(STR_CMD_SHUTDOWN,               &Console::command_shutdown);
     compare_cmd(STR_cmd_Allow_Charging,         &Console::cmd_Allow_Charging);
     compare_cmd(STR_cmd_Allow_Discharging,      &Console::cmd_Allow_Discharging);
     compare_cmd(STR_cmd_BQ_dbg,                 &Console::cmd_BQ_dbg);
+    compare_cmd(STR_cmd_AlertDriven,            &Console::cmd_AlertDriven);
+    compare_cmd(STR_cmd_OCV_Curve,              &Console::cmd_OCV_Curve);
+    compare_cmd(STR_cmd_SOC_Mode,               &Console::cmd_SOC_Mode);
+    compare_cmd(STR_cmd_Cells_Parallel,         &Console::cmd_Cells_Parallel);
+    compare_cmd(STR_cmd_Baud,                   &Console::cmd_Baud);
+    compare_cmd(STR_cmd_Modbus,                 &Console::cmd_Modbus);
     compare_cmd(STR_cmd_RT_bits,                &Console::cmd_RT_bits);
     compare_cmd(STR_cmd_RS_uOhm,                &Console::cmd_RS_uOhm);
     compare_cmd(STR_cmd_RT_Beta,                &Console::cmd_RT_Beta);
@@ -906,107 +1255,204 @@ bool Console::handleCommand(const char *buffer, const uint8_t len) {
     return handle_result;
 }
 
+//----------------------------------------------------------------------------
+// Long outputs are printers run a part per call by print_step(), so the
+// main loop never waits on the wire: a part goes out only if the TX queue
+// has room for all of it and no sample is due, the sample comes first.
+// The prompt of the command that queued them follows the last part, the
+// next line waits in the editor until then.
+
+void Console::print(const PrintPart part) {
+    if (m_printCount < PRINT_QUEUE) m_print[m_printCount++] = part;
+}
+
+bool Console::bq_due() {
+    return mcu::Timer::millis() - m_lastUpdate >= BQ_UPDATE_MS || bq.sampleReady();
+}
+
+void Console::print_step() {
+    while (m_printCount && !bq_due()
+           && ser.tx_free() >= PRINT_PART_BYTES && ser.tx_slots() >= PRINT_PART_SLOTS) {
+        if ((this->*m_print[0])(m_printPart++)) continue;
+        m_printPart = 0;
+        m_printCount--;
+        for (uint8_t i = 0; i < m_printCount; i++) m_print[i] = m_print[i + 1];
+    }
+    if (!m_printCount && m_lineHeld) {
+        m_lineHeld = false;
+        cout << PGM << PSTR("\r\nBMS>");
+        ser.line_done();
+    }
+}
+
+bool Console::busy() { return m_printCount || ser.line(); }
+
+void Console::woke() { m_lastUpdate = mcu::Timer::millis() - BQ_UPDATE_MS; }
+
+// The RX interrupt edits and echoes the line, a finished one is handled
+// on the pass that sees it
 bool Console::Recv() {
-    bool result = false;
-    char ch;
-    if (state == CONSOLE_STARTUP) {
-        state = CONSOLE_ACCUMULATING;
-    } else if (state == CONSOLE_ACCUMULATING) {
-        while (ser.avail()) {
-            result = true;
-            ch = ser.read();
-                ser.write(ch);
-                if (ch == CR) ser.write(LF);
-            if (ch == BackSpace || ch == Delete) {
-                if (len) buffer[--len] = 0;
-            } else {
-                if (ch != LF) buffer[len++] = ch;
-            }
-            if (len == CONS_BUFF || ch == CR) {
-                buffer[--len] = 0;
-                state = CONSOLE_COMMAND;
+    if (m_baudTrial && mcu::Timer::millis() - m_baudSince >= BAUD_TRIAL_MS) {
+        m_baudTrial = false;
+        ser.set_baud(m_baudPrev);
+        bq769x_conf.Baud = m_baudPrev;
+        PRINT_P(cout, "\r\nbaud back to {}\r\nBMS>", mcu::Usart::baud_rate(m_baudPrev));
+    }
+    if (m_printCount) {
+        print_step();
+        return true;
+    }
+    if (ser.binary_request()) tel.begin();
+    if (tel.active()) {
+        switch (tel.update()) {
+            case TEL_CONF_SET:
+                conf_begin_protect();
+                break;
+            case TEL_CONF_SAVE:
+                conf_save();
+                tel.ack(TEL_SAVE);
+                break;
+            case TEL_ENDED:
+                cout << PGM << PSTR("\r\nBMS>");
+                break;
+            default:
                 break;
-            }
         }
-    } else if (state == CONSOLE_COMMAND) {
-        handleCommand(buffer, len);
-        cout << "\r\nBMS>";
-        len = 0;
-        state = CONSOLE_ACCUMULATING;
+        return tel.streaming() || tel.sending();    // a logger listening counts as activity
     }
-    return result;
+    if (modbus.active()) {
+        const ModbusEvent e = modbus.update();
+        switch (e) {
+            case MB_CONF_SET:
+                conf_begin_protect();
+                break;
+            case MB_CONF_SAVE:
+                conf_save();
+                modbus.saved();
+                break;
+            case MB_ENDED:
+                cout << PGM << PSTR("\r\nBMS>");
+                break;
+            default:
+                break;
+        }
+        return e != MB_NONE;        // polled by a master counts as activity
+    }
+    const char *line = ser.line();
+    if (!line) return false;
+    // a command understood at the trial rate proves it, a new baud restarts the trial
+    const uint8_t trying = ser.baud();
+    if (handleCommand(line, strlen(line)) && m_baudTrial && ser.baud() == trying) {
+        m_baudTrial = false;
+        bq769x_conf.Baud = trying;
+        PRINT_P(cout, "\r\nbaud {} kept, 'save' to boot with it", mcu::Usart::baud_rate(trying));
+    }
+    if (m_printCount) {
+        m_lineHeld = true;      // print_step() prompts and releases it
+        print_step();
+        return true;
+    }
+    cout << PGM << PSTR("\r\nBMS>");
+    ser.line_done();
+    return true;
 }
 
 
-void Console::debug_print() {
-    uint32_t uptime = m_millisOverflows * (0xffffffffLL / 1000UL);
-    uptime += mcu::Timer::millis() / 1000;
-
-    cout
-        << PGM << PSTR("BMS uptime: ") << uptime
-        << PGM << PSTR(" BAT Temp: ") // TODO macro for x20 x30 Ic
-        << bq.getTemperatureDegC(0) << ' '
-        << bq.getTemperatureDegC(1) << ' '
-        << bq.getTemperatureDegC(2)
-        << EOL;
-
-    cout 
-        << PGM << PSTR("BAT Voltage: ")     << bq769x_data.batVoltage_
-        << PGM << PSTR(" mV (")             << bq769x_data.batVoltage_raw_
-        << PGM << PSTR(" raw), current: ")  << bq769x_data.batCurrent_
-        << PGM << PSTR(" mA (")             << bq769x_data.batCurrent_raw_
-        << PGM << PSTR(" raw)\r\n")
-        << PGM << PSTR("SOC: ") << bq.getSOC()
-        << PGM << PSTR(" Balancing status: ") << bq769x_data.balancingStatus_
-        << PGM << PSTR("\r\nCell voltages:\r\n");
-    
-    for(uint8_t x = 0; x < MAX_NUMBER_OF_CELLS; x++) {
-        uint8_t y = bq769x_stats.cellIdMap_[x];
-        cout << bq769x_stats.cellVoltages_[y] << PGM << PSTR(" mV (") << bq769x_data.cellVoltages_raw_[y] << " raw)\t";
-        if ((x+1) % 3 == 0) cout << EOL;
+namespace {
+
+struct ErrorLine { uint8_t error; char label[24]; };
+
+// debug_part() error lines
+const ErrorLine DEBUG_ERRORS[] PROGMEM = {
+    { devices::ERROR_XREADY,            "\r\nXREADY errors: " },
+    { devices::ERROR_ALERT,             "\r\n ALERT errors: " },
+    { devices::ERROR_UVP,               "\r\n   UVP errors: " },
+    { devices::ERROR_OVP,               "\r\n   OVP errors: " },
+    { devices::ERROR_SCD,               "\r\n   SCD errors: " },
+    { devices::ERROR_OCD,               "\r\n   OCD errors: " },
+    { devices::ERROR_USER_DISCHG_TEMP,  "\r\nDISCHG TEMP errors: " },
+    { devices::ERROR_USER_CHG_TEMP,     "\r\n   CHG TEMP errors: " },
+    { devices::ERROR_USER_CHG_OCD,      "\r\n    CHG OCD errors: " },
+};
+
+constexpr uint8_t DEBUG_ERROR_COUNT = sizeof(DEBUG_ERRORS) / sizeof(DEBUG_ERRORS[0]);
+
+}
+
+bool Console::debug_part(uint8_t i) {
+    switch (i) {
+        case 0: {
+            uint32_t uptime = m_millisOverflows * (0xffffffffLL / 1000UL);
+            uptime += mcu::Timer::millis() / 1000;
+            PRINT_P(cout, "BMS uptime: {} BAT Temp:", uptime);
+            for (uint8_t t = 0; t < BQ::thermistors; t++) PRINT_P(cout, " {}", bq.getTemperatureDegC(t));
+            cout << EOL;
+            return true;
+        }
+        case 1:
+            PRINT_P(cout, "BAT Voltage: {} mV ({} raw), current: {}",
+                    bq769x_data.batVoltage_, bq769x_data.batVoltage_raw_, bq769x_data.batCurrent_);
+            return true;
+        case 2:
+            PRINT_P(cout, " mA ({} raw)\r\nSOC: {} Balancing status: {}",
+                    bq769x_data.batCurrent_raw_, bq.getSOC(), bq769x_data.balancingStatus_);
+            return true;
+        case 3:
+            PRINT_P(cout, "\r\nCC samples: {} missed: {} duplicates: {}",
+                    bq.getCCTiming().samples, bq.getCCTiming().missed, bq.getCCTiming().duplicates);
+            return true;
+        case 4:
+            PRINT_P(cout, " jitter max: {} ms, last dt: {} ms",
+                    bq.getCCTiming().jitterMax_ms, bq.getCCTiming().lastDt_ms);
+            return true;
+        case 5:
+            PRINT_P(cout, "\r\nUpdates late: {} max: {} ms\r\nCell voltages:\r\n",
+                    m_updateMisses, m_updateLateMax);
+            return true;
     }
-    
-    cout
-        << PGM << PSTR("\r\nCell mV: Min: ")       << bq.getMinCellVoltage()
-        << PGM << PSTR(" | Avg: ")                 << bq.getAvgCellVoltage()
-        << PGM << PSTR(" | Max: ")                 << bq.getMaxCellVoltage()
-        << PGM << PSTR(" | Delta: ")               << bq.getMaxCellVoltage() - bq.getMinCellVoltage()
-        << PGM << PSTR("\r\nXREADY errors: ")      << bq769x_stats.errorCounter_[devices::BQ769xERR::ERROR_XREADY]
-        << PGM << PSTR("\r\n ALERT errors: ")      << bq769x_stats.errorCounter_[devices::BQ769xERR::ERROR_ALERT]
-        << PGM << PSTR("\r\n   UVP errors: ")      << bq769x_stats.errorCounter_[devices::BQ769xERR::ERROR_UVP]
-        << PGM << PSTR("\r\n   OVP errors: ")      << bq769x_stats.errorCounter_[devices::BQ769xERR::ERROR_OVP]
-        << PGM << PSTR("\r\n   SCD errors: ")      << bq769x_stats.errorCounter_[devices::BQ769xERR::ERROR_SCD]
-        << PGM << PSTR("\r\n   OCD errors: ")      << bq769x_stats.errorCounter_[devices::BQ769xERR::ERROR_OCD]
-        << PGM << PSTR("\r\nDISCHG TEMP errors: ") << bq769x_stats.errorCounter_[devices::BQ769xERR::ERROR_USER_DISCHG_TEMP]
-        << PGM << PSTR("\r\n   CHG TEMP errors: ") << bq769x_stats.errorCounter_[devices::BQ769xERR::ERROR_USER_CHG_TEMP]
-        << PGM << PSTR("\r\n    CHG OCD errors: ") << bq769x_stats.errorCounter_[devices::BQ769xERR::ERROR_USER_CHG_OCD]
-        << EOL;
+    i -= 6;
+    if (i < BQ::cells) {
+        uint8_t y = bq769x_stats.cellIdMap_[i];
+        PRINT_P(cout, "{} mV ({} raw)\t", bq769x_stats.cellVoltages_[y], bq769x_data.cellVoltages_raw_[y]);
+        if ((i+1) % 3 == 0) cout << EOL;
+        return true;
+    }
+    i -= BQ::cells;
+    if (!i) {
+        const uint16_t min = bq.getMinCellVoltage();
+        const uint16_t max = bq.getMaxCellVoltage();
+        PRINT_P(cout, "\r\nCell mV: Min: {} | Avg: {} | Max: {} | Delta: {}",
+                min, bq.getAvgCellVoltage(), max, (uint16_t)(max - min));
+        return true;
+    }
+    const ErrorLine *e = &DEBUG_ERRORS[i - 1];
+    cout << PGM << e->label << bq769x_stats.errorCounter_[pgm_read_byte(&e->error)];
+    if (i < DEBUG_ERROR_COUNT) return true;
+    cout << EOL;
+    return false;
 }
 
 typedef void (*do_reboot_t)(void);
 const do_reboot_t do_reboot = (do_reboot_t)((FLASHEND - 511) >> 1); // optiboot size
 
 void Console::command_bootloader() {
+    ser.flush();
     mcu::Watchdog::disable();
     cli();
     TCCR0A = 0;
     TCCR1A = 0;
     TCCR2A = 0;
     MCUSR = 0;
+#ifdef __AVR__
     do_reboot();
-}
-
-uint8_t gencrc8(uint8_t *data, uint16_t len) {
-    uint8_t crc = 0;
-    for (uint16_t i = 0; i < len; i++) {
-        crc = devices::_crc8_ccitt_update(crc, data[i]);
-    }
-    return crc;
+#else
+    mcu::Watchdog::forceRestart(); // no bootloader in the host build
+#endif
 }
 
 void Console::command_format_EEMEM() {
     for (int i = 0 ; i < E2END + 1 ; i++) {
-        eeprom_write_byte((uint8_t*)i, 0xff);
+        eeprom_write_byte((uint8_t*)(size_t)i, 0xff);
         ser.write('.');
         mcu::Watchdog::reset();
     }
@@ -25,61 +25,35 @@
 #include "mcu/timer.h"
 #include <avr/pgmspace.h>
 #include "mcu/pin.h"
+#include "mcu/baud.h"
+#include "protocol/conf_table.h"
+#include "protocol/telemetry.h"
+#include "protocol/modbus.h"
 
-#define CONS_BUFF   100
-#define BackSpace   0x08
-#define Delete      0x7F
+#define BAUD_TRIAL_MS   10000       // a switched rate reverts without a command by then
+#define BQ_UPDATE_MS    250         // sample period, the bq769x0 wants one at least this often
+#define UPDATE_SLACK_MS 50          // a sample later than this missed its deadline
+#define PRINT_QUEUE     5           // long outputs waiting, the boot dump is the most
+#define PRINT_PART_BYTES 40         // TX ring bytes one part of a long output takes at most
+#define PRINT_PART_SLOTS 8          // and TX slots
 
 namespace protocol {
 
-enum PrintParam {
-    Conf_Allow_Charging,
-    Conf_Allow_Discharging,
-    Conf_BQ_dbg,
-    Conf_RT_bits,
-    Conf_RS_uOhm,
-    Conf_RT_Beta,
-    Conf_Cell_CapaNom_mV,
-    Conf_Cell_CapaFull_mV,
-    Conf_Batt_CapaNom_mAsec,
-    Conf_CurrentThresholdIdle_mA,
-    Conf_Cell_TempCharge_min,
-    Conf_Cell_TempCharge_max,
-    Conf_Cell_TempDischarge_min,
-    Conf_Cell_TempDischarge_max,
-    Conf_BalancingInCharge,
-    Conf_BalancingEnable,
-    Conf_BalancingCellMin_mV,
-    Conf_BalancingCellMaxDifference_mV,
-    Conf_BalancingIdleTimeMin_s,
-    Conf_Cell_OCD_mA,
-    Conf_Cell_OCD_ms,
-    Conf_Cell_SCD_mA,
-    Conf_Cell_SCD_us,
-    Conf_Cell_ODP_mA,
-    Conf_Cell_ODP_ms,
-    Conf_Cell_OVP_mV,
-    Conf_Cell_OVP_sec,
-    Conf_Cell_UVP_mV,
-    Conf_Cell_UVP_sec,
-    Conf_adcCellsOffset,
-    Conf_ts,
-    Conf_CRC8,
-    FIRST = Conf_Allow_Charging,
-    LAST = Conf_CRC8
-};
-
 class Console;
 typedef void (Console::*SerialCommandHandler)();
 struct SerialCommand { const char *command; SerialCommandHandler handler; };
+// prints part i of a long output, false if that was the last one
+typedef bool (Console::*PrintPart)(const uint8_t i);
 
 class Console {
     mcu::Usart &ser;
     stream::UartStream cout;
-    devices::bq769_conf  bq769x_conf;
-    devices::bq769_data  bq769x_data;
-    devices::bq769_stats bq769x_stats;
-    devices::bq769x0     bq;
+    devices::bq769_conf<BQ>  bq769x_conf;
+    devices::bq769_data<BQ>  bq769x_data;
+    devices::bq769_stats<BQ> bq769x_stats;
+    devices::bq769x0<BQ>     bq;
+    Telemetry tel;
+    Modbus modbus;
     bool debug_events;
     bool handle_result;
     uint8_t param_len;
@@ -87,28 +61,45 @@ class Console {
     uint32_t m_lastUpdate;
     uint32_t m_oldMillis = 0;
     uint32_t m_millisOverflows;
-    uint8_t len;
+    uint32_t m_baudSince;       // rate switched, no command seen at it yet
+    uint8_t m_baudPrev;
+    bool m_baudTrial;
+    PrintPart m_print[PRINT_QUEUE];     // long outputs, the first one running
+    uint8_t m_printCount;
+    uint8_t m_printPart;        // next part of m_print[0]
+    bool m_lineHeld;            // its command queued output, the prompt waits for it
+    uint16_t m_updateMisses;    // samples later than UPDATE_SLACK_MS
+    uint16_t m_updateLateMax;   // ms, the latest of them
     uint16_t m_BatCycles_prev;
     uint16_t m_ChargedTimes_prev;
+    uint32_t m_Throughput_Ah_prev;
     uint8_t shd;
 public:
     Console();
     bool update(mcu::Pin job, const bool force);
     void begin();
     bool Recv();
+    bool busy();                // a line or a long output is not done yet
+    void woke();                // after the power-save sleep, a sample is due but not late
 private:
-    void debug_print();
+    void print(const PrintPart part);
+    void print_step();
+    bool bq_due();
+    bool debug_part(const uint8_t i);
+    bool conf_part(const uint8_t i);
+    bool stats_part(const uint8_t i);
+    bool regs_part(const uint8_t i);
+    bool help_part(const uint8_t i);
+    bool modbus_part(const uint8_t i);
     void conf_begin_protect();
     void conf_default();
     void conf_load();
     void conf_save();
     void stats_load();
     void stats_save();
-    void print_all_stats();
     
     
     void print_conf(const PrintParam c);
-    void print_all_conf();
     
     void command_restore();
     void command_save();
@@ -117,6 +108,14 @@ private:
     void command_wdreset();
     void command_bootloader();
     void command_freemem();
+    void command_crcbench();
+    void command_fmtbench();
+    void command_ntc();
+    void command_ekf();
+    void command_binary();
+    void command_stream();
+    void command_modbus();
+    void modbus_begin(const uint8_t address);
     void command_format_EEMEM();
     void command_help();
     void command_shutdown();
@@ -127,6 +126,13 @@ private:
     void cmd_Allow_Charging();
     void cmd_Allow_Discharging();
     void cmd_BQ_dbg();
+    void cmd_AlertDriven();
+    void cmd_OCV_Curve();
+    void cmd_SOC_Mode();
+    void cmd_Cells_Parallel();
+    void cmd_Baud();
+    void cmd_Modbus();
+    void baud_try(const uint8_t i);
     void cmd_RT_bits();
     void cmd_RS_uOhm();
     void cmd_RT_Beta();
@@ -156,14 +162,9 @@ private:
     
     bool handleCommand(const char *buffer, const uint8_t len);
     void write_help(stream::OutputStream &out, const char *cmd, const char *help);
-    char buffer[CONS_BUFF];
     void compare_cmd(const char *name_P, SerialCommandHandler handler);
-    enum SerialState { CONSOLE_STARTUP, CONSOLE_ACCUMULATING, CONSOLE_COMMAND };
-    SerialState state;
     const char *handle_buffer;
     const char *param;
 };
 
-uint8_t gencrc8(uint8_t *data, uint16_t len);
-
 }
@@ -34,12 +34,24 @@ char const STR_cmd_Allow_Discharging[]      PROGMEM = "discharging";
 char const STR_cmd_Allow_Discharging_HELP[] PROGMEM = " on (1) or off (0) allow discharging";
 char const STR_cmd_BQ_dbg[]         PROGMEM = "bqdbg";
 char const STR_cmd_BQ_dbg_HELP[]    PROGMEM = " on (1) or off (0) debug events on BQ769x0";
+char const STR_cmd_AlertDriven[]    PROGMEM = "alertdriven";
+char const STR_cmd_AlertDriven_HELP[] PROGMEM = " current on ALERT pin (1) or 250 ms polling (0)";
+char const STR_cmd_OCV_Curve[]      PROGMEM = "ocv";
+char const STR_cmd_OCV_Curve_HELP[] PROGMEM = " NMC (0), LFP (1), LTO (2), resets SOC from OCV";
+char const STR_cmd_SOC_Mode[]       PROGMEM = "socmode";
+char const STR_cmd_SOC_Mode_HELP[]  PROGMEM = " coulomb counter (0) or EKF (1)";
+char const STR_cmd_Cells_Parallel[] PROGMEM = "parallel";
+char const STR_cmd_Cells_Parallel_HELP[] PROGMEM = " cells in parallel per series group, scales the EKF cell model (1)";
+char const STR_cmd_Baud[]           PROGMEM = "baud";
+char const STR_cmd_Baud_HELP[]      PROGMEM = " console rate (4), send a command at the new one within 10 s";
+char const STR_cmd_Modbus[]         PROGMEM = "mbaddr";
+char const STR_cmd_Modbus_HELP[]    PROGMEM = " Modbus slave address 1-247 to boot as, 0 boots the console (0)";
 char const STR_cmd_RT_bits[]        PROGMEM = "thermistors";
-char const STR_cmd_RT_bits_HELP[]   PROGMEM = " <1> <1> <1> - enable 3 of 3";
+char const STR_cmd_RT_bits_HELP[]   PROGMEM = " <1> <1> <1> - enable per TS input";
 char const STR_cmd_RS_uOhm[]        PROGMEM = "shuntresistor";
 char const STR_cmd_RS_uOhm_HELP[]   PROGMEM = " (1000) = 1mOhm";
 char const STR_cmd_RT_Beta[]        PROGMEM = "thermistorbeta";
-char const STR_cmd_RT_Beta_HELP[]   PROGMEM = " (3435) (3435) (3435) / Semitec 103AT-5";
+char const STR_cmd_RT_Beta_HELP[]   PROGMEM = " (3435) (3435) (3435) per TS input / Semitec 103AT-5";
 char const STR_cmd_Cell_CapaNom_mV[]            PROGMEM = "cellnominalmv";
 char const STR_cmd_Cell_CapaNom_mV_HELP[]       PROGMEM = " mV (3600)";
 char const STR_cmd_Cell_CapaFull_mV[]           PROGMEM = "cellfullmv";
@@ -98,6 +110,20 @@ char const STR_CMD_BOOTLOADER[]     PROGMEM = "bootloader";
 char const STR_CMD_BOOTLOADER_HLP[] PROGMEM = " jump to bootloader";
 char const STR_CMD_FREEMEM[]        PROGMEM = "mem";
 char const STR_CMD_FREEMEM_HLP[]    PROGMEM = " show free memory";
+char const STR_CMD_CRCBENCH[]       PROGMEM = "crcbench";
+char const STR_CMD_CRCBENCH_HLP[]   PROGMEM = " CPU cycles of CRC8 over conf";
+char const STR_CMD_FMTBENCH[]       PROGMEM = "fmtbench";
+char const STR_CMD_FMTBENCH_HLP[]   PROGMEM = " CPU cycles per number printed, ltoa and stream";
+char const STR_CMD_NTC[]            PROGMEM = "ntc";
+char const STR_CMD_NTC_HLP[]        PROGMEM = " [beta] worst code per table segment, -40..+120 C: code T ref err";
+char const STR_CMD_EKF[]            PROGMEM = "ekf";
+char const STR_CMD_EKF_HLP[]        PROGMEM = " SOC filter state and CPU cycles of one step";
+char const STR_CMD_BINARY[]         PROGMEM = "binary";
+char const STR_CMD_BINARY_HLP[]     PROGMEM = " COBS framed telemetry until an exit frame (protocol/telemetry.h)";
+char const STR_CMD_STREAM[]         PROGMEM = "stream";
+char const STR_CMD_STREAM_HLP[]     PROGMEM = " [ms] binary mode, delta coded cells/current/temp/FET records (250)";
+char const STR_CMD_MODBUS[]         PROGMEM = "modbus";
+char const STR_CMD_MODBUS_HLP[]     PROGMEM = " [addr] Modbus RTU slave until the exit coil (protocol/modbus.h)";
 char const STR_CMD_EPFORMAT[]       PROGMEM = "format";
 char const STR_CMD_EPFORMAT_HLP[]   PROGMEM = " EEPROM (forced load defs in next boot)";
 char const STR_CMD_HELP[]           PROGMEM = "help";
@@ -33,6 +33,18 @@ extern char const STR_cmd_Allow_Discharging[];
 extern char const STR_cmd_Allow_Discharging_HELP[];
 extern char const STR_cmd_BQ_dbg[];
 extern char const STR_cmd_BQ_dbg_HELP[];
+extern char const STR_cmd_AlertDriven[];
+extern char const STR_cmd_AlertDriven_HELP[];
+extern char const STR_cmd_OCV_Curve[];
+extern char const STR_cmd_OCV_Curve_HELP[];
+extern char const STR_cmd_SOC_Mode[];
+extern char const STR_cmd_SOC_Mode_HELP[];
+extern char const STR_cmd_Cells_Parallel[];
+extern char const STR_cmd_Cells_Parallel_HELP[];
+extern char const STR_cmd_Baud[];
+extern char const STR_cmd_Baud_HELP[];
+extern char const STR_cmd_Modbus[];
+extern char const STR_cmd_Modbus_HELP[];
 extern char const STR_cmd_RT_bits[];
 extern char const STR_cmd_RT_bits_HELP[];
 extern char const STR_cmd_RS_uOhm[];
@@ -97,6 +109,20 @@ extern char const STR_CMD_BOOTLOADER[];
 extern char const STR_CMD_BOOTLOADER_HLP[];
 extern char const STR_CMD_FREEMEM[];
 extern char const STR_CMD_FREEMEM_HLP[];
+extern char const STR_CMD_CRCBENCH[];
+extern char const STR_CMD_CRCBENCH_HLP[];
+extern char const STR_CMD_FMTBENCH[];
+extern char const STR_CMD_FMTBENCH_HLP[];
+extern char const STR_CMD_NTC[];
+extern char const STR_CMD_NTC_HLP[];
+extern char const STR_CMD_EKF[];
+extern char const STR_CMD_EKF_HLP[];
+extern char const STR_CMD_BINARY[];
+extern char const STR_CMD_BINARY_HLP[];
+extern char const STR_CMD_STREAM[];
+extern char const STR_CMD_STREAM_HLP[];
+extern char const STR_CMD_MODBUS[];
+extern char const STR_CMD_MODBUS_HLP[];
 extern char const STR_CMD_EPFORMAT[];
 extern char const STR_CMD_EPFORMAT_HLP[];
 extern char const STR_CMD_HELP[];
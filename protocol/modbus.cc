@@ -0,0 +1,327 @@
+/* Shell console for battery management based on bq769x Ic
+ * Copyright (c) 2022 Sergey Kostanoy (https://arduino.uno)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <avr/pgmspace.h>
+#include "modbus.h"
+#include "mcu/timer.h"
+#include "stream/uartstream.h"
+#include "utils/crc.h"
+
+#define MB_BROADCAST    0
+#define MB_COIL_ON      0xFF00
+
+namespace protocol {
+
+namespace {
+
+typedef devices::bq769_data<BQ> Data;
+typedef devices::bq769_stats<BQ> Stats;
+
+static_assert(sizeof(Data) <= 0xFF && sizeof(Stats) <= 0xFF, "field offsets are one byte");
+
+// in ModbusData order
+const ConfField dataFields[] PROGMEM = {
+    CONF_FIELD(Data, alertInterruptFlag_,       0),
+    CONF_FIELD(Data, user_CHGOCD_ReleasedNow_,  0),
+    CONF_FIELD(Data, charging_,                 0),
+    CONF_FIELD(Data, connectedCells_,           0),
+    CONF_FIELD(Data, batVoltage_,               0),
+    CONF_FIELD(Data, batVoltage_raw_,           0),
+    CONF_FIELD(Data, batCurrent_,               CONF_SIGNED),
+    CONF_FIELD(Data, batCurrent_raw_,           CONF_SIGNED),
+    CONF_FIELD(Data, balancingStatus_,          0),
+    CONF_ARRAY(Data, cellVoltages_raw_,         0),
+};
+
+// in ModbusStats order
+const ConfField statsFields[] PROGMEM = {
+    CONF_FIELD(Stats, adcGain_,                 0),
+    CONF_FIELD(Stats, adcOffset_,               CONF_SIGNED),
+    CONF_FIELD(Stats, batCycles_,               0),
+    CONF_FIELD(Stats, chargedTimes_,            0),
+    CONF_FIELD(Stats, idCellMaxVoltage_,        0),
+    CONF_FIELD(Stats, idCellMinVoltage_,        0),
+    CONF_FIELD(Stats, idleTimestamp_,           0),
+    CONF_FIELD(Stats, chargeTimestamp_,         0),
+    CONF_ARRAY(Stats, errorCounter_,            0),
+    CONF_ARRAY(Stats, cellIdMap_,               0),
+    CONF_ARRAY(Stats, cellVoltages_,            0),
+    CONF_ARRAY(Stats, temperatures_,            CONF_SIGNED),
+    CONF_ARRAY(Stats, errorTimestamps_,         0),
+    CONF_FIELD(Stats, chargeIn_mAh_,            0),
+    CONF_FIELD(Stats, chargeOut_mAh_,           0),
+    CONF_FIELD(Stats, energyIn_mWh_,            0),
+    CONF_FIELD(Stats, energyOut_mWh_,           0),
+    CONF_FIELD(Stats, ts,                       0),
+    CONF_FIELD(Stats, crc8,                     0),
+};
+
+static_assert(sizeof(dataFields) / sizeof(dataFields[0]) == MB_DATA_COUNT, "one data field per ModbusData");
+static_assert(sizeof(statsFields) / sizeof(statsFields[0]) == MB_STATS_COUNT, "one stats field per ModbusStats");
+static_assert(MB_IR_DATA + MB_SLOT * MB_DATA_COUNT <= MB_IR_STATS, "bq769_data runs into bq769_stats");
+static_assert(MB_IR_STATS + MB_SLOT * MB_STATS_COUNT <= MB_IR_LIVE, "bq769_stats runs into the live registers");
+static_assert(2 * devices::NUM_ERRORS <= MB_SLOT && 2 * BQ::cells <= MB_SLOT, "an array fits its slot");
+static_assert(BQ::cells <= MB_WRITE_MAX, "one FC16 writes adcCellsOffset_");
+
+uint16_t be16(const uint8_t *p) { return (uint16_t)p[0] << 8 | p[1]; }
+
+}  // namespace
+
+Modbus::Modbus(mcu::Usart &ser, Conf &conf, devices::bq769_data<BQ> &data,
+               devices::bq769_stats<BQ> &stats, devices::bq769x0<BQ> &bq):
+    ser_(ser), conf_(conf), data_(data), stats_(stats), bq_(bq),
+    address_(0), status_(0), reply_(false), crc_(0xFFFF)
+{}
+
+// t3.5 is 3.5 characters of 11 bits, fixed at 1750 us above 19200 baud
+void Modbus::begin(const uint8_t address) {
+    const uint32_t baud = mcu::Usart::baud_rate(ser_.baud());
+    ser_.flush();
+    stream::UartStream::mute(true);
+    ser_.rx_lines(false);
+    ser_.rx_gap_us(baud > 19200 ? 1750 : 38500000UL / baud);
+    address_ = address;
+}
+
+void Modbus::end() {
+    ser_.flush();
+    address_ = 0;
+    ser_.rx_gap_us(0);
+    ser_.rx_lines(true);
+    stream::UartStream::mute(false);
+}
+
+//----------------------------------------------------------------------------
+// register map
+
+// the element register addr of a block is in, MB_GAP between the fields
+Modbus::Found Modbus::locate(const bool input, const uint16_t addr, Reg &r) {
+    const ConfField *table = nullptr;
+    uint8_t *base = (uint8_t *)&conf_;
+    uint8_t count = LAST + 1;
+    uint16_t reg = addr - MB_HR_CONF;
+    if (input) {
+        if (addr >= MB_IR_LIVE) return MB_OUT;
+        if (addr >= MB_IR_STATS) {
+            table = statsFields;
+            base = (uint8_t *)&stats_;
+            count = MB_STATS_COUNT;
+            reg = addr - MB_IR_STATS;
+        } else {
+            table = dataFields;
+            base = (uint8_t *)&data_;
+            count = MB_DATA_COUNT;
+            reg = addr - MB_IR_DATA;
+        }
+    }
+    if (reg / MB_SLOT >= count) return MB_OUT;
+    const uint8_t slot = reg / MB_SLOT;
+    ConfField f;
+    if (table) memcpy_P(&f, &table[slot], sizeof(f));
+    else f = conf_field((PrintParam)slot);
+    const uint8_t per = f.size == 4 ? 2 : 1;
+    const uint8_t i = reg % MB_SLOT;
+    if (i >= f.count * per) return MB_GAP;
+    r.p = base + f.offset + i / per * f.size;
+    r.size = f.size;
+    r.flags = f.flags;
+    r.slot = slot;
+    r.high = per == 2 && !(i % 2);
+    return MB_FOUND;
+}
+
+uint16_t Modbus::live(const uint8_t i) {
+    switch (i) {
+        case MB_LIVE_SOC:    return bq_.getSOC() * 100;
+        case MB_LIVE_FETS:   return (bq_.isChargingEnabled() ? 1 : 0) | (bq_.isDischargingEnabled() ? 2 : 0);
+        case MB_LIVE_STATUS: return status_;
+        case MB_LIVE_MILLIS: return mcu::Timer::millis() >> 16;
+        default:             return mcu::Timer::millis();     // its low word
+    }
+}
+
+// false outside the map
+bool Modbus::read(const bool input, const uint16_t addr, uint16_t &value) {
+    value = 0;
+    if (input && addr >= MB_IR_LIVE) {
+        if (addr - MB_IR_LIVE >= MB_LIVE_COUNT) return false;
+        value = live(addr - MB_IR_LIVE);
+        return true;
+    }
+    Reg r;
+    const Found found = locate(input, addr, r);
+    if (found != MB_FOUND) return found == MB_GAP;
+    if (r.size == 1) {
+        value = (r.flags & CONF_SIGNED) ? (uint16_t)(int8_t)*r.p : *r.p;
+    } else if (r.size == 2) {
+        memcpy(&value, r.p, 2);
+    } else {
+        uint32_t v;
+        memcpy(&v, r.p, 4);
+        value = r.high ? v >> 16 : v;
+    }
+    return true;
+}
+
+// n conf registers from start, the values big endian; 0 or the exception.
+// Each element is checked against the conf limits before it is stored,
+// store false only checks. A 32 bit element needs both of its registers.
+uint8_t Modbus::write(const uint16_t start, const uint8_t n, const uint8_t *values, const bool store) {
+    for (uint8_t i = 0; i < n; i++) {
+        Reg r;
+        if (locate(false, start + i, r) != MB_FOUND || (r.flags & CONF_READONLY)) return MB_ILLEGAL_ADDRESS;
+        uint32_t v = be16(values + 2 * i);
+        if (r.size == 4) {
+            if (!r.high || i + 1 >= n) return MB_ILLEGAL_ADDRESS;
+            i++;
+            v = v << 16 | be16(values + 2 * i);
+        } else if (r.size == 1) {
+            const bool fits = (r.flags & CONF_SIGNED) ? (int16_t)v >= -128 && (int16_t)v <= 127 : v <= 0xFF;
+            if (!fits) return MB_ILLEGAL_VALUE;
+        }
+        if (!conf_valid((PrintParam)r.slot, (const uint8_t *)&v, 1)) return MB_ILLEGAL_VALUE;
+        if (store) memcpy(r.p, &v, r.size);        // little endian, as the conf
+    }
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+// replies, the CRC runs along with the bytes
+
+void Modbus::out(const uint8_t b) {
+    crc_ = utils::crc16_update(crc_, b);
+    ser_.write(b);
+}
+
+void Modbus::out16(const uint16_t v) {
+    out(v >> 8);
+    out(v);
+}
+
+void Modbus::reply_end() {
+    const uint16_t crc = crc_;
+    ser_.write(crc);
+    ser_.write(crc >> 8);
+    crc_ = 0xFFFF;
+}
+
+// FC05, FC06: the request is the answer
+void Modbus::echo() {
+    if (!reply_) return;
+    for (uint8_t i = 0; i < 6; i++) out(rx_[i]);
+    reply_end();
+}
+
+void Modbus::saved() { echo(); }
+
+ModbusEvent Modbus::exception(const uint8_t fc, const ModbusException code) {
+    if (!reply_) return MB_RECEIVED;
+    out(address_);
+    out(fc | 0x80);
+    out(code);
+    reply_end();
+    return MB_RECEIVED;
+}
+
+//----------------------------------------------------------------------------
+// requests
+
+ModbusEvent Modbus::request(const uint8_t len) {
+    const uint8_t fc = rx_[1];
+    switch (fc) {
+        case MB_READ_HOLDING:
+        case MB_READ_INPUT: {
+            if (!reply_) return MB_NONE;        // nobody to read to
+            if (len != 6) return exception(fc, MB_ILLEGAL_VALUE);
+            const bool input = fc == MB_READ_INPUT;
+            const uint16_t start = be16(rx_ + 2);
+            const uint16_t n = be16(rx_ + 4);
+            if (!n || n > MB_READ_MAX) return exception(fc, MB_ILLEGAL_VALUE);
+            uint16_t v;
+            for (uint16_t i = 0; i < n; i++) {
+                if (!read(input, start + i, v)) return exception(fc, MB_ILLEGAL_ADDRESS);
+            }
+            out(address_);
+            out(fc);
+            out(2 * n);
+            for (uint16_t i = 0; i < n; i++) {
+                read(input, start + i, v);
+                out16(v);
+            }
+            reply_end();
+            return MB_RECEIVED;
+        }
+        case MB_WRITE_REGISTER: {
+            if (len != 6) return exception(fc, MB_ILLEGAL_VALUE);
+            const uint8_t err = write(be16(rx_ + 2), 1, rx_ + 4, true);
+            if (err) return exception(fc, (ModbusException)err);
+            echo();
+            return MB_CONF_SET;
+        }
+        case MB_WRITE_REGISTERS: {
+            const uint16_t start = be16(rx_ + 2);
+            const uint16_t n = be16(rx_ + 4);
+            if (len < 7 || !n || n > MB_WRITE_MAX || rx_[6] != 2 * n || len != 7 + 2 * n) {
+                return exception(fc, MB_ILLEGAL_VALUE);
+            }
+            // all or nothing
+            for (uint8_t pass = 0; pass < 2; pass++) {
+                const uint8_t err = write(start, n, rx_ + 7, pass);
+                if (err) return exception(fc, (ModbusException)err);
+            }
+            if (reply_) {
+                for (uint8_t i = 0; i < 6; i++) out(rx_[i]);
+                reply_end();
+            }
+            return MB_CONF_SET;
+        }
+        case MB_WRITE_COIL: {
+            if (len != 6) return exception(fc, MB_ILLEGAL_VALUE);
+            const uint16_t coil = be16(rx_ + 2);
+            const uint16_t value = be16(rx_ + 4);
+            if (coil > MB_COIL_EXIT) return exception(fc, MB_ILLEGAL_ADDRESS);
+            if (value != MB_COIL_ON && value) return exception(fc, MB_ILLEGAL_VALUE);
+            if (!value) {
+                echo();
+                return MB_RECEIVED;
+            }
+            if (coil == MB_COIL_SAVE) return MB_CONF_SAVE;  // answered once written
+            echo();
+            end();
+            return MB_ENDED;
+        }
+        default:
+            return exception(fc, MB_ILLEGAL_FUNCTION);
+    }
+}
+
+ModbusEvent Modbus::update() {
+    const uint8_t len = ser_.rx_frame();
+    if (!len) return MB_NONE;
+    for (uint8_t i = 0; i < len; i++) {
+        const uint8_t c = ser_.read();
+        if (i < MODBUS_RX_SIZE) rx_[i] = c;
+    }
+    // CRC over the frame and its CRC is 0; noise, a reply of another
+    // slave and what does not fit are left unanswered
+    if (len < 4 || len > MODBUS_RX_SIZE || utils::crc16(rx_, len)) return MB_NONE;
+    if (rx_[0] != address_ && rx_[0] != MB_BROADCAST) return MB_NONE;
+    reply_ = rx_[0] != MB_BROADCAST;
+    return request(len - 2);
+}
+
+}
@@ -0,0 +1,189 @@
+/* Shell console for battery management based on bq769x Ic
+ * Copyright (c) 2022 Sergey Kostanoy (https://arduino.uno)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "utils/cpp.h"
+#include "mcu/usart.h"
+#include "protocol/conf_table.h"
+
+// Modbus RTU slave on the console UART, 8N1 at the conf's Baud. Frames
+// end with t3.5 of silence (Usart::rx_frame()), the CRC-16 (utils/crc)
+// is sent low byte first, registers high byte first.
+//
+// Every field of a structure gets MB_SLOT registers at slot address
+// base + MB_SLOT * field: one register per 8 or 16 bit element, sign
+// extended for signed ones, two per 32 bit element, high word first.
+// Arrays run element by element. Registers between the fields read 0.
+//   input registers (FC04)
+//     MB_IR_DATA   bq769_data<BQ>, slots in ModbusData order
+//     MB_IR_STATS  bq769_stats<BQ>, slots in ModbusStats order, e.g. all
+//                  cells in mV are BQ::cells registers at
+//                  MB_IR_STATS + MB_SLOT * MB_STATS_cellVoltages
+//     MB_IR_LIVE   ModbusLive, one after the other
+//   holding registers (FC03, FC06, FC16)
+//     MB_HR_CONF   bq769_conf<BQ>, slots in PrintParam order; ts and crc8
+//                  are read only. Values outside the field's limits
+//                  (conf_table.cc) are MB_ILLEGAL_VALUE, a 32 bit element
+//                  is written as its two registers in one FC16 only. A
+//                  write applies the protection limits, the coil
+//                  MB_COIL_SAVE stores it.
+//   coils (FC05, 0xFF00 acts, 0x0000 does nothing)
+//     MB_COIL_SAVE the conf to EEPROM, answered once written
+//     MB_COIL_EXIT back to the text console, answered first
+//
+// A read takes up to MB_READ_MAX registers, not the spec's 125: the whole
+// reply goes into the TX ring at once, so it neither stalls the loop nor
+// leaves a gap inside the frame. Beyond that is MB_ILLEGAL_VALUE.
+//
+// Address 0 is the broadcast: writes are done, nothing is answered.
+// Frames with a bad CRC, for another slave or longer than MODBUS_RX_SIZE
+// are ignored. Entered with the 'modbus' command or at boot when the conf
+// has an address. Text output is muted while the slave is on.
+#define MB_SLOT         32
+#define MB_IR_DATA      0x0000
+#define MB_IR_STATS     0x0400
+#define MB_IR_LIVE      0x0800
+#define MB_HR_CONF      0x0000
+#define MB_READ_MAX     ((USART_TX_RING_SIZE - 1 - 5) / 2)   // registers, the reply fits the TX ring
+#define MB_WRITE_MAX    16                  // registers, adcCellsOffset_ at most
+#define MODBUS_RX_SIZE  (9 + 2 * MB_WRITE_MAX)  // FC16 frame of MB_WRITE_MAX
+#define MB_ADDRESS_MAX  247
+
+namespace protocol {
+
+enum ModbusFunction : uint8_t {
+    MB_READ_HOLDING     = 0x03,
+    MB_READ_INPUT       = 0x04,
+    MB_WRITE_COIL       = 0x05,
+    MB_WRITE_REGISTER   = 0x06,
+    MB_WRITE_REGISTERS  = 0x10,
+};
+
+enum ModbusException : uint8_t {
+    MB_ILLEGAL_FUNCTION = 0x01,
+    MB_ILLEGAL_ADDRESS  = 0x02,
+    MB_ILLEGAL_VALUE    = 0x03,
+};
+
+enum ModbusCoil : uint8_t {
+    MB_COIL_SAVE,
+    MB_COIL_EXIT,
+};
+
+// slots of MB_IR_DATA, in bq769_data order
+enum ModbusData : uint8_t {
+    MB_DATA_alertInterruptFlag,
+    MB_DATA_user_CHGOCD_ReleasedNow,
+    MB_DATA_charging,
+    MB_DATA_connectedCells,
+    MB_DATA_batVoltage,
+    MB_DATA_batVoltage_raw,
+    MB_DATA_batCurrent,
+    MB_DATA_batCurrent_raw,
+    MB_DATA_balancingStatus,
+    MB_DATA_cellVoltages_raw,
+    MB_DATA_COUNT
+};
+
+// slots of MB_IR_STATS, in bq769_stats order
+enum ModbusStats : uint8_t {
+    MB_STATS_adcGain,
+    MB_STATS_adcOffset,
+    MB_STATS_batCycles,
+    MB_STATS_chargedTimes,
+    MB_STATS_idCellMaxVoltage,
+    MB_STATS_idCellMinVoltage,
+    MB_STATS_idleTimestamp,
+    MB_STATS_chargeTimestamp,
+    MB_STATS_errorCounter,
+    MB_STATS_cellIdMap,
+    MB_STATS_cellVoltages,
+    MB_STATS_temperatures,
+    MB_STATS_errorTimestamps,
+    MB_STATS_chargeIn_mAh,
+    MB_STATS_chargeOut_mAh,
+    MB_STATS_energyIn_mWh,
+    MB_STATS_energyOut_mWh,
+    MB_STATS_ts,
+    MB_STATS_crc8,
+    MB_STATS_COUNT
+};
+
+// registers from MB_IR_LIVE
+enum ModbusLive : uint8_t {
+    MB_LIVE_SOC,                // 0.01 %
+    MB_LIVE_FETS,               // CHG 1, DSG 2
+    MB_LIVE_STATUS,             // last update() result
+    MB_LIVE_MILLIS,             // u32, high word first
+    MB_LIVE_COUNT = MB_LIVE_MILLIS + 2
+};
+
+// what the console has to do after update()
+enum ModbusEvent : uint8_t {
+    MB_NONE,
+    MB_RECEIVED,
+    MB_CONF_SET,                // apply the conf
+    MB_CONF_SAVE,               // then saved()
+    MB_ENDED,
+};
+
+class Modbus {
+public:
+    Modbus(mcu::Usart &ser, Conf &conf, devices::bq769_data<BQ> &data,
+           devices::bq769_stats<BQ> &stats, devices::bq769x0<BQ> &bq);
+    void begin(const uint8_t address);
+    void end();
+    bool active() const { return address_ != 0; }
+    ModbusEvent update();               // one request per call
+    void converted(const uint8_t status) { status_ = status; }
+    void saved();                       // answers MB_COIL_SAVE
+private:
+    enum Found : uint8_t { MB_OUT, MB_GAP, MB_FOUND };
+    struct Reg {
+        uint8_t *p;                     // the element
+        uint8_t size;
+        uint8_t flags;
+        uint8_t slot;                   // PrintParam for the conf
+        bool high;                      // first register of a 32 bit element
+    };
+
+    mcu::Usart &ser_;
+    Conf &conf_;
+    devices::bq769_data<BQ> &data_;
+    devices::bq769_stats<BQ> &stats_;
+    devices::bq769x0<BQ> &bq_;
+    uint8_t rx_[MODBUS_RX_SIZE];
+    uint8_t address_;                   // 0 while off
+    uint8_t status_;
+    bool reply_;                        // not a broadcast
+    uint16_t crc_;                      // of the reply so far
+
+    Found locate(const bool input, const uint16_t addr, Reg &r);
+    uint16_t live(const uint8_t i);
+    bool read(const bool input, const uint16_t addr, uint16_t &value);
+    uint8_t write(const uint16_t start, const uint8_t n, const uint8_t *values, const bool store);
+    void out(const uint8_t b);
+    void out16(const uint16_t v);
+    void reply_end();
+    void echo();
+    ModbusEvent exception(const uint8_t fc, const ModbusException code);
+    ModbusEvent request(const uint8_t len);
+    DISALLOW_COPY_AND_ASSIGN(Modbus);
+};
+
+}
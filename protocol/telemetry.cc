@@ -0,0 +1,330 @@
+/* Shell console for battery management based on bq769x Ic
+ * Copyright (c) 2022 Sergey Kostanoy (https://arduino.uno)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "telemetry.h"
+#include "mcu/timer.h"
+#include "stream/uartstream.h"
+#include "utils/crc.h"
+
+namespace protocol {
+
+Telemetry::Telemetry(mcu::Usart &ser, Conf &conf, devices::bq769_data<BQ> &data,
+                     devices::bq769_stats<BQ> &stats, devices::bq769x0<BQ> &bq):
+    ser_(ser), conf_(conf), data_(data), stats_(stats), bq_(bq),
+    rxLen_(0), rxOverflow_(false), txPhase_(TX_IDLE), active_(false), every_(1), count_(0), status_(0), seq_(0),
+    delta_(false), key_(0)
+{}
+
+void Telemetry::begin() {
+    ser_.flush();
+    stream::UartStream::mute(true);
+    ser_.rx_lines(false);
+    ser_.write(0);      // ends the text for the client, frames start clean
+    rxLen_ = 0;
+    rxOverflow_ = false;
+    txPhase_ = TX_IDLE;
+    every_ = 1;
+    count_ = 0;
+    delta_ = false;
+    active_ = true;
+}
+
+void Telemetry::stream(const uint8_t every) {
+    every_ = every;
+    count_ = 0;
+    delta_ = true;
+    key_ = 0;
+}
+
+void Telemetry::end() {
+    pump(true);
+    ser_.flush();
+    active_ = false;
+    ser_.rx_lines(true);
+    stream::UartStream::mute(false);
+}
+
+//----------------------------------------------------------------------------
+// framing
+
+uint8_t Telemetry::put(uint8_t n, const void *p, const uint8_t len) {
+    memcpy(tx_ + n, p, len);
+    return n + len;
+}
+
+// The frame is built in tx_, then CRC and COBS go to the TX queue as it
+// has room: a block up to each zero byte, led by its length + 1, the zero
+// itself is implied. What does not fit goes out from update(); a sample
+// is longer than the whole TX ring.
+void Telemetry::send(const uint8_t len) {
+    tx_[len] = utils::crc8(tx_, len);
+    txLen_ = len + 1;
+    txStart_ = 0;
+    txPhase_ = TX_CODE;
+    pump(false);
+}
+
+// true once the frame is queued; wait blocks until then
+bool Telemetry::pump(const bool wait) {
+    uint8_t room = wait ? 0xFF : ser_.tx_free();
+    while (txPhase_ != TX_IDLE) {
+        if (!room) return false;
+        if (!wait) room--;
+        switch (txPhase_) {
+            case TX_CODE:
+                txEnd_ = txStart_;
+                while (txEnd_ < txLen_ && tx_[txEnd_] && txEnd_ - txStart_ < 254) txEnd_++;
+                ser_.write(txEnd_ - txStart_ + 1);
+                txPos_ = txStart_;
+                txPhase_ = TX_DATA;
+                break;
+            case TX_DATA:
+                if (txPos_ < txEnd_) {
+                    ser_.write(tx_[txPos_++]);
+                    break;
+                }
+                if (!wait) room++;          // nothing written
+                if (txEnd_ >= txLen_) {
+                    txPhase_ = TX_END;
+                    break;
+                }
+                txStart_ = (txEnd_ - txStart_ == 254) ? txEnd_ : txEnd_ + 1;   // a full block implies no zero
+                if (txStart_ == txLen_) {
+                    if (!wait) room--;
+                    ser_.write(1);          // the zero was the last byte
+                    txPhase_ = TX_END;
+                } else {
+                    txPhase_ = TX_CODE;
+                }
+                break;
+            default:
+                ser_.write(0);
+                txPhase_ = TX_IDLE;
+                break;
+        }
+    }
+    return true;
+}
+
+void Telemetry::ack(const uint8_t type) {
+    pump(true);
+    tx_[0] = TEL_ACK;
+    tx_[1] = type;
+    send(2);
+}
+
+void Telemetry::nak(const uint8_t type, const TelError err) {
+    pump(true);
+    tx_[0] = TEL_NAK;
+    tx_[1] = type;
+    tx_[2] = err;
+    send(3);
+}
+
+//----------------------------------------------------------------------------
+// records
+
+void Telemetry::sample() {
+    pump(true);
+    const uint32_t now = mcu::Timer::millis();
+    const uint16_t soc = bq_.getSOC() * 100;
+    uint8_t n = 0;
+    tx_[n++] = TEL_SAMPLE;
+    n = put(n, &seq_, sizeof(seq_));
+    n = put(n, &now, sizeof(now));
+    n = put(n, &data_, sizeof(data_));
+    n = put(n, stats_.cellVoltages_, sizeof(stats_.cellVoltages_));
+    n = put(n, stats_.temperatures_, sizeof(stats_.temperatures_));
+    n = put(n, &soc, sizeof(soc));
+    tx_[n++] = status_;
+    seq_++;
+    send(n);
+}
+
+static uint8_t varint(uint8_t *p, uint32_t v) {
+    uint8_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = v | 0x80;
+        v >>= 7;
+    }
+    p[n++] = v;
+    return n;
+}
+
+static uint32_t zigzag(const int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+
+static_assert(3 + 5 + 3 * BQ::cells + 5 + 3 * BQ::thermistors + 5 + 1 <= TEL_TX_SIZE, "TEL_STREAM record fits tx_");
+
+// Unchanged cells cost a byte each, a keyframe about two.
+void Telemetry::record() {
+    const bool key = !key_;
+    const uint32_t now = mcu::Timer::millis();
+    const uint32_t state = (bq_.isChargingEnabled() ? 1 : 0) | (bq_.isDischargingEnabled() ? 2 : 0)
+                         | data_.balancingStatus_ << 2;
+    uint8_t n = 0;
+    tx_[n++] = TEL_STREAM;
+    tx_[n++] = seq_;
+    tx_[n++] = key ? TEL_KEYFRAME : 0;
+    n += varint(tx_ + n, key ? now : now - lastMs_);
+    for (uint8_t i = 0; i < BQ::cells; i++) {
+        const uint16_t v = stats_.cellVoltages_[i];
+        n += varint(tx_ + n, zigzag(key ? v : (int32_t)v - lastCells_[i]));
+    }
+    n += varint(tx_ + n, zigzag(key ? data_.batCurrent_ : data_.batCurrent_ - lastCurrent_));
+    for (uint8_t i = 0; i < BQ::thermistors; i++) {
+        const int16_t t = stats_.temperatures_[i];
+        n += varint(tx_ + n, zigzag(key ? t : (int32_t)t - lastTemps_[i]));
+    }
+    n += varint(tx_ + n, key ? state : state ^ lastState_);
+    seq_++;
+    send(n);
+    key_ = key ? TEL_KEYFRAME_EVERY - 1 : key_ - 1;
+    lastMs_ = now;
+    lastCurrent_ = data_.batCurrent_;
+    lastState_ = state;
+    memcpy(lastCells_, stats_.cellVoltages_, sizeof(lastCells_));
+    memcpy(lastTemps_, stats_.temperatures_, sizeof(lastTemps_));
+}
+
+void Telemetry::conf(const uint8_t id) {
+    const ConfField f = conf_field((PrintParam)id);
+    pump(true);
+    tx_[0] = TEL_CONF;
+    tx_[1] = id;
+    send(put(2, (const uint8_t *)&conf_ + f.offset, f.size * f.count));
+}
+
+void Telemetry::converted(const uint8_t status) {
+    status_ = status;
+    if (!active_ || !every_) return;
+    if (++count_ < every_) return;
+    count_ = 0;
+    // the conversions must not wait on the UART: while the last frame is
+    // still going out this one is skipped, the next record is a keyframe
+    if (!pump(false)) {
+        seq_++;
+        key_ = 0;
+        return;
+    }
+    if (delta_) record(); else sample();
+}
+
+//----------------------------------------------------------------------------
+// requests
+
+// COBS decode in place, the CRC byte stays at the end
+static uint8_t cobs_decode(uint8_t *buf, const uint8_t len) {
+    uint8_t r = 0, w = 0;
+    while (r < len) {
+        const uint8_t code = buf[r++];
+        if (!code || r + code - 1 > len) return 0;
+        for (uint8_t i = 1; i < code; i++) buf[w++] = buf[r++];
+        if (code < 0xFF && r < len) buf[w++] = 0;
+    }
+    return w;
+}
+
+TelEvent Telemetry::request(uint8_t len) {
+    len = cobs_decode(rx_, len);
+    if (len < 2 || utils::crc8(rx_, len)) {
+        nak(len ? rx_[0] : 0, TEL_ERR_CRC);
+        return TEL_RECEIVED;
+    }
+    len--;
+    const uint8_t type = rx_[0];
+    switch (type) {
+        case TEL_SAMPLE:
+            sample();
+            return TEL_RECEIVED;
+        case TEL_GET:
+        case TEL_SET: {
+            if (len < 2) break;
+            const uint8_t id = rx_[1];
+            if (id > LAST) {
+                nak(type, TEL_ERR_ID);
+                return TEL_RECEIVED;
+            }
+            if (type == TEL_GET) {
+                if (len != 2) break;
+                conf(id);
+                return TEL_RECEIVED;
+            }
+            const ConfField f = conf_field((PrintParam)id);
+            if (f.flags & CONF_READONLY) {
+                nak(type, TEL_ERR_READONLY);
+                return TEL_RECEIVED;
+            }
+            if (len != 2 + f.size * f.count) break;
+            if (!conf_valid((PrintParam)id, rx_ + 2, f.count)) {
+                nak(type, TEL_ERR_RANGE);
+                return TEL_RECEIVED;
+            }
+            memcpy((uint8_t *)&conf_ + f.offset, rx_ + 2, f.size * f.count);
+            conf(id);
+            return TEL_CONF_SET;
+        }
+        case TEL_EVERY:
+            if (len != 2) break;
+            every_ = rx_[1];
+            count_ = 0;
+            delta_ = false;
+            ack(type);
+            return TEL_RECEIVED;
+        case TEL_STREAM:
+            if (len != 2) break;
+            stream(rx_[1]);
+            ack(type);
+            return TEL_RECEIVED;
+        case TEL_SAVE:
+            if (len != 1) break;
+            return TEL_CONF_SAVE;       // acked once written
+        case TEL_EXIT:
+            if (len != 1) break;
+            ack(type);
+            end();
+            return TEL_ENDED;
+        default:
+            nak(type, TEL_ERR_TYPE);
+            return TEL_RECEIVED;
+    }
+    nak(type, TEL_ERR_LEN);
+    return TEL_RECEIVED;
+}
+
+// one request per call, the rest stays in the RX ring
+TelEvent Telemetry::update() {
+    pump(false);
+    while (ser_.avail()) {
+        const uint8_t c = ser_.read();
+        if (c) {
+            if (rxLen_ < TEL_RX_SIZE) rx_[rxLen_++] = c;
+            else rxOverflow_ = true;
+            continue;
+        }
+        const uint8_t len = rxLen_;
+        rxLen_ = 0;
+        if (rxOverflow_) {
+            rxOverflow_ = false;
+            nak(0, TEL_ERR_LEN);
+            return TEL_RECEIVED;
+        }
+        if (len) return request(len);   // empty frames: the magic, resync
+    }
+    return TEL_NONE;
+}
+
+}
@@ -0,0 +1,146 @@
+/* Shell console for battery management based on bq769x Ic
+ * Copyright (c) 2022 Sergey Kostanoy (https://arduino.uno)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "utils/cpp.h"
+#include "mcu/usart.h"
+#include "protocol/conf_table.h"
+
+// Binary telemetry: COBS frames ended by 0x00, the last payload byte is
+// the CRC-8 (utils/crc) of the ones before, the first the frame type.
+// Multi-byte values are little endian.
+//
+// from the BMS
+//   TEL_SAMPLE   seq u16, millis u32, bq769_data<BQ> as packed in
+//                devices/bq769x0.h, cell mV u16[cells], temperature
+//                C/10 i16[thermistors], SOC 0.01 % u16, update() status u8
+//   TEL_STREAM   seq u8, flags u8 (TEL_KEYFRAME), then varints (LEB128):
+//                ms since the last record, cell mV[cells], current mA,
+//                temperature C/10[thermistors] as zigzag deltas to the
+//                last record, FET (CHG 1, DSG 2) | balancing bits << 2 as
+//                XOR to the last. A keyframe is against zeros, every
+//                TEL_KEYFRAME_EVERY records and after a dropped one.
+//   TEL_CONF     id u8, the field's bytes (conf_table.h)
+//   TEL_ACK      type u8 of the request
+//   TEL_NAK      type u8 of the request (0 if unreadable), TEL_ERR_*
+// to the BMS
+//   TEL_SAMPLE   empty, one sample now
+//   TEL_GET      id u8
+//   TEL_SET      id u8, the field's bytes; answered with TEL_CONF, out of
+//                range with TEL_ERR_RANGE and nothing stored
+//   TEL_EVERY    n u8: a sample after every n-th conversion, 0 on request only
+//   TEL_STREAM   n u8: the same with TEL_STREAM records
+//   TEL_SAVE     conf to EEPROM
+//   TEL_EXIT     back to the text console
+//
+// Entered with the 'binary' or 'stream' command, or by TEL_MAGIC_ZEROS 0x00 bytes at
+// the text console (Usart::binary_request()). Text output is muted while
+// binary mode is on.
+#define TEL_CONVERSION_MS   250             // bq769x0 ADC, the records follow it
+#define TEL_KEYFRAME_EVERY  16
+#define TEL_RX_SIZE     40                  // longest request: TEL_SET of adcCellsOffset_
+#define TEL_TX_SIZE     (8 + sizeof(devices::bq769_data<BQ>) + 2 * BQ::cells + 2 * BQ::thermistors + 3)
+
+namespace protocol {
+
+enum TelType : uint8_t {
+    TEL_SAMPLE  = 0x01,
+    TEL_CONF    = 0x02,
+    TEL_STREAM  = 0x03,
+    TEL_GET     = 0x10,
+    TEL_SET     = 0x11,
+    TEL_EVERY   = 0x12,
+    TEL_SAVE    = 0x13,
+    TEL_EXIT    = 0x1F,
+    TEL_ACK     = 0x7E,
+    TEL_NAK     = 0x7F,
+};
+
+enum TelFlags : uint8_t {
+    TEL_KEYFRAME    = 0x01,
+};
+
+enum TelError : uint8_t {
+    TEL_ERR_CRC = 1,            // or bad COBS
+    TEL_ERR_TYPE,
+    TEL_ERR_ID,
+    TEL_ERR_LEN,
+    TEL_ERR_READONLY,
+    TEL_ERR_RANGE,              // a value outside the field's limits (conf_table.cc)
+};
+
+// what the console has to do after update()
+enum TelEvent : uint8_t {
+    TEL_NONE,
+    TEL_RECEIVED,
+    TEL_CONF_SET,               // apply the conf
+    TEL_CONF_SAVE,
+    TEL_ENDED,
+};
+
+class Telemetry {
+public:
+    Telemetry(mcu::Usart &ser, Conf &conf, devices::bq769_data<BQ> &data,
+              devices::bq769_stats<BQ> &stats, devices::bq769x0<BQ> &bq);
+    void begin();
+    void end();
+    bool active() const { return active_; }
+    bool streaming() const { return active_ && every_; }
+    bool sending() const { return txPhase_ != TX_IDLE; }   // a frame is partly queued
+    void stream(const uint8_t every);   // TEL_STREAM records instead of samples
+    TelEvent update();                  // requests from the host
+    void converted(const uint8_t status);   // after every bq.update()
+    void ack(const uint8_t type);
+private:
+    mcu::Usart &ser_;
+    Conf &conf_;
+    devices::bq769_data<BQ> &data_;
+    devices::bq769_stats<BQ> &stats_;
+    devices::bq769x0<BQ> &bq_;
+    uint8_t tx_[TEL_TX_SIZE];
+    uint8_t rx_[TEL_RX_SIZE];
+    uint8_t rxLen_;
+    bool rxOverflow_;
+    enum TxPhase : uint8_t { TX_IDLE, TX_CODE, TX_DATA, TX_END };
+    TxPhase txPhase_;                   // of the frame in tx_ going out
+    uint8_t txLen_, txStart_, txEnd_, txPos_;
+    bool active_;
+    uint8_t every_;
+    uint8_t count_;
+    uint8_t status_;
+    uint16_t seq_;
+    bool delta_;
+    uint8_t key_;                       // records until the next keyframe
+    uint32_t lastMs_;                   // what the last TEL_STREAM record sent
+    int32_t lastCurrent_;
+    uint32_t lastState_;
+    uint16_t lastCells_[BQ::cells];
+    int16_t lastTemps_[BQ::thermistors];
+
+    uint8_t put(uint8_t n, const void *p, const uint8_t len);
+    void send(const uint8_t len);
+    bool pump(const bool wait);
+    void sample();
+    void record();
+    void conf(const uint8_t id);
+    void nak(const uint8_t type, const TelError err);
+    TelEvent request(uint8_t len);
+    DISALLOW_COPY_AND_ASSIGN(Telemetry);
+};
+
+}
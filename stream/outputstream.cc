@@ -1,13 +1,76 @@
 #include "outputstream.h"
 
 #include <avr/pgmspace.h>
-#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
 namespace stream {
 
-OutputStream::OutputStream() : flags(0) {}
+namespace {
+
+// "00".."99": one division by 100 gives two decimal digits
+char const DIGIT_PAIRS[200] PROGMEM = {
+    '0','0','0','1','0','2','0','3','0','4','0','5','0','6','0','7','0','8','0','9',
+    '1','0','1','1','1','2','1','3','1','4','1','5','1','6','1','7','1','8','1','9',
+    '2','0','2','1','2','2','2','3','2','4','2','5','2','6','2','7','2','8','2','9',
+    '3','0','3','1','3','2','3','3','3','4','3','5','3','6','3','7','3','8','3','9',
+    '4','0','4','1','4','2','4','3','4','4','4','5','4','6','4','7','4','8','4','9',
+    '5','0','5','1','5','2','5','3','5','4','5','5','5','6','5','7','5','8','5','9',
+    '6','0','6','1','6','2','6','3','6','4','6','5','6','6','6','7','6','8','6','9',
+    '7','0','7','1','7','2','7','3','7','4','7','5','7','6','7','7','7','8','7','9',
+    '8','0','8','1','8','2','8','3','8','4','8','5','8','6','8','7','8','8','8','9',
+    '9','0','9','1','9','2','9','3','9','4','9','5','9','6','9','7','9','8','9','9',
+};
+
+char const HEX_DIGITS[16] PROGMEM = {
+    '0','1','2','3','4','5','6','7','8','9','A','B','C','D','E','F',
+};
+
+uint32_t const POW10[FIXED_MAX + 1] PROGMEM = {
+    1UL, 10UL, 100UL, 1000UL, 10000UL, 100000UL, 1000000UL, 10000000UL, 100000000UL, 1000000000UL,
+};
+
+char *pair(char *p, const uint8_t v) {
+    const char *d = &DIGIT_PAIRS[2 * v];
+    *--p = pgm_read_byte(d + 1);
+    *--p = pgm_read_byte(d);
+    return p;
+}
+
+// exactly n digits of v, right to left ending before p
+char *digits(char *p, uint32_t v, uint8_t n) {
+    for (; n >= 2 && v > 0xFFFF; n -= 2) {
+        p = pair(p, v % 100);
+        v /= 100;
+    }
+    uint16_t w = v;             // 16 bit divisions from here, far cheaper on AVR
+    for (; n >= 2; n -= 2) {
+        p = pair(p, w % 100);
+        w /= 100;
+    }
+    if (n) *--p = '0' + w % 10;
+    return p;
+}
+
+// all digits of v, at least one
+char *decimal(char *p, uint32_t v) {
+    while (v > 0xFFFF) {
+        p = pair(p, v % 100);
+        v /= 100;
+    }
+    uint16_t w = v;
+    while (w >= 100) {
+        p = pair(p, w % 100);
+        w /= 100;
+    }
+    if (w >= 10) return pair(p, w);
+    *--p = '0' + w;
+    return p;
+}
+
+}  // namespace
+
+OutputStream::OutputStream() : flags(0), width(0), decimals(0) {}
 
 OutputStream::~OutputStream() {}
 
@@ -21,6 +84,16 @@ OutputStream &OutputStream::operator<<(const Spaces spaces) {
     return *this;
 }
 
+OutputStream &OutputStream::operator<<(const Width w) {
+    width = w.num;
+    return *this;
+}
+
+OutputStream &OutputStream::operator<<(const Fixed fixed) {
+    decimals = fixed.decimals > FIXED_MAX ? FIXED_MAX : fixed.decimals;
+    return *this;
+}
+
 OutputStream &OutputStream::operator<<(const char ch) {
     write(ch);
     return *this;
@@ -28,7 +101,7 @@ OutputStream &OutputStream::operator<<(const char ch) {
 
 OutputStream &OutputStream::operator<<(const char *str) {
     if (flags & (1 << Flags::PGM)) {
-        while (pgm_read_byte(str)) write(pgm_read_byte(str++));
+        write_P(str);
     } else {
         while (*str) write(*str++);
     }
@@ -37,97 +110,131 @@ OutputStream &OutputStream::operator<<(const char *str) {
 }
 
 
-OutputStream &OutputStream::operator<<(const   int8_t val){
-    memset(buffer, 0, sizeof(*buffer));
-    itoa(val, buffer, 10);
-    return *this << buffer;
+void OutputStream::write(const char *buf, const uint8_t len) {
+    for (uint8_t i = 0; i < len; i++) write(buf[i]);
 }
 
-OutputStream &OutputStream::operator<<(const  int16_t val){
-    memset(buffer, 0, sizeof(*buffer));
-    itoa(val, buffer, 10);
-    return *this << buffer;
-    
+void OutputStream::write_P(const char *str) {
+    while (pgm_read_byte(str)) write(pgm_read_byte(str++));
 }
 
-OutputStream &OutputStream::operator<<(const  int32_t val){
-    memset(buffer, 0, sizeof(*buffer));
-    itoa(val, buffer, 10);
-    return *this << buffer;
+void OutputStream::write_P(const char *buf, const uint16_t len) {
+    for (uint16_t i = 0; i < len; i++) write(pgm_read_byte(buf + i));
 }
 
-OutputStream &OutputStream::operator<<(const uint8_t val) {
-    if (flags == 0) {
-        memset(buffer, 0, sizeof(*buffer));
-        utoa(val, buffer, 10);
-        return *this << buffer;
+// Made right to left in a scratch of the widest field, padding and sign
+// included, and handed to the sink as one run
+void OutputStream::number(uint32_t val, const bool neg) {
+    char buf[NUMBER_MAX + 1];
+    char *const end = buf + sizeof(buf);
+    char *p = end;
+    if (flags & (1 << Flags::BIN)) {
+        do { *--p = '0' + (val & 1); } while (val >>= 1);
+    } else if (flags & (1 << Flags::HEX)) {
+        do { *--p = pgm_read_byte(&HEX_DIGITS[val & 0x0F]); } while (val >>= 4);
+    } else if (decimals) {
+        const uint32_t unit = pgm_read_dword(&POW10[decimals]);
+        p = digits(p, val % unit, decimals);
+        *--p = '.';
+        p = decimal(p, val / unit);
+    } else {
+        p = decimal(p, val);
     }
-    
-    else if (flags & ((1 << Flags::PAD_ZERO) | (1 << Flags::PAD_SPACE))) {
-        if (val < 10)
-            *this << static_cast<char>(flags & (1 << Flags::PAD_ZERO) ? '0' : ' ');
-        else
-            *this << static_cast<char>('0' + val / 10);
-        *this << static_cast<char>('0' + val % 10);
+    char *const start = end - (width < sizeof(buf) ? width : sizeof(buf));
+    if (flags & (1 << Flags::PAD_ZERO)) {
+        while (p > start + neg) *--p = '0';
     }
-    
+    if (neg) *--p = '-';
+    while (p > start) *--p = ' ';
     flags = 0;
+    width = 0;
+    decimals = 0;
+    write(p, end - p);
+}
+
+OutputStream &OutputStream::operator<<(const int8_t val) {
+    return *this << (int32_t)val;
+}
+
+OutputStream &OutputStream::operator<<(const uint8_t val) {
+    number(val, false);
+    return *this;
+}
+
+OutputStream &OutputStream::operator<<(const int16_t val) {
+    return *this << (int32_t)val;
+}
+
+OutputStream &OutputStream::operator<<(const uint16_t val) {
+    number(val, false);
     return *this;
 }
 
-OutputStream &OutputStream::operator<<(const uint16_t val){
-    memset(buffer, 0, sizeof(*buffer));
-    ltoa(val, buffer, 10);
-    return *this << buffer;
+OutputStream &OutputStream::operator<<(const int32_t val) {
+    number(val < 0 ? 0UL - (uint32_t)val : (uint32_t)val, val < 0);
+    return *this;
 }
 
-OutputStream &OutputStream::operator<<(const uint32_t val){
-    memset(buffer, 0, sizeof(*buffer));
-    ltoa(val, buffer, 10);
-    return *this << buffer;
-    
+OutputStream &OutputStream::operator<<(const uint32_t val) {
+    number(val, false);
+    return *this;
 }
 
 OutputStream &OutputStream::operator<<(const float val) {
-    double number = val;
-    uint8_t digits = 2; // TODO
-    
-    if (isnan(number)) return *this << "nan";
-    if (isinf(number)) return *this << "inf";
-    if (number > 4294967040.0) return *this << "ovf";  // constant determined empirically
-    if (number <-4294967040.0) return *this << "ovf";  // constant determined empirically
-    
-    // Handle negative numbers
-    if (number < 0.0) {
-        write('-');
-        number = -number;
-    }
-    
-    // Round correctly so that print(1.999, 2) prints as "2.00"
-    double rounding = 0.5;
-    for (uint8_t i=0; i<digits; ++i)
-        rounding /= 10.0;
-    
-    number += rounding;
-    
-    // Extract the integer part of the number and print it
-    uint32_t int_part = (uint32_t)number;
-    double remainder = number - (double)int_part;
-    *this << int_part;
-    
-    // Print the decimal point, but only if there are digits beyond
-    if (digits > 0) { write('.'); }
-    
-    // Extract digits from the remainder one at a time
-    while (digits-- > 0) {
-        remainder *= 10.0;
-        uint16_t toPrint = (uint16_t)(remainder);
-        *this << toPrint ;
-        remainder -= toPrint; 
-    }
+    real(val);
     return *this;
 }
 
+// rounded once to hundredths, then a fixed-point number: one float
+// multiply instead of a loop of them
+void OutputStream::real(const float val) {
+    const float mag = fabsf(val) * 100.0f + 0.5f;
+    if (isnan(val) || mag >= 4294967040.0f) {    // largest float below 2^32, inf too
+        width = 0;
+        decimals = 0;
+        *this << (isnan(val) ? "nan" : isinf(val) ? "inf" : "ovf");
+        return;
+    }
+    const uint32_t hundredths = (uint32_t)mag;
+    decimals = 2;
+    number(hundredths, val < 0 && hundredths);
+}
 
+// The interpreter of PRINT_P(): a text run up to the next op or the end
+// is one write_P(), an op sets up the next number like the manipulators
+void OutputStream::print_P(const char *ops, const FmtArg *args) {
+    for (;;) {
+        const char *text = ops;
+        uint8_t c;
+        while ((c = pgm_read_byte(ops)) > FMT_ARG) ops++;
+        if (ops != text) write_P(text, ops - text);
+        if (!c) return;
+        const uint8_t spec = pgm_read_byte(ops + 1);
+        width = pgm_read_byte(ops + 2) & ~FMT_WIDTH;
+        ops += FMT_OP_SIZE;
+        flags = (spec & FMT_ZERO ? 1 << Flags::PAD_ZERO : 0)
+              | (spec & FMT_HEX ? 1 << Flags::HEX : 0)
+              | (spec & FMT_BIN ? 1 << Flags::BIN : 0);
+        decimals = spec & FMT_DECIMALS;
+        switch (args->kind) {
+            case FmtArg::UNSIGNED:
+                number(args->u, false);
+                break;
+            case FmtArg::SIGNED:
+                number(args->i < 0 ? 0UL - (uint32_t)args->i : (uint32_t)args->i, args->i < 0);
+                break;
+            case FmtArg::REAL:
+                real(args->f);
+                break;
+            default:
+                flags = 0;
+                width = 0;
+                decimals = 0;
+                *this << args->s;
+                break;
+        }
+        args++;
+    }
+}
 
 }  // namespace stream
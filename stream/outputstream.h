@@ -2,43 +2,185 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <avr/pgmspace.h>
 
 #define EOL "\r\n"
 #define CR '\r'
 #define LF '\n'
 
+#define NUMBER_MAX  32      // longest field before padding, 32 bit in binary
+#define FIXED_MAX   9       // decimals of a 32 bit value
+
+// PRINT_P(out, "BAT Voltage: {} mV ({} raw)", mV, raw)
+// The format is compiled at build time into a flash op-stream: text as
+// it is, every {} as FMT_ARG and its spec. OutputStream::print_P() runs
+// it in one loop, text runs go to write_P() whole, each {} prints the
+// next argument. A {} may carry [0][width][.decimals][x|b], e.g. {.1}
+// for 0.1 degC, {08b} for a register; a float is always 2 decimals.
+// The text holds no braces, the argument count is checked at compile time.
+#define PRINT_P(out, fmt, ...) do { \
+        static constexpr stream::FmtOps<stream::fmt_size(fmt)> ops_ PROGMEM = \
+            stream::fmt_compile<stream::fmt_size(fmt)>(fmt); \
+        const stream::FmtArg args_[] = { __VA_ARGS__ }; \
+        static_assert(sizeof(args_) / sizeof(args_[0]) == stream::fmt_args(fmt), \
+                      "PRINT_P: placeholders and arguments differ in count"); \
+        (out).print_P(ops_.op, args_); \
+    } while (0)
+
+#define FMT_ARG         0x01    // op, spec and width follow; text bytes are above it
+#define FMT_OP_SIZE     3
+#define FMT_SPEC        0x80    // never 0, the op-stream ends at NUL
+#define FMT_ZERO        0x40
+#define FMT_HEX         0x10
+#define FMT_BIN         0x20
+#define FMT_DECIMALS    0x0F
+#define FMT_WIDTH       0x80
+
 namespace stream {
 
-enum Flags : uint8_t { PGM, PAD_ZERO, PAD_SPACE };
+// PGM: the next string is in flash. PAD_ZERO, PAD_SPACE: what fills the
+// Width of the next number (space by default). HEX, BIN: its radix.
+// All of them last for the next string or number only.
+enum Flags : uint8_t { PGM, PAD_ZERO, PAD_SPACE, HEX, BIN };
 
 struct Spaces {
     explicit constexpr Spaces(const size_t num) : num(num) {}
     const size_t num;
 };
 
+// at least num characters for the next number, sign included, up to NUMBER_MAX + 1
+struct Width {
+    explicit constexpr Width(const uint8_t num) : num(num) {}
+    const uint8_t num;
+};
+
+// the next integer counts 10^-decimals units, Fixed(3) << 3650 is 3.650
+struct Fixed {
+    explicit constexpr Fixed(const uint8_t decimals) : decimals(decimals) {}
+    const uint8_t decimals;
+};
+
+// one PRINT_P argument
+struct FmtArg {
+    enum Kind : uint8_t { UNSIGNED, SIGNED, REAL, STRING };
+    union {
+        uint32_t u;
+        int32_t i;
+        float f;
+        const char *s;
+    };
+    Kind kind;
+    FmtArg(const  uint8_t v) : u(v), kind(UNSIGNED) {}
+    FmtArg(const uint16_t v) : u(v), kind(UNSIGNED) {}
+    FmtArg(const uint32_t v) : u(v), kind(UNSIGNED) {}
+    FmtArg(const   int8_t v) : i(v), kind(SIGNED) {}
+    FmtArg(const  int16_t v) : i(v), kind(SIGNED) {}
+    FmtArg(const  int32_t v) : i(v), kind(SIGNED) {}
+    FmtArg(const    float v) : f(v), kind(REAL) {}
+    FmtArg(const char *v) : s(v), kind(STRING) {}
+};
+
+template <size_t N>
+struct FmtOps { char op[N]; };
+
+void fmt_error();       // not constexpr: a bad format stops the build where it is called
+
+constexpr size_t fmt_args(const char *s) {
+    size_t n = 0;
+    for (; *s; s++) {
+        if (*s == '{') n++;
+    }
+    return n;
+}
+
+// bytes of the op-stream, NUL included
+constexpr size_t fmt_size(const char *s) {
+    size_t n = 1;
+    while (*s) {
+        if (*s++ != '{') {
+            n++;
+            continue;
+        }
+        while (*s && *s != '}') s++;
+        if (!*s++) fmt_error();
+        n += FMT_OP_SIZE;
+    }
+    return n;
+}
+
+template <size_t N>
+constexpr FmtOps<N> fmt_compile(const char *s) {
+    FmtOps<N> ops{};
+    size_t o = 0;
+    while (*s) {
+        if (*s == '}' || *s == FMT_ARG) fmt_error();
+        if (*s != '{') {
+            ops.op[o++] = *s++;
+            continue;
+        }
+        s++;
+        uint8_t spec = FMT_SPEC;
+        uint8_t width = 0;
+        if (*s == '0') {
+            spec |= FMT_ZERO;
+            s++;
+        }
+        while (*s >= '0' && *s <= '9') width = width * 10 + (*s++ - '0');
+        if (*s == '.') {
+            s++;
+            if (*s < '0' || *s > '0' + FIXED_MAX) fmt_error();
+            spec |= *s++ - '0';
+        }
+        if (*s == 'x') {
+            spec |= FMT_HEX;
+            s++;
+        } else if (*s == 'b') {
+            spec |= FMT_BIN;
+            s++;
+        }
+        if (*s++ != '}' || width > NUMBER_MAX + 1) fmt_error();
+        ops.op[o++] = FMT_ARG;
+        ops.op[o++] = spec;
+        ops.op[o++] = FMT_WIDTH | width;
+    }
+    return ops;
+}
+
 class OutputStream {
-    char buffer[34];
 public:
     OutputStream();
     virtual ~OutputStream();
-    
+
     OutputStream &operator<<(const Flags flags);
     OutputStream &operator<<(const Spaces spaces);
+    OutputStream &operator<<(const Width width);
+    OutputStream &operator<<(const Fixed fixed);
     OutputStream &operator<<(const char ch);
     OutputStream &operator<<(const char *str);
 
+    // signed values are sign and magnitude in every radix
     OutputStream &operator<<(const   int8_t val);
     OutputStream &operator<<(const  uint8_t val);
     OutputStream &operator<<(const  int16_t val);
     OutputStream &operator<<(const uint16_t val);
     OutputStream &operator<<(const  int32_t val);
     OutputStream &operator<<(const uint32_t val);
-    OutputStream &operator<<(const    float val);
+    OutputStream &operator<<(const    float val);     // 2 decimals, "ovf" from 2^32/100 on
+
+    void print_P(const char *ops, const FmtArg *args);  // PRINT_P()
 protected:
     virtual void write(const char ch) = 0;
-    
+    virtual void write(const char *buf, const uint8_t len);     // a run of bytes, copied
+    virtual void write_P(const char *str);  // flash string, a sink may take it whole
+    virtual void write_P(const char *buf, const uint16_t len);  // flash bytes, the same
+
 private:
     uint8_t flags;
+    uint8_t width;
+    uint8_t decimals;
+
+    void number(uint32_t val, const bool neg);
+    void real(const float val);
 };
-    
+
 }  // namespace stream
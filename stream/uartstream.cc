@@ -3,6 +3,8 @@
 
 namespace stream {
 
+bool UartStream::muted_ = false;
+
 UartStream::UartStream(mcu::Usart &uart) : uart(uart) {}
 
 bool UartStream::avail() { return uart.avail(); }
@@ -12,6 +14,15 @@ UartStream &UartStream::operator>>(char &ch) {
     return *this;
 }
 
-void UartStream::write(const char ch) { uart.write(ch); }
+void UartStream::write(const char ch) { if (!muted_) uart.write(ch); }
+
+void UartStream::write(const char *buf, const uint8_t len) {
+    if (muted_) return;
+    for (uint8_t i = 0; i < len; i++) uart.write(buf[i]);
+}
+
+void UartStream::write_P(const char *str) { if (!muted_) uart.write_P(str); }
+
+void UartStream::write_P(const char *buf, const uint16_t len) { if (!muted_) uart.write_P(buf, len); }
 
 }
@@ -9,13 +9,20 @@ class UartStream : public OutputStream {
 public:
     UartStream(mcu::Usart &uart);
     
+    // text off on every UartStream, while the port carries binary frames
+    static void mute(const bool on) { muted_ = on; }
+
     bool avail();
     UartStream &operator>>(char &ch);
     
 private:
     void write(const char ch) override;
+    void write(const char *buf, const uint8_t len) override;
+    void write_P(const char *str) override;     // queued as one flash block
+    void write_P(const char *buf, const uint16_t len) override;
     
     mcu::Usart &uart;
+    static bool muted_;
 };
 
 }
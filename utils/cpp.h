@@ -3,3 +3,22 @@
 #define DISALLOW_COPY_AND_ASSIGN(T) \
   T(T const &) = delete;            \
   void operator=(T const &) = delete
+
+#include <stdint.h>
+
+namespace utils {
+
+// Calls f(0) .. f(N - 1), unrolled at compile time for a constexpr N
+template <uint8_t N>
+struct Unroll {
+    template <typename F>
+    __attribute__((always_inline)) static inline void run(const F &f) { Unroll<N - 1>::run(f); f(N - 1); }
+};
+
+template <>
+struct Unroll<0> {
+    template <typename F>
+    __attribute__((always_inline)) static inline void run(const F &) {}
+};
+
+}  // namespace utils
@@ -2,9 +2,26 @@
 
 #include <stdint.h>
 
+// CRC-8/CCITT, polynomial 0x07, MSB first. Used for bq769x0 I2C framing
+// and for the conf/stats images in EEPROM.
+//
+// CRC8_IMPL selects the kernel at compile time (flash vs. speed):
+//   0 - bitwise, 8 iterations per byte, no table
+//   1 - nibble table, 16 bytes PROGMEM, 2 lookups per byte
+//   2 - byte table, 256 bytes PROGMEM, 1 lookup per byte
+#ifndef CRC8_IMPL
+#define CRC8_IMPL 1
+#endif
+
 namespace utils {
 
-uint8_t gencrc8(uint8_t *data, uint16_t len);
-    
-}
+uint8_t crc8_update(uint8_t crc, const uint8_t data);
+uint8_t crc8(const uint8_t *data, uint16_t len, uint8_t crc = 0);
 
+// CRC-16/MODBUS, polynomial 0x8005 reflected, init 0xFFFF, sent low byte
+// first. Byte table, 512 bytes PROGMEM: a Modbus RTU reply takes its CRC
+// byte by byte as it goes out.
+uint16_t crc16_update(const uint16_t crc, const uint8_t data);
+uint16_t crc16(const uint8_t *data, uint16_t len, uint16_t crc = 0xFFFF);
+
+}